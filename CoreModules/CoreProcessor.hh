@@ -1,4 +1,9 @@
 #pragma once
+#include "CoreModules/dirty_rect.hh"
+#include "CoreModules/index_mask.hh"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <span>
 #include <string>
@@ -12,6 +17,35 @@ public:
 
 	virtual void update() = 0;
 
+	// Process a block of frames.
+	// inputs[i] and outputs[i] point to buffers of num_frames samples for input jack i and output jack i.
+	// A nullptr input buffer means the host is not providing values for that jack (the module keeps
+	// the last value it was given). A nullptr output buffer means the host will not read that jack.
+	//
+	// The default implementation calls update() once per frame, so existing modules work unchanged.
+	// Modules can override this to process the whole block at once (e.g. with vectorized code).
+	//
+	// This is called in the audio context.
+	virtual void
+	update_block(std::span<const float *const> inputs, std::span<float *const> outputs, unsigned num_frames) {
+		for (unsigned frame = 0; frame < num_frames; frame++) {
+			for (unsigned i = 0; i < inputs.size(); i++) {
+				if (inputs[i])
+					set_input(i, inputs[i][frame]);
+			}
+
+			update();
+
+			for (unsigned i = 0; i < outputs.size(); i++) {
+				if (outputs[i])
+					outputs[i][frame] = get_output(i);
+			}
+		}
+	}
+
+	// set_param(), set_input(), the mark_*_patched() functions, load_state() and load_state_from()
+	// must not run at the same time as update() or update_block(). To change a running module from
+	// another thread, send a ModuleEvent (CoreModules/module_events.hh) which the audio thread applies.
 	virtual void set_samplerate(float sr) = 0;
 	virtual void set_param(int param_id, float val) = 0;
 	virtual void set_input(int input_id, float val) = 0;
@@ -23,10 +57,52 @@ public:
 	virtual size_t get_display_text(int display_id, std::span<char> text) {
 		return 0;
 	}
+
+	// Whether a display's text may have changed since `version`, which is updated to the current version.
+	// The GUI keeps a version per display (starting at 0) and only calls get_display_text() when this
+	// returns true. The default always returns true, for modules that don't keep versions.
+	virtual bool display_text_changed(int display_id, uint32_t &version) {
+		return true;
+	}
 	virtual float get_param(int param_id) const {
 		return 0;
 	}
 
+	// Bulk versions of set_input(), set_param(), get_output(), and get_led_brightness().
+	// vals[i] is the value for jack/param/light i.
+	// Only the indices selected by `mask` are read or written (see CoreModules/index_mask.hh).
+	// An empty mask selects all indices in `vals`.
+	//
+	// The default implementations call the single-value functions for each selected index.
+	virtual void set_inputs(std::span<const float> vals, std::span<const uint64_t> mask = {}) {
+		MetaModule::IndexMask::for_each_selected(mask, vals.size(), [&](size_t i) { set_input(i, vals[i]); });
+	}
+	virtual void set_params(std::span<const float> vals, std::span<const uint64_t> mask = {}) {
+		MetaModule::IndexMask::for_each_selected(mask, vals.size(), [&](size_t i) { set_param(i, vals[i]); });
+	}
+	virtual void get_outputs(std::span<float> vals, std::span<const uint64_t> mask = {}) const {
+		MetaModule::IndexMask::for_each_selected(mask, vals.size(), [&](size_t i) { vals[i] = get_output(i); });
+	}
+	virtual void get_led_brightnesses(std::span<float> vals, std::span<const uint64_t> mask = {}) const {
+		MetaModule::IndexMask::for_each_selected(mask, vals.size(), [&](size_t i) { vals[i] = get_led_brightness(i); });
+	}
+
+	// Lights whose brightness changed since the last call.
+	// Writes the light ids and brightnesses into ids and vals, and returns how many were written.
+	// If there are more changes than fit, the rest are returned by the next call.
+	// Size the spans for all of the module's lights: the default implementation (for modules that
+	// don't track changes) returns every light that fits.
+	//
+	// This is called in the GUI context, and may run at the same time as update().
+	virtual size_t get_changed_leds(std::span<uint16_t> ids, std::span<float> vals) {
+		auto num = std::min(ids.size(), vals.size());
+		for (size_t i = 0; i < num; i++) {
+			ids[i] = uint16_t(i);
+			vals[i] = get_led_brightness(i);
+		}
+		return num;
+	}
+
 	virtual void mark_all_inputs_unpatched() {
 	}
 	virtual void mark_input_unpatched(int input_id) {
@@ -40,12 +116,71 @@ public:
 	virtual void mark_output_patched(int output_id) {
 	}
 
+	// Bulk versions of the above: bit i of `patched` is set if jack i is patched.
+	// All other jacks are marked unpatched.
+	// Unlike an index mask (CoreModules/index_mask.hh), an empty `patched` does not select all:
+	// it means no jacks are patched, so it marks every input unpatched.
+	virtual void mark_inputs_patched(std::span<const uint64_t> patched) {
+		mark_all_inputs_unpatched();
+		if (!patched.empty())
+			MetaModule::IndexMask::for_each_selected(
+				patched, patched.size() * MetaModule::IndexMask::BitsPerWord, [&](size_t i) { mark_input_patched(i); });
+	}
+	// An empty `patched` marks every output unpatched, as with mark_inputs_patched()
+	virtual void mark_outputs_patched(std::span<const uint64_t> patched) {
+		mark_all_outputs_unpatched();
+		if (!patched.empty())
+			MetaModule::IndexMask::for_each_selected(
+				patched, patched.size() * MetaModule::IndexMask::BitsPerWord, [&](size_t i) { mark_output_patched(i); });
+	}
+
 	virtual void load_state(std::string_view state_data) {
 	}
 	virtual std::string save_state() {
 		return "";
 	}
 
+	// Binary state: an alternative to save_state()/load_state() that does not allocate.
+	// binary_state_size() is the number of bytes save_state_into() writes (0 if not supported).
+	// save_state_into() returns the number of bytes written, or 0 if the buffer is too small.
+	// load_state_from() returns false if the data was not made by this type of module.
+	virtual size_t binary_state_size() const {
+		return 0;
+	}
+	virtual size_t save_state_into(std::span<std::byte> buffer) {
+		return 0;
+	}
+	virtual bool load_state_from(std::span<const std::byte> data) {
+		return false;
+	}
+
+	// State generation: a counter that changes whenever the module's state changes,
+	// so a host can skip saving modules that have not changed.
+	// SmartCoreProcessor bumps it when a param value changes. Modules with other state
+	// (e.g. what they save in save_state()) should call mark_state_dirty() when it changes.
+	// Can be read from any thread.
+	uint32_t state_generation() const {
+		return std::atomic_ref{state_gen}.load(std::memory_order_acquire);
+	}
+
+	// Returns the new generation
+	uint32_t mark_state_dirty() {
+		return std::atomic_ref{state_gen}.fetch_add(1, std::memory_order_acq_rel) + 1;
+	}
+
+	// Delta state: the binary state that changed after generation `since_generation`,
+	// to be loaded on top of the earlier state with load_state_delta_from().
+	// By default this is the whole binary state.
+	virtual size_t state_delta_size(uint32_t since_generation) const {
+		return binary_state_size();
+	}
+	virtual size_t save_state_delta_into(uint32_t since_generation, std::span<std::byte> buffer) {
+		return save_state_into(buffer);
+	}
+	virtual bool load_state_delta_from(std::span<const std::byte> data) {
+		return load_state_from(data);
+	}
+
 	virtual ~CoreProcessor() = default;
 
 	// Whether or not the module is bypassed.
@@ -71,8 +206,25 @@ public:
 	show_graphic_display(int display_id, std::span<uint32_t> pix_buffer, unsigned width, lv_obj_t *lvgl_canvas) {
 	}
 
+	// Pixel format a module wants for a display's pixel buffer.
+	// With Rgb565, the GUI engine calls show_graphic_display_rgb565() instead of show_graphic_display(),
+	// with a 16-bit buffer. This halves the memory and bandwidth for displays that don't need alpha.
+	// Converters between the formats are in CoreModules/pixel_convert.hh
+	enum class PixelFormat { Rgba8888, Rgb565 };
+
+	virtual PixelFormat graphic_display_format(int display_id) {
+		return PixelFormat::Rgba8888;
+	}
+
+	// Same as show_graphic_display(), for displays whose graphic_display_format() is Rgb565.
+	// pix_buffer: RGB565 pixels (raw values of RGB565 colors)
+	virtual void
+	show_graphic_display_rgb565(int display_id, std::span<uint16_t> pix_buffer, unsigned width, lv_obj_t *lvgl_canvas) {
+	}
+
 	// Write pixel data to the display's pixel buffer.
-	// The pixel buffer will have been previously passed to the module via show_graphic_display().
+	// The pixel buffer will have been previously passed to the module via show_graphic_display()
+	// (or show_graphic_display_rgb565()).
 	// If you need to manually access the red, green, blue, and alpha values, use the helper class PixelRGBA in CoreModules/pixels.hh
 	//
 	// This is called in the GUI context.
@@ -82,6 +234,22 @@ public:
 		return false;
 	}
 
+	// Like draw_graphic_display(), but also reports which parts of the pixel buffer changed,
+	// so the GUI only has to copy and flush those.
+	// Write up to dirty_rects.size() rects (merging regions if there are more) and return how many were written.
+	// Return 0 if no pixels changed. Rects may extend past the buffer: the GUI clips them.
+	// MetaModule::DirtyRegion in CoreModules/dirty_rect.hh can be used to collect the regions while drawing.
+	//
+	// This is called in the GUI context, instead of draw_graphic_display().
+	// The default calls draw_graphic_display() and marks the whole buffer if it returns true.
+	//
+	virtual size_t draw_graphic_display_rects(int display_id, std::span<MetaModule::DirtyRect> dirty_rects) {
+		if (!draw_graphic_display(display_id) || dirty_rects.empty())
+			return 0;
+		dirty_rects[0] = MetaModule::DirtyRect::whole_display();
+		return 1;
+	}
+
 	// De-initialize graphics for a display
 	// The GUI engine calls this to inform the module that the display is now hidden.
 	// Perform any clean-up here.
@@ -94,4 +262,8 @@ public:
 	// common default values, OK to override or ignore
 	static constexpr float CvRangeVolts = 5.0f;
 	static constexpr float MaxOutputVolts = 8.0f;
+
+private:
+	// Not std::atomic, so modules stay copyable
+	alignas(std::atomic_ref<uint32_t>::required_alignment) mutable uint32_t state_gen{};
 };
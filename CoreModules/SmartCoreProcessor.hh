@@ -1,18 +1,48 @@
 #pragma once
 #include "CoreModules/CoreHelper.hh"
 #include "CoreModules/CoreProcessor.hh"
+#include "CoreModules/base64.hh"
 #include "CoreModules/elements/element_counter.hh"
 #include "CoreModules/elements/element_state_conversion.hh"
+#include "CoreModules/index_mask.hh"
+#include "CoreModules/module_registry.hh"
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <concepts>
+#include <cstring>
 #include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace MetaModule
 {
 
-template<typename INFO>
+// Options, passed as the second template argument (combine them with |):
+// struct MyModule : SmartCoreProcessor<MyInfo, WithParamSmoothing | WithBinaryState> {...}
+
+// Param smoothing: see setSmoothingTime()
+inline constexpr unsigned WithParamSmoothing = 1 << 0;
+
+// Binary and delta state (save_state_into() etc.) made of the param values and patched jacks.
+// Only for modules whose params are their whole state: text from save_state() is not included.
+// Without it, hosts save modules with save_state().
+inline constexpr unsigned WithBinaryState = 1 << 1;
+
+template<typename INFO, unsigned Options = 0>
 class SmartCoreProcessor : public CoreProcessor, public CoreHelper<INFO> {
 	using Elem = typename INFO::Elem;
 
+	static constexpr bool ParamSmoothing = Options & WithParamSmoothing;
+	static constexpr bool BinaryState = Options & WithBinaryState;
+
 	constexpr static auto element_index(Elem el) {
 		return static_cast<std::underlying_type_t<Elem>>(el);
 	}
@@ -22,6 +52,28 @@ class SmartCoreProcessor : public CoreProcessor, public CoreHelper<INFO> {
 		return ElementCount::count(INFO::Elements[element_idx]);
 	}
 
+	constexpr static bool isSmoothable(const Element &element) {
+		return std::visit(
+			[](auto el) {
+				using T = decltype(el);
+				return (std::derived_from<T, Pot> && !std::derived_from<T, KnobSnapped>) ||
+					   std::derived_from<T, AltParamContinuous>;
+			},
+			element);
+	}
+
+	constexpr static bool isSmoothable(Elem el) {
+		return isSmoothable(INFO::Elements[element_index(el)]);
+	}
+
+	constexpr static bool isTextDisplay(const Element &element) {
+		return std::visit([](auto el) { return std::derived_from<decltype(el), DynamicTextDisplay>; }, element);
+	}
+
+	constexpr static bool isTextDisplay(Elem el) {
+		return isTextDisplay(INFO::Elements[element_index(el)]);
+	}
+
 protected:
 	template<Elem EL>
 	void setOutput(float val) requires(count(EL).num_outputs == 1)
@@ -42,8 +94,8 @@ protected:
 	bool isPatched() requires(count(EL).num_outputs == 1)
 	{
 		auto idx = index(EL);
-		if (idx.output_idx < outputPatched.size())
-			return outputPatched[idx.output_idx];
+		if (idx.output_idx < outputValues.size())
+			return outputPatched.test(idx.output_idx);
 		else
 			return false;
 	}
@@ -53,7 +105,7 @@ protected:
 	{
 		auto idx = index(EL);
 		if (idx.input_idx < inputValues.size())
-			return inputValues[idx.input_idx].has_value();
+			return inputPatched.test(idx.input_idx);
 		else
 			return false;
 	}
@@ -62,7 +114,7 @@ protected:
 	std::optional<float> getInput() requires(count(EL).num_inputs == 1)
 	{
 		auto idx = index(EL);
-		if (idx.input_idx < inputValues.size()) {
+		if (idx.input_idx < inputValues.size() && inputPatched.test(idx.input_idx)) {
 			return inputValues[idx.input_idx];
 		} else
 			return std::nullopt;
@@ -114,6 +166,96 @@ protected:
 		}
 	}
 
+	// Display text
+	// setDisplayText() stores the text of a DynamicTextDisplay in the module. The value form only calls
+	// format when the value is different from the last call, so modules can call it on every update().
+	// format(value, std::span<char> buffer) writes the text and returns its length.
+	// Text is truncated to DisplayTextSize (32) characters.
+	//
+	// The value must be trivially copyable and at most 16 bytes (e.g. a number, enum or small struct).
+	// Values are compared byte by byte: a struct with padding must be zero-initialized (e.g. `T val{}`)
+	// or its padding may make equal values look different, and 0.f and -0.f count as different.
+	//
+	// Each change bumps the display's text version, so the GUI only copies text that changed
+	// (see display_text_changed()). Modules that override get_display_text() for other displays
+	// should call SmartCoreProcessor::get_display_text() for displays set with setDisplayText().
+	template<Elem EL, typename T, typename Format>
+	void setDisplayText(T const &value, Format &&format) requires(isTextDisplay(EL))
+	{
+		static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= DisplayText::MaxValueSize,
+					  "Use setDisplayText(std::string_view) for this type");
+
+		constexpr auto slot = TextDisplaySlots[index(EL).light_idx];
+		auto &display = displayTexts[slot];
+		if (display.has_value && std::memcmp(display.last_value.data(), &value, sizeof value) == 0)
+			return;
+
+		std::memcpy(display.last_value.data(), &value, sizeof value);
+		display.has_value = true;
+
+		std::array<char, DisplayTextSize> text;
+		size_t length = format(value, std::span<char>{text});
+		writeDisplayText(display, {text.data(), std::min(length, text.size())});
+	}
+
+	template<Elem EL>
+	void setDisplayText(std::string_view text) requires(isTextDisplay(EL))
+	{
+		constexpr auto slot = TextDisplaySlots[index(EL).light_idx];
+		auto &display = displayTexts[slot];
+		text = text.substr(0, DisplayTextSize);
+
+		display.has_value = false;
+		if (display.seq != 0 && std::string_view{display.text.data(), display.length} == text)
+			return;
+
+		writeDisplayText(display, text);
+	}
+
+	// Param smoothing (opt-in)
+	// Continuous params (Pots other than KnobSnapped, and AltParamContinuous) can be smoothed with a
+	// one-pole filter. To use it, derive from SmartCoreProcessor<INFO, WithParamSmoothing>, set a
+	// smoothing time for each element, call smoothParams() once per block or once per sample, and read
+	// the values with getSmoothedState() instead of getState(). Other modules have no smoothing state.
+	// The first value set for a param (e.g. when a patch loads) and loaded state are not smoothed.
+	// get_param() and the saved state always use the unsmoothed values.
+
+	// A time of 0 means no smoothing (this is the default)
+	template<Elem EL>
+	void setSmoothingTime(float seconds, float sample_rate) requires(ParamSmoothing && isSmoothable(EL))
+	{
+		constexpr auto slot = SmoothSlots[index(EL).param_idx];
+		auto samples = seconds * sample_rate;
+		smoothing.coefs[slot] = samples > 1.f ? 1.f - std::exp(-1.f / samples) : 1.f;
+		smoothing.block_frames = 0;
+	}
+
+	template<Elem EL>
+	float getSmoothedState() requires(ParamSmoothing && isSmoothable(EL))
+	{
+		return smoothing.current[SmoothSlots[index(EL).param_idx]];
+	}
+
+	// Moves all smoothed params towards their targets by num_frames samples
+	void smoothParams(unsigned num_frames = 1) requires(ParamSmoothing)
+	{
+		if constexpr (NumSmoothed > 0) {
+			if (num_frames != smoothing.block_frames)
+				updateBlockCoefs(num_frames);
+
+			// Plain loop over contiguous arrays, so the compiler vectorizes it
+			for (size_t i = 0; i < SmoothedArraySize; i++)
+				smoothing.current[i] += smoothing.block_coefs[i] * (smoothing.targets[i] - smoothing.current[i]);
+		}
+	}
+
+	// Jumps all smoothed params to their targets (e.g. after a preset change)
+	void resetSmoothing() requires(ParamSmoothing)
+	{
+		if constexpr (NumSmoothed > 0)
+			smoothing.current = smoothing.targets;
+	}
+
 private:
 	float getParamRaw(Elem el, size_t local_index = 0) {
 		auto idx = index(el);
@@ -124,8 +266,14 @@ private:
 	void setLEDRaw(Elem el, float val, size_t color_idx = 0) {
 		auto idx = index(el);
 		size_t led_idx = idx.light_idx + color_idx;
-		if (led_idx < ledValues.size())
-			ledValues[led_idx] = val;
+		if (led_idx < ledValues.size() && ledValues[led_idx] != val) {
+			std::atomic_ref{ledValues[led_idx]}.store(val, std::memory_order_relaxed);
+
+			// Always set the bit after the value, even if it looks set: the GUI may have just
+			// cleared it and read the previous value
+			std::atomic_ref changed{ledChanged.words[led_idx / IndexMask::BitsPerWord]};
+			changed.fetch_or(uint64_t{1} << (led_idx % IndexMask::BitsPerWord), std::memory_order_release);
+		}
 	}
 
 	constexpr static auto counts = ElementCount::count<INFO>();
@@ -136,7 +284,117 @@ private:
 		return (size_t)element_idx < indices.size() ? indices[element_idx] : ElementCount::NoElementIndices;
 	}
 
+	// Params that can be smoothed
+	constexpr static auto SmoothedParamMask = [] {
+		IndexMask::Bits<counts.num_params> mask;
+		for (size_t i = 0; i < INFO::Elements.size(); i++) {
+			if (isSmoothable(INFO::Elements[i]))
+				mask.set(indices[i].param_idx);
+		}
+		return mask;
+	}();
+
+	constexpr static size_t NumSmoothed = [] {
+		if (!ParamSmoothing)
+			return size_t{0};
+		size_t num = 0;
+		for (size_t i = 0; i < counts.num_params; i++)
+			num += SmoothedParamMask.test(i);
+		return num;
+	}();
+
+	// Padded to a whole number of 4-float vectors, so the smoothing loop has no scalar remainder
+	// (GCC only vectorizes loops with a remainder at -O3). Padding values stay at 0.
+	constexpr static size_t SmoothedArraySize = (NumSmoothed + 3) / 4 * 4;
+
+	// Display text storage: one per DynamicTextDisplay
+	constexpr static size_t DisplayTextSize = 32;
+
+	constexpr static size_t NumTextDisplays =
+		std::ranges::count_if(INFO::Elements, [](auto &el) { return isTextDisplay(el); });
+
+	// Display id (light index) -> index in displayTexts
+	constexpr static uint16_t NoTextDisplay = 0xFFFF;
+	constexpr static auto TextDisplaySlots = [] {
+		std::array<uint16_t, counts.num_lights> slots;
+		slots.fill(NoTextDisplay);
+		uint16_t slot = 0;
+		for (size_t i = 0; i < INFO::Elements.size(); i++) {
+			if (isTextDisplay(INFO::Elements[i]))
+				slots[indices[i].light_idx] = slot++;
+		}
+		return slots;
+	}();
+
+	// Param index -> index in the smoothing arrays
+	constexpr static uint16_t NotSmoothed = 0xFFFF;
+	constexpr static auto SmoothSlots = [] {
+		std::array<uint16_t, counts.num_params> slots{};
+		uint16_t slot = 0;
+		for (size_t i = 0; i < counts.num_params; i++)
+			slots[i] = SmoothedParamMask.test(i) ? slot++ : NotSmoothed;
+		return slots;
+	}();
+
+	void setSmoothingTarget(size_t param_id, float val) {
+		if constexpr (NumSmoothed > 0) {
+			if (auto slot = SmoothSlots[param_id]; slot != NotSmoothed) {
+				smoothing.targets[slot] = val;
+				// The first value jumps, so smoothed params don't ramp up from 0 when a patch loads
+				if (!smoothing.has_target.test(slot)) {
+					smoothing.current[slot] = val;
+					smoothing.has_target.set(slot);
+				}
+			}
+		}
+	}
+
+	void loadSmoothingTargets(bool jump) {
+		if constexpr (NumSmoothed > 0) {
+			for (size_t i = 0; i < counts.num_params; i++)
+				setSmoothingTarget(i, paramValues[i]);
+			if (jump)
+				smoothing.current = smoothing.targets;
+		}
+	}
+
+	// Coefficient for num_frames steps of the one-pole filter: 1 - (1 - coef)^num_frames
+	void updateBlockCoefs(unsigned num_frames) {
+		for (size_t i = 0; i < SmoothedArraySize; i++)
+			smoothing.block_coefs[i] = 1.f - std::pow(1.f - smoothing.coefs[i], float(num_frames));
+		smoothing.block_frames = num_frames;
+	}
+
 public:
+	// Same behavior as CoreProcessor::update_block(), but moves jack values directly
+	// instead of calling set_input() and get_output() for every jack on every frame.
+	// Modules can override this to process the whole block at once. Use the
+	// CoreHelper<INFO>::input_idx<> and output_idx<> constants to index the buffers.
+	void
+	update_block(std::span<const float *const> inputs, std::span<float *const> outputs, unsigned num_frames) override {
+		auto num_inputs = std::min(inputs.size(), inputValues.size());
+		auto num_outputs = std::min(outputs.size(), outputValues.size());
+
+		for (unsigned i = 0; i < num_inputs; i++) {
+			if (inputs[i])
+				inputPatched.set(i);
+		}
+
+		for (unsigned frame = 0; frame < num_frames; frame++) {
+			for (unsigned i = 0; i < num_inputs; i++) {
+				if (inputs[i])
+					inputValues[i] = inputs[i][frame];
+			}
+
+			update();
+
+			for (unsigned i = 0; i < num_outputs; i++) {
+				if (outputs[i])
+					outputs[i][frame] = outputValues[i];
+			}
+		}
+	}
+
 	float get_output(int output_id) const override {
 		if ((size_t)output_id < outputValues.size())
 			return outputValues[output_id];
@@ -145,14 +403,123 @@ public:
 	}
 
 	void set_input(int input_id, float val) override {
-		if ((size_t)input_id < inputValues.size())
+		if ((size_t)input_id < inputValues.size()) {
 			inputValues[input_id] = val;
+			inputPatched.set(input_id);
+		}
 	}
 
 	void set_param(int param_id, float val) override {
-		if ((size_t)param_id < paramValues.size()) {
+		if ((size_t)param_id < paramValues.size() && paramValues[param_id] != val) {
 			paramValues[param_id] = val;
+			paramGenerations[param_id] = mark_state_dirty();
+			setSmoothingTarget(param_id, val);
+		}
+	}
+
+	void set_inputs(std::span<const float> vals, std::span<const uint64_t> mask = {}) override {
+		// Only inputs that were given a value are marked patched
+		auto num_inputs = std::min(vals.size(), inputValues.size());
+		if (mask.empty()) {
+			// Modules with no inputs have a null inputValues.data()
+			if constexpr (counts.num_inputs > 0)
+				std::copy_n(vals.begin(), num_inputs, inputValues.begin());
+			inputPatched.set_first(num_inputs);
+		} else {
+			IndexMask::for_each_selected(mask, num_inputs, [&](size_t i) {
+				inputValues[i] = vals[i];
+				inputPatched.set(i);
+			});
+		}
+	}
+
+	void set_params(std::span<const float> vals, std::span<const uint64_t> mask = {}) override {
+		// Bump the state generation once, and only if a value changed
+		std::optional<uint32_t> generation;
+		auto num_params = std::min(vals.size(), paramValues.size());
+		IndexMask::for_each_selected(mask, num_params, [&](size_t i) {
+			if (paramValues[i] != vals[i]) {
+				if (!generation)
+					generation = mark_state_dirty();
+				paramValues[i] = vals[i];
+				paramGenerations[i] = *generation;
+				setSmoothingTarget(i, vals[i]);
+			}
+		});
+	}
+
+	void get_outputs(std::span<float> vals, std::span<const uint64_t> mask = {}) const override {
+		IndexMask::copy_selected<float>(outputValues, vals, mask);
+	}
+
+	void get_led_brightnesses(std::span<float> vals, std::span<const uint64_t> mask = {}) const override {
+		IndexMask::copy_selected<float>(ledValues, vals, mask);
+	}
+
+	// Text of displays set with setDisplayText(). Can be called at the same time as update().
+	size_t get_display_text(int display_id, std::span<char> text) override {
+		auto display = findDisplayText(display_id);
+		if (!display)
+			return 0;
+
+		size_t length = 0;
+		std::atomic_ref seq{display->seq};
+		for (unsigned attempt = 0; attempt < 4; attempt++) {
+			auto start_seq = seq.load(std::memory_order_acquire);
+			if (start_seq & 1)
+				continue;
+
+			length = std::min<size_t>(std::atomic_ref{display->length}.load(std::memory_order_relaxed), text.size());
+			for (size_t i = 0; i < length; i++)
+				text[i] = std::atomic_ref{display->text[i]}.load(std::memory_order_relaxed);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (seq.load(std::memory_order_relaxed) == start_seq)
+				break;
+			// Otherwise the text changed while copying: the version changed too, so the GUI will copy again
+		}
+		return length;
+	}
+
+	bool display_text_changed(int display_id, uint32_t &version) override {
+		auto display = findDisplayText(display_id);
+		if (!display)
+			return true;
+
+		auto seq = std::atomic_ref{display->seq}.load(std::memory_order_acquire);
+		// 0: setDisplayText() was never called, so the module may be making the text some other way
+		if (seq == 0)
+			return true;
+
+		return std::exchange(version, seq) != seq;
+	}
+
+	// Only returns the lights that setLED() changed, so the cost scales with the number of changes
+	size_t get_changed_leds(std::span<uint16_t> ids, std::span<float> vals) override {
+		auto max_num = std::min(ids.size(), vals.size());
+		size_t num = 0;
+
+		for (size_t word_idx = 0; word_idx < ledChanged.words.size(); word_idx++) {
+			std::atomic_ref changed{ledChanged.words[word_idx]};
+			if (changed.load(std::memory_order_relaxed) == 0)
+				continue;
+
+			auto bits = changed.exchange(0, std::memory_order_acquire);
+			while (bits) {
+				if (num == max_num) {
+					// Report the rest next time
+					changed.fetch_or(bits, std::memory_order_relaxed);
+					return num;
+				}
+
+				auto led_idx = word_idx * IndexMask::BitsPerWord + std::countr_zero(bits);
+				ids[num] = uint16_t(led_idx);
+				vals[num] = std::atomic_ref{ledValues[led_idx]}.load(std::memory_order_relaxed);
+				num++;
+				bits &= bits - 1;
+			}
 		}
+		return num;
 	}
 
 	float get_param(int param_id) const override {
@@ -171,42 +538,327 @@ public:
 	}
 
 	void mark_all_inputs_unpatched() override {
-		std::fill(inputValues.begin(), inputValues.end(), std::nullopt);
+		inputPatched.reset_all();
 	}
 
 	void mark_input_unpatched(const int input_id) override {
 		if ((size_t)input_id < inputValues.size())
-			inputValues[input_id].reset();
+			inputPatched.reset(input_id);
 	}
 
 	void mark_input_patched(const int input_id) override {
 		if ((size_t)input_id < inputValues.size()) {
 			// Marking an input patched, but not setting a voltage on the jack: assume 0V
-			if (!inputValues[input_id].has_value())
+			if (!inputPatched.test(input_id)) {
 				inputValues[input_id] = 0.f;
+				inputPatched.set(input_id);
+			}
 		}
 	}
 
 	void mark_all_outputs_unpatched() override {
-		std::fill(outputPatched.begin(), outputPatched.end(), false);
+		outputPatched.reset_all();
 	}
 
 	void mark_output_unpatched(int output_id) override {
-		if (size_t(output_id) < outputPatched.size())
-			outputPatched[output_id] = false;
+		if (size_t(output_id) < outputValues.size())
+			outputPatched.reset(output_id);
 	}
 
 	void mark_output_patched(int output_id) override {
-		if (size_t(output_id) < outputPatched.size())
-			outputPatched[output_id] = true;
+		if (size_t(output_id) < outputValues.size())
+			outputPatched.set(output_id);
+	}
+
+	// `patched` is a set of bits, not an index mask: empty means no jacks are patched
+	void mark_inputs_patched(std::span<const uint64_t> patched) override {
+		// Newly patched inputs start at 0V (see mark_input_patched)
+		if (!patched.empty()) {
+			for (size_t i = 0; i < inputValues.size(); i++) {
+				if (!inputPatched.test(i) && IndexMask::is_selected(patched, i))
+					inputValues[i] = 0.f;
+			}
+		}
+		inputPatched.assign(patched);
+	}
+
+	void mark_outputs_patched(std::span<const uint64_t> patched) override {
+		outputPatched.assign(patched);
+	}
+
+	// With WithBinaryState, binary state is the param values and the patched state of the jacks:
+	// [StateHeader][params: float x num_params][input patched words][output patched words]
+	// The header has a hash of INFO::slug, so state saved by another type of module is rejected.
+	// Without it, binary_state_size() is 0, like CoreProcessor's.
+	size_t binary_state_size() const override {
+		if (!BinaryState)
+			return 0;
+		return sizeof(StateHeader) + ParamBytes + InputPatchedBytes + OutputPatchedBytes;
+	}
+
+	size_t save_state_into(std::span<std::byte> buffer) override {
+		if (!BinaryState || buffer.size() < binary_state_size())
+			return 0;
+
+		auto *ptr = buffer.data();
+		ptr = write_bytes(ptr, &state_header, sizeof state_header);
+		ptr = write_bytes(ptr, paramValues.data(), ParamBytes);
+		ptr = write_bytes(ptr, inputPatched.words.data(), InputPatchedBytes);
+		ptr = write_bytes(ptr, outputPatched.words.data(), OutputPatchedBytes);
+		return ptr - buffer.data();
+	}
+
+	bool load_state_from(std::span<const std::byte> data) override {
+		StateHeader header;
+		if (!BinaryState || data.size() < binary_state_size())
+			return false;
+
+		auto *ptr = data.data();
+		ptr = read_bytes(&header, ptr, sizeof header);
+		if (header != state_header)
+			return false;
+
+		ptr = read_bytes(paramValues.data(), ptr, ParamBytes);
+		ptr = read_bytes(inputPatched.words.data(), ptr, InputPatchedBytes);
+		ptr = read_bytes(outputPatched.words.data(), ptr, OutputPatchedBytes);
+		paramGenerations.fill(mark_state_dirty());
+		loadSmoothingTargets(true);
+		return true;
+	}
+
+	// With WithBinaryState, delta state is the params whose values changed after the given generation:
+	// [DeltaHeader][ParamDelta x num_changed]
+	// Patched jacks are not included: they are set by the host, not saved by the module.
+	size_t state_delta_size(uint32_t since_generation) const override {
+		if (!BinaryState)
+			return 0;
+		return sizeof(DeltaHeader) + num_params_changed(since_generation) * sizeof(ParamDelta);
+	}
+
+	size_t save_state_delta_into(uint32_t since_generation, std::span<std::byte> buffer) override {
+		if (!BinaryState || buffer.size() < state_delta_size(since_generation))
+			return 0;
+
+		auto header = delta_header;
+		auto *ptr = buffer.data() + sizeof header;
+		for (uint32_t i = 0; i < paramValues.size(); i++) {
+			if (param_changed(i, since_generation)) {
+				ParamDelta param{i, paramValues[i]};
+				ptr = write_bytes(ptr, &param, sizeof param);
+				header.num_changed++;
+			}
+		}
+		write_bytes(buffer.data(), &header, sizeof header);
+		return ptr - buffer.data();
+	}
+
+	bool load_state_delta_from(std::span<const std::byte> data) override {
+		DeltaHeader header;
+		if (!BinaryState || data.size() < sizeof header)
+			return false;
+
+		auto *ptr = read_bytes(&header, data.data(), sizeof header);
+		if (header.magic != delta_header.magic || header.type_hash != delta_header.type_hash ||
+			header.num_params != delta_header.num_params)
+			return false;
+		if (data.size() < sizeof header + header.num_changed * sizeof(ParamDelta))
+			return false;
+
+		// Check every entry before changing anything, so bad data leaves the module as it was
+		auto *params = ptr;
+		for (unsigned i = 0; i < header.num_changed; i++) {
+			ParamDelta param;
+			ptr = read_bytes(&param, ptr, sizeof param);
+			if (param.param_id >= paramValues.size())
+				return false;
+		}
+
+		std::optional<uint32_t> generation;
+		ptr = params;
+		for (unsigned i = 0; i < header.num_changed; i++) {
+			ParamDelta param;
+			ptr = read_bytes(&param, ptr, sizeof param);
+			if (!generation)
+				generation = mark_state_dirty();
+			paramValues[param.param_id] = param.value;
+			paramGenerations[param.param_id] = *generation;
+		}
+		loadSmoothingTargets(true);
+		return true;
+	}
+
+	// Base64 helpers for putting binary data into the text state of save_state()/load_state().
+	// The span forms write into the caller's buffer and do not allocate.
+	// See Base64::encoded_size() and Base64::max_decoded_size() for sizing the buffer.
+	static size_t encode(std::span<const uint8_t> data, std::span<char> out) {
+		return Base64::encode(data, out);
+	}
+
+	// Returns nullopt if the text is not valid base64, or out is too small
+	static std::optional<size_t> decode(std::string_view encoded, std::span<uint8_t> out) {
+		return Base64::decode(encoded, out);
+	}
+
+	static std::string encode(std::span<const uint8_t> data) {
+		std::string encoded(Base64::encoded_size(data.size()), '\0');
+		Base64::encode(data, encoded);
+		return encoded;
+	}
+
+	// Returns an empty vector if the text is not valid base64
+	static std::vector<uint8_t> decode(std::string_view encoded) {
+		std::vector<uint8_t> data(Base64::max_decoded_size(encoded.size()));
+		data.resize(Base64::decode(encoded, data).value_or(0));
+		return data;
 	}
 
 private:
-	std::array<float, counts.num_params> paramValues{};
-	std::array<std::optional<float>, counts.num_inputs> inputValues{0};
+	// Identifies the type of module that saved the state
+	static constexpr uint32_t TypeHash = uint32_t(slug_hash(INFO::slug));
+
+	struct StateHeader {
+		uint32_t magic;
+		uint32_t type_hash;
+		uint16_t num_params;
+		uint16_t num_inputs;
+		uint16_t num_outputs;
+		uint16_t reserved;
+
+		bool operator==(const StateHeader &) const = default;
+	};
+
+	static constexpr StateHeader state_header{
+		.magic = 0x3253534D, // "MSS2"
+		.type_hash = TypeHash,
+		.num_params = uint16_t(counts.num_params),
+		.num_inputs = uint16_t(counts.num_inputs),
+		.num_outputs = uint16_t(counts.num_outputs),
+		.reserved = 0,
+	};
+
+	struct DeltaHeader {
+		uint32_t magic;
+		uint32_t type_hash;
+		uint16_t num_params;
+		uint16_t num_changed;
+	};
+
+	struct ParamDelta {
+		uint32_t param_id;
+		float value;
+	};
+
+	static constexpr DeltaHeader delta_header{
+		.magic = 0x3244534D, // "MSD2"
+		.type_hash = TypeHash,
+		.num_params = uint16_t(counts.num_params),
+		.num_changed = 0,
+	};
+
+	// Wrap-around safe: true if the param changed after the given generation
+	bool param_changed(size_t param_id, uint32_t since_generation) const {
+		return int32_t(paramGenerations[param_id] - since_generation) > 0;
+	}
+
+	size_t num_params_changed(uint32_t since_generation) const {
+		size_t num = 0;
+		for (size_t i = 0; i < paramGenerations.size(); i++)
+			num += param_changed(i, since_generation);
+		return num;
+	}
+
+	// Not sizeof(): an empty std::array has a size of 1
+	static constexpr size_t ParamBytes = counts.num_params * sizeof(float);
+	static constexpr size_t InputPatchedBytes = IndexMask::num_words(counts.num_inputs) * sizeof(uint64_t);
+	static constexpr size_t OutputPatchedBytes = IndexMask::num_words(counts.num_outputs) * sizeof(uint64_t);
+
+	// The arrays for element types the module doesn't have are empty, and data() may be null
+	static std::byte *write_bytes(std::byte *to, const void *from, size_t size) {
+		if (size)
+			std::memcpy(to, from, size);
+		return to + size;
+	}
+
+	static const std::byte *read_bytes(void *to, const std::byte *from, size_t size) {
+		if (size)
+			std::memcpy(to, from, size);
+		return from + size;
+	}
+
+	static constexpr size_t CacheLineSize = 64;
+
+	// Values are stored in plain contiguous arrays, and patched state in bitmasks.
+	// The jack values and masks (used every frame) come first, starting on a cache line.
+	alignas(CacheLineSize) std::array<float, counts.num_inputs> inputValues{};
 	std::array<float, counts.num_outputs> outputValues{};
+	IndexMask::Bits<counts.num_inputs> inputPatched{};
+	IndexMask::Bits<counts.num_outputs> outputPatched{};
+	std::array<float, counts.num_params> paramValues{};
+	std::array<uint32_t, counts.num_params> paramGenerations{};
+
+	struct Smoothing {
+		alignas(CacheLineSize) std::array<float, SmoothedArraySize> current{};
+		std::array<float, SmoothedArraySize> targets{};
+		std::array<float, SmoothedArraySize> coefs = filled(1.f);
+		std::array<float, SmoothedArraySize> block_coefs = filled(1.f);
+		IndexMask::Bits<SmoothedArraySize> has_target{};
+		unsigned block_frames = 1;
+
+		static constexpr std::array<float, SmoothedArraySize> filled(float val) {
+			std::array<float, SmoothedArraySize> arr;
+			arr.fill(val);
+			return arr;
+		}
+	};
+	struct NoSmoothing {};
+	[[no_unique_address]] std::conditional_t<(NumSmoothed > 0), Smoothing, NoSmoothing> smoothing;
 	std::array<float, counts.num_lights> ledValues{};
-	std::array<bool, counts.num_outputs> outputPatched{};
+
+	struct DisplayText {
+		static constexpr size_t MaxValueSize = 16;
+
+		// Sequence lock, written by the module and read by the GUI with std::atomic_ref.
+		// Odd while the text is being written. The version of the text is the (even) value.
+		alignas(std::atomic_ref<uint32_t>::required_alignment) uint32_t seq = 0;
+		alignas(std::atomic_ref<uint32_t>::required_alignment) uint32_t length = 0;
+		std::array<char, DisplayTextSize> text{};
+
+		// Module only
+		std::array<std::byte, MaxValueSize> last_value{};
+		bool has_value = false;
+	};
+	std::array<DisplayText, NumTextDisplays> displayTexts{};
+
+	DisplayText *findDisplayText(int display_id) {
+		if constexpr (NumTextDisplays > 0) {
+			if (size_t(display_id) < TextDisplaySlots.size() && TextDisplaySlots[display_id] != NoTextDisplay)
+				return &displayTexts[TextDisplaySlots[display_id]];
+		}
+		return nullptr;
+	}
+
+	void writeDisplayText(DisplayText &display, std::string_view text) {
+		std::atomic_ref seq{display.seq};
+		auto start_seq = seq.load(std::memory_order_relaxed);
+		seq.store(start_seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		for (size_t i = 0; i < text.size(); i++)
+			std::atomic_ref{display.text[i]}.store(text[i], std::memory_order_relaxed);
+		std::atomic_ref{display.length}.store(text.size(), std::memory_order_relaxed);
+
+		// Skip 0 when wrapping around, since 0 means the text was never set
+		auto end_seq = start_seq + 2;
+		seq.store(end_seq ? end_seq : 2, std::memory_order_release);
+	}
+
+	// Lights changed since the GUI last called get_changed_leds(). Written by the audio thread and
+	// read by the GUI, using std::atomic_ref. Starts with all lights set, so the GUI reads them all once.
+	IndexMask::Bits<counts.num_lights> ledChanged = [] {
+		IndexMask::Bits<counts.num_lights> all;
+		all.set_all();
+		return all;
+	}();
 };
 
 } // namespace MetaModule
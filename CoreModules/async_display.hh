@@ -0,0 +1,106 @@
+#pragma once
+#include "CoreModules/canvas.hh"
+#include "CoreModules/triple_buffer.hh"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace MetaModule
+{
+
+// A graphic display rendered on another thread (e.g. the module's AsyncThread), so expensive
+// drawing (spectrograms, waveforms, ...) doesn't stall the GUI.
+//
+// Frames are triple-buffered: the render thread draws into its own frame and publishes it, and
+// draw() copies the newest published frame into the display's pixel buffer. Neither side waits
+// for the other, and the GUI never sees a partly drawn frame.
+//
+// Usage:
+//   show_graphic_display(): display.show(pix_buffer, width), then start the AsyncThread
+//   AsyncThread:            display.render([](Canvas &canvas) { ... });
+//   draw_graphic_display(): return display.draw();
+//   hide_graphic_display(): stop the AsyncThread, then display.hide()
+template<typename Pixel>
+class BasicAsyncDisplay {
+public:
+	// GUI context. Allocates the frames (only if the size changed).
+	// When the size changed, this blocks until a render already in progress finishes, so the GUI can
+	// stall for up to one render. To avoid that, stop the AsyncThread before showing at a new size.
+	void show(std::span<Pixel> pix_buffer, unsigned width) {
+		auto &frames = buffers.all();
+		if (frames[0].size() != pix_buffer.size() || display_width != width) {
+			flags.fetch_and(uint8_t(~Visible));
+			for (auto f = flags.load(); f & Rendering; f = flags.load())
+				flags.wait(f);
+			for (auto &frame : frames)
+				frame.assign(pix_buffer.size(), Pixel{});
+			display_width = width;
+		}
+
+		display = pix_buffer;
+		flags.fetch_or(Visible);
+	}
+
+	// GUI context. After this, render() does nothing. Keeps the frames allocated, for the next show().
+	void hide() {
+		flags.fetch_and(uint8_t(~Visible));
+	}
+
+	// Render thread: draws a frame with draw(BasicCanvas<Pixel> &) and publishes it.
+	// The canvas holds an older frame, so draw the whole frame (e.g. start with canvas.clear()).
+	// Returns false without drawing if the display isn't showing.
+	template<typename Draw>
+	bool render(Draw &&draw) {
+		if (!(flags.fetch_or(Rendering) & Visible)) {
+			end_render();
+			return false;
+		}
+
+		BasicCanvas<Pixel> canvas{buffers.back(), display_width};
+		draw(canvas);
+		buffers.publish();
+
+		end_render();
+		return true;
+	}
+
+	// GUI context: copies the newest frame into the display's pixel buffer.
+	// Returns false if no frame was rendered since the last call (for draw_graphic_display()).
+	bool draw() {
+		if (display.empty() || !buffers.acquire())
+			return false;
+
+		auto &frame = buffers.front();
+		std::copy_n(frame.begin(), std::min(frame.size(), display.size()), display.begin());
+		return true;
+	}
+
+private:
+	static constexpr uint8_t Visible = 0b01;
+	static constexpr uint8_t Rendering = 0b10;
+
+	TripleBuffer<std::vector<Pixel>> buffers;
+	std::atomic<uint8_t> flags{0};
+
+	// GUI context only
+	std::span<Pixel> display{};
+
+	// Only changed by show() while not visible, and read by the render thread
+	unsigned display_width = 0;
+
+	// show() only waits after clearing Visible, so only wake it then
+	void end_render() {
+		if (!(flags.fetch_and(uint8_t(~Rendering)) & Visible))
+			flags.notify_all();
+	}
+};
+
+// RGBA8888, for show_graphic_display()
+using AsyncDisplay = BasicAsyncDisplay<uint32_t>;
+
+// RGB565, for show_graphic_display_rgb565()
+using AsyncDisplay565 = BasicAsyncDisplay<uint16_t>;
+
+} // namespace MetaModule
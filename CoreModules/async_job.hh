@@ -0,0 +1,483 @@
+#pragma once
+#include "CoreModules/async_thread.hh"
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Background work with results, for modules.
+//
+// AsyncJob<T(Args...)> runs a function (or coroutine) on its own AsyncThread. The audio thread
+// calls request(args...) and polls the returned AsyncFuture<T>. Neither request() nor polling
+// locks or allocates, so both are safe in update().
+//
+// A job runs one request at a time. The work can be a plain function returning T, or a
+// coroutine returning AsyncCoroutine<T>, which can co_await other jobs' futures (e.g. a file read
+// job) and other AsyncCoroutines, and can co_await async_yield() to split up long work.
+// A job waiting for another job's future doesn't run again until that job finishes and wakes it.
+// co_await on a future gives a std::optional<T>, which is empty if the request was refused (the job was busy).
+// Destroy jobs before the jobs they co_await (e.g. declare them after).
+//
+// Example:
+//   AsyncJob<Header(uint32_t)> read_header{this, [this](uint32_t offset) { ... }};
+//   AsyncJob<Sample(uint32_t)> load{this, [this](uint32_t offset) -> AsyncCoroutine<Sample> {
+//       auto header = co_await read_header.request(offset);
+//       if (!header) co_return Sample{};
+//       co_return co_await decode(*header);
+//   }};
+//
+//   update(): if (!future.valid()) future = load.request(0);
+//             if (auto sample = future.take()) { ... }
+
+namespace MetaModule
+{
+
+template<typename T>
+class AsyncCoroutine;
+
+namespace AsyncDetail
+{
+
+enum Status : uint32_t { Idle, Pending, Running, Ready };
+
+// Wakes the job (via its AsyncThread) that waits for a result, once the result is ready
+class Waker {
+public:
+	// Waiting job's thread. Check whether the result is ready after this, since it may have become ready before.
+	void subscribe(AsyncThread *thread) {
+		AsyncThread *expected = nullptr;
+		while (!waiter.compare_exchange_weak(expected, thread)) {
+			// Only a wake() that's just finishing can be in the way
+			expected = nullptr;
+			std::this_thread::yield();
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	// Returns true if the subscription was still there. False means wake() took it: the thread was (or is being)
+	// woken, and this waits for that to finish.
+	bool unsubscribe(AsyncThread *thread) {
+		auto expected = thread;
+		if (waiter.compare_exchange_strong(expected, nullptr))
+			return true;
+		while (waiter.load() == waking_mark())
+			std::this_thread::yield();
+		return false;
+	}
+
+	// Finishing job's thread, after storing the result
+	void wake() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!waiter.load())
+			return;
+
+		if (auto thread = waiter.exchange(waking_mark()))
+			thread->run_once();
+		auto expected = waking_mark();
+		waiter.compare_exchange_strong(expected, nullptr);
+	}
+
+private:
+	std::atomic<AsyncThread *> waiter{nullptr};
+
+	// Marks a wake() in progress. Never dereferenced.
+	AsyncThread *waking_mark() {
+		return reinterpret_cast<AsyncThread *>(this);
+	}
+};
+
+// State of a job's latest request: generation << 2 | status.
+// Idle/Ready -> Pending: requester. Pending -> Running -> Ready: the job's thread. Ready -> Idle: take()
+template<typename T>
+struct Result {
+	std::atomic<uint32_t> state{Idle};
+	std::optional<T> value;
+	Waker waker;
+
+	static constexpr uint32_t make_state(uint32_t generation, Status status) {
+		return (generation << 2) | status;
+	}
+};
+
+// Where a suspended AsyncCoroutine chain resumes, and what it waits for
+struct Driver {
+	std::coroutine_handle<> resume_point{};
+	bool (*ready)(const void *) = nullptr;
+	const void *ready_arg = nullptr;
+	Waker *waker = nullptr;
+};
+
+template<typename T>
+struct FutureAwaiter;
+
+// Suspends until the next step()
+struct YieldAwaiter {
+	bool await_ready() const {
+		return false;
+	}
+
+	template<typename Promise>
+	void await_suspend(std::coroutine_handle<Promise> handle) {
+		*handle.promise().driver = {handle, nullptr, nullptr, nullptr};
+	}
+
+	void await_resume() {
+	}
+};
+
+template<typename T>
+struct CoroutineAwaiter;
+
+} // namespace AsyncDetail
+
+// The result of one AsyncJob request. Poll it from the thread that made the request.
+template<typename T>
+class AsyncFuture {
+public:
+	AsyncFuture() = default;
+
+	// False for a default-constructed future, or if request() was refused
+	bool valid() const {
+		return result != nullptr;
+	}
+
+	bool ready() const {
+		return result &&
+			   result->state.load(std::memory_order_acquire) == AsyncDetail::Result<T>::make_state(generation, AsyncDetail::Ready);
+	}
+
+	// Moves the value out if it's ready. The future is then no longer valid.
+	std::optional<T> take() {
+		if (!ready())
+			return std::nullopt;
+
+		std::optional<T> value = std::move(result->value);
+		result->value.reset();
+		result->state.store(AsyncDetail::Result<T>::make_state(generation, AsyncDetail::Idle), std::memory_order_release);
+		result = nullptr;
+		return value;
+	}
+
+	// In an AsyncCoroutine: suspends until the value is ready, and takes it.
+	// Gives std::nullopt right away for an invalid future (e.g. a request refused because the job was busy).
+	auto operator co_await() {
+		return AsyncDetail::FutureAwaiter<T>{std::exchange(*this, {})};
+	}
+
+private:
+	template<typename Signature>
+	friend class AsyncJob;
+	friend struct AsyncDetail::FutureAwaiter<T>;
+
+	AsyncFuture(AsyncDetail::Result<T> *result, uint32_t generation)
+		: result{result}
+		, generation{generation} {
+	}
+
+	AsyncDetail::Result<T> *result = nullptr;
+	uint32_t generation = 0;
+};
+
+// In an AsyncCoroutine: co_await async_yield() suspends until the job's next turn on its thread
+inline auto async_yield() {
+	return AsyncDetail::YieldAwaiter{};
+}
+
+// Coroutine type for AsyncJob work. Starts suspended, and is resumed by the job on its thread.
+// Nested AsyncCoroutines run on the same thread, as part of the same job.
+template<typename T>
+class AsyncCoroutine {
+public:
+	struct promise_type {
+		std::optional<T> value;
+		std::coroutine_handle<> continuation{};
+		AsyncDetail::Driver own_driver{};
+		AsyncDetail::Driver *driver = &own_driver;
+
+		AsyncCoroutine get_return_object() {
+			return AsyncCoroutine{std::coroutine_handle<promise_type>::from_promise(*this)};
+		}
+
+		std::suspend_always initial_suspend() noexcept {
+			return {};
+		}
+
+		auto final_suspend() noexcept {
+			struct ResumeCaller {
+				bool await_ready() noexcept {
+					return false;
+				}
+
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+					auto caller = handle.promise().continuation;
+					return caller ? caller : std::noop_coroutine();
+				}
+
+				void await_resume() noexcept {
+				}
+			};
+			return ResumeCaller{};
+		}
+
+		void return_value(T val) {
+			value = std::move(val);
+		}
+
+		void unhandled_exception() {
+			std::terminate();
+		}
+	};
+
+	AsyncCoroutine(AsyncCoroutine &&other) noexcept
+		: handle{std::exchange(other.handle, {})} {
+	}
+
+	AsyncCoroutine &operator=(AsyncCoroutine &&other) noexcept {
+		if (this != &other) {
+			if (handle)
+				handle.destroy();
+			handle = std::exchange(other.handle, {});
+		}
+		return *this;
+	}
+
+	~AsyncCoroutine() {
+		if (handle)
+			handle.destroy();
+	}
+
+	bool done() const {
+		return !handle || handle.done();
+	}
+
+	// Resumes the coroutine (or the nested coroutine it's waiting in) if what it waits for is ready.
+	// Returns true when the coroutine has finished.
+	bool step() {
+		if (done())
+			return true;
+
+		auto &driver = *handle.promise().driver;
+		if (driver.ready && !driver.ready(driver.ready_arg))
+			return false;
+
+		auto resume_point = driver.resume_point ? driver.resume_point : handle;
+		driver = {};
+		resume_point.resume();
+		return handle.done();
+	}
+
+	// After step() returned false: whether step() would resume it now
+	bool can_step() const {
+		auto &driver = *handle.promise().driver;
+		return !driver.ready || driver.ready(driver.ready_arg);
+	}
+
+	// After step() returned false: wakes the job when what the coroutine waits for is ready.
+	// Null after async_yield(), which just waits for the job's next turn.
+	AsyncDetail::Waker *waker() const {
+		return handle.promise().driver->waker;
+	}
+
+	// After step() returned true
+	std::optional<T> take_value() {
+		return handle ? std::move(handle.promise().value) : std::nullopt;
+	}
+
+	// In another AsyncCoroutine: runs this one to completion as part of the caller
+	auto operator co_await() && {
+		return AsyncDetail::CoroutineAwaiter<T>{std::move(*this)};
+	}
+
+private:
+	friend struct AsyncDetail::CoroutineAwaiter<T>;
+
+	explicit AsyncCoroutine(std::coroutine_handle<promise_type> handle)
+		: handle{handle} {
+	}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+namespace AsyncDetail
+{
+
+// Awaiters suspend by telling the driver of the coroutine chain where to resume, and what to wait for
+
+template<typename T>
+struct FutureAwaiter {
+	AsyncFuture<T> future;
+
+	bool await_ready() const {
+		// An invalid future never becomes ready, so don't wait for it
+		return !future.valid() || future.ready();
+	}
+
+	template<typename Promise>
+	void await_suspend(std::coroutine_handle<Promise> handle) {
+		*handle.promise().driver = {handle,
+									[](const void *f) { return static_cast<const AsyncFuture<T> *>(f)->ready(); },
+									&future,
+									&future.result->waker};
+	}
+
+	std::optional<T> await_resume() {
+		return future.take();
+	}
+};
+
+template<typename T>
+struct CoroutineAwaiter {
+	AsyncCoroutine<T> child;
+
+	bool await_ready() const {
+		return child.done();
+	}
+
+	// Runs the child right away, sharing the caller's driver. The child resumes the caller when it finishes.
+	template<typename Promise>
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> caller) {
+		auto &promise = child.handle.promise();
+		promise.continuation = caller;
+		promise.driver = caller.promise().driver;
+		return child.handle;
+	}
+
+	T await_resume() {
+		return *child.take_value();
+	}
+};
+
+} // namespace AsyncDetail
+
+template<typename Signature>
+class AsyncJob;
+
+template<typename T, typename... Args>
+class AsyncJob<T(Args...)> {
+	static_assert(!std::is_void_v<T>, "Use a value type, e.g. bool, for jobs with no result");
+
+public:
+	// Work that runs as one call on the job's thread
+	AsyncJob(CoreProcessor *module, std::function<T(Args...)> work)
+		: work{std::move(work)}
+		, thread{module, [this] { run(); }} {
+	}
+
+	// Work that runs as a coroutine: the job's thread resumes it each time it's ready to continue
+	AsyncJob(CoreProcessor *module, std::function<AsyncCoroutine<T>(Args...)> work)
+		: coroutine_work{std::move(work)}
+		, thread{module, [this] { run(); }} {
+	}
+
+	AsyncJob(const AsyncJob &) = delete;
+	AsyncJob &operator=(const AsyncJob &) = delete;
+
+	~AsyncJob() {
+		// A job being awaited may be waking this one: let that finish, then make sure nothing runs again
+		thread.stop();
+		if (subscribed)
+			subscribed->unsubscribe(&thread);
+		thread.stop();
+	}
+
+	// Starts the work with a copy of args. Call from one thread only (e.g. the audio thread).
+	// Returns an invalid future if the previous request hasn't finished yet.
+	// A finished result that wasn't taken is discarded.
+	AsyncFuture<T> request(Args... request_args) {
+		auto state = result.state.load(std::memory_order_acquire);
+		auto status = state & 0b11;
+		if (status == AsyncDetail::Pending || status == AsyncDetail::Running)
+			return {};
+
+		result.value.reset();
+		args = {std::move(request_args)...};
+
+		auto generation = (state >> 2) + 1;
+		result.state.store(AsyncDetail::Result<T>::make_state(generation, AsyncDetail::Pending),
+						   std::memory_order_release);
+		thread.run_once();
+		return {&result, generation};
+	}
+
+	// Whether a request is pending or running
+	bool busy() const {
+		auto status = result.state.load(std::memory_order_acquire) & 0b11;
+		return status == AsyncDetail::Pending || status == AsyncDetail::Running;
+	}
+
+	void set_priority(AsyncThread::Priority priority) {
+		thread.set_priority(priority);
+	}
+
+private:
+	std::function<T(Args...)> work;
+	std::function<AsyncCoroutine<T>(Args...)> coroutine_work;
+
+	AsyncDetail::Result<T> result;
+	std::tuple<std::decay_t<Args>...> args{};
+
+	// Job's thread only
+	std::optional<AsyncCoroutine<T>> active;
+	AsyncDetail::Waker *subscribed = nullptr;
+
+	AsyncThread thread;
+
+	void run() {
+		// Usually the awaited job woke this, and already removed the subscription
+		if (subscribed) {
+			subscribed->unsubscribe(&thread);
+			subscribed = nullptr;
+		}
+
+		auto state = result.state.load(std::memory_order_acquire);
+		auto generation = state >> 2;
+
+		if ((state & 0b11) == AsyncDetail::Pending) {
+			result.state.store(AsyncDetail::Result<T>::make_state(generation, AsyncDetail::Running),
+							   std::memory_order_relaxed);
+			if (work) {
+				finish(generation, std::apply(work, args));
+				return;
+			}
+			active = std::apply(coroutine_work, args);
+		}
+
+		if (!active)
+			return;
+
+		if (active->step()) {
+			auto value = active->take_value();
+			active.reset();
+			finish(generation, std::move(*value));
+		} else if (auto waker = active->waker())
+			sleep_until_woken(*waker);
+		else
+			thread.run_once();
+	}
+
+	// Waiting for another job's future: that job runs this one again when it finishes
+	void sleep_until_woken(AsyncDetail::Waker &waker) {
+		waker.subscribe(&thread);
+		subscribed = &waker;
+
+		// It may have finished before the subscription
+		if (active->can_step() && waker.unsubscribe(&thread)) {
+			subscribed = nullptr;
+			thread.run_once();
+		}
+	}
+
+	void finish(uint32_t generation, T value) {
+		result.value = std::move(value);
+		result.state.store(AsyncDetail::Result<T>::make_state(generation, AsyncDetail::Ready), std::memory_order_release);
+		result.waker.wake();
+	}
+};
+
+} // namespace MetaModule
@@ -19,6 +19,12 @@ public:
 
 	bool is_enabled();
 
+	// When many AsyncThreads share a pool of threads, higher priority actions run first
+	// (lower priorities still get a share of the turns, so they aren't starved).
+	// E.g. High for reading files that feed the audio thread, Low for rendering displays.
+	enum class Priority { High, Normal, Low };
+	void set_priority(Priority priority);
+
 	~AsyncThread();
 
 private:
@@ -0,0 +1,301 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Base64 (RFC 4648, standard alphabet, with padding) into and from caller-provided buffers.
+// Uses SSSE3 or NEON when the target supports it, and scalar code for the rest of the data.
+//
+// The SSSE3 code follows Wojciech Muła's base64 algorithms
+// (http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html and
+// http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html).
+
+namespace MetaModule::Base64
+{
+
+#if defined(__SSSE3__)
+constexpr std::string_view implementation{"ssse3"};
+#elif defined(__ARM_NEON)
+constexpr std::string_view implementation{"neon"};
+#else
+constexpr std::string_view implementation{"scalar"};
+#endif
+
+constexpr size_t encoded_size(size_t num_bytes) {
+	return (num_bytes + 2) / 3 * 4;
+}
+
+// Upper bound: padding makes the actual size up to 2 bytes smaller
+constexpr size_t max_decoded_size(size_t num_chars) {
+	return (num_chars + 3) / 4 * 3;
+}
+
+namespace Detail
+{
+
+constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+constexpr uint8_t Invalid = 0xFF;
+
+constexpr std::array<uint8_t, 256> decode_table = [] {
+	std::array<uint8_t, 256> table{};
+	table.fill(Invalid);
+	for (uint8_t i = 0; i < 64; i++)
+		table[uint8_t(alphabet[i])] = i;
+	return table;
+}();
+
+inline void encode_triplet(const uint8_t *in, char *out) {
+	uint32_t bits = (in[0] << 16) | (in[1] << 8) | in[2];
+	out[0] = alphabet[(bits >> 18) & 0x3F];
+	out[1] = alphabet[(bits >> 12) & 0x3F];
+	out[2] = alphabet[(bits >> 6) & 0x3F];
+	out[3] = alphabet[bits & 0x3F];
+}
+
+// Returns false if any of the 4 chars is not in the alphabet
+inline bool decode_quad(const char *in, uint8_t *out) {
+	auto a = decode_table[uint8_t(in[0])];
+	auto b = decode_table[uint8_t(in[1])];
+	auto c = decode_table[uint8_t(in[2])];
+	auto d = decode_table[uint8_t(in[3])];
+	if ((a | b | c | d) & 0x80)
+		return false;
+
+	uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+	out[0] = uint8_t(bits >> 16);
+	out[1] = uint8_t(bits >> 8);
+	out[2] = uint8_t(bits);
+	return true;
+}
+
+// The vector loops process as many whole blocks as they can, and return how many
+// input bytes/chars they consumed. The scalar code does the rest.
+
+#if defined(__SSSE3__)
+
+// 12 bytes -> 16 chars. Reads 16 bytes.
+inline size_t encode_vector(const uint8_t *in, size_t num_bytes, char *out) {
+	const auto shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const auto shift_lut = _mm_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+	size_t pos = 0;
+	for (; pos + 16 <= num_bytes; pos += 12, out += 16) {
+		auto bytes = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + pos)), shuffle);
+
+		// Move each 6-bit field into its own byte
+		auto t0 = _mm_mulhi_epu16(_mm_and_si128(bytes, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+		auto t1 = _mm_mullo_epi16(_mm_and_si128(bytes, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+		auto indices = _mm_or_si128(t0, t1);
+
+		// Map 0..63 to the alphabet by adding an offset, chosen by which range the index is in
+		auto range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+		auto is_upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+		range = _mm_or_si128(range, _mm_and_si128(is_upper, _mm_set1_epi8(13)));
+		auto chars = _mm_add_epi8(indices, _mm_shuffle_epi8(shift_lut, range));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), chars);
+	}
+	return pos;
+}
+
+// 16 chars -> 12 bytes. Writes 16 bytes.
+// Stops at the first block containing a char not in the alphabet (including padding).
+inline size_t decode_vector(const char *in, size_t num_chars, uint8_t *out, size_t out_size) {
+	const auto lut_lo = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const auto lut_hi = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const auto lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const auto mask_2f = _mm_set1_epi8(0x2F);
+	const auto pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	size_t pos = 0;
+	for (; pos + 16 <= num_chars && (pos / 4 * 3) + 16 <= out_size; pos += 16, out += 12) {
+		auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + pos));
+
+		// Classify each char by its nibbles: a char is valid if its lo and hi classes don't overlap
+		auto hi_nibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask_2f);
+		auto lo_nibbles = _mm_and_si128(chars, mask_2f);
+		auto hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+		auto lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+		auto invalid = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+		if (_mm_movemask_epi8(invalid) != 0xFFFF)
+			break;
+
+		auto is_slash = _mm_cmpeq_epi8(chars, mask_2f);
+		auto roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(is_slash, hi_nibbles));
+		auto values = _mm_add_epi8(chars, roll);
+
+		// Pack four 6-bit values into 3 bytes
+		auto merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_shuffle_epi8(merged, pack));
+	}
+	return pos;
+}
+
+#elif defined(__ARM_NEON)
+
+// 48 bytes -> 64 chars
+inline size_t encode_vector(const uint8_t *in, size_t num_bytes, char *out) {
+	size_t pos = 0;
+	for (; pos + 48 <= num_bytes; pos += 48, out += 64) {
+		auto bytes = vld3q_u8(in + pos);
+		const auto mask6 = vdupq_n_u8(0x3F);
+
+		uint8x16x4_t indices;
+		indices.val[0] = vshrq_n_u8(bytes.val[0], 2);
+		indices.val[1] = vandq_u8(vorrq_u8(vshrq_n_u8(bytes.val[1], 4), vshlq_n_u8(bytes.val[0], 4)), mask6);
+		indices.val[2] = vandq_u8(vorrq_u8(vshrq_n_u8(bytes.val[2], 6), vshlq_n_u8(bytes.val[1], 2)), mask6);
+		indices.val[3] = vandq_u8(bytes.val[2], mask6);
+
+		// Map 0..63 to the alphabet: start with the offset for 'A'..'Z' and adjust it for each higher range
+		for (auto &v : indices.val) {
+			auto offset = vdupq_n_u8('A');
+			offset = vaddq_u8(offset, vandq_u8(vcgeq_u8(v, vdupq_n_u8(26)), vdupq_n_u8('a' - 26 - 'A')));
+			offset = vsubq_u8(offset, vandq_u8(vcgeq_u8(v, vdupq_n_u8(52)), vdupq_n_u8('a' - 26 - ('0' - 52))));
+			offset = vsubq_u8(offset, vandq_u8(vcgeq_u8(v, vdupq_n_u8(62)), vdupq_n_u8(('0' - 52) - ('+' - 62))));
+			offset = vaddq_u8(offset, vandq_u8(vcgeq_u8(v, vdupq_n_u8(63)), vdupq_n_u8(('/' - 63) - ('+' - 62))));
+			v = vaddq_u8(v, offset);
+		}
+
+		vst4q_u8(reinterpret_cast<uint8_t *>(out), indices);
+	}
+	return pos;
+}
+
+// Returns 0..63, or a value with the high bit set if the char is not in the alphabet
+inline uint8x16_t decode_chars(uint8x16_t c) {
+	auto upper = vcltq_u8(vsubq_u8(c, vdupq_n_u8('A')), vdupq_n_u8(26));
+	auto lower = vcltq_u8(vsubq_u8(c, vdupq_n_u8('a')), vdupq_n_u8(26));
+	auto digit = vcltq_u8(vsubq_u8(c, vdupq_n_u8('0')), vdupq_n_u8(10));
+	auto plus = vceqq_u8(c, vdupq_n_u8('+'));
+	auto slash = vceqq_u8(c, vdupq_n_u8('/'));
+
+	auto values = vdupq_n_u8(Invalid);
+	values = vbslq_u8(upper, vsubq_u8(c, vdupq_n_u8('A')), values);
+	values = vbslq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 26)), values);
+	values = vbslq_u8(digit, vaddq_u8(c, vdupq_n_u8(52 - '0')), values);
+	values = vbslq_u8(plus, vdupq_n_u8(62), values);
+	values = vbslq_u8(slash, vdupq_n_u8(63), values);
+	return values;
+}
+
+// 64 chars -> 48 bytes
+// Stops at the first block containing a char not in the alphabet (including padding).
+inline size_t decode_vector(const char *in, size_t num_chars, uint8_t *out, size_t out_size) {
+	size_t pos = 0;
+	for (; pos + 64 <= num_chars && (pos / 4 * 3) + 48 <= out_size; pos += 64, out += 48) {
+		auto chars = vld4q_u8(reinterpret_cast<const uint8_t *>(in + pos));
+
+		uint8x16_t v[4];
+		for (unsigned i = 0; i < 4; i++)
+			v[i] = decode_chars(chars.val[i]);
+
+		auto any = vorrq_u8(vorrq_u8(v[0], v[1]), vorrq_u8(v[2], v[3]));
+		auto high_bits = vreinterpretq_u64_u8(vandq_u8(any, vdupq_n_u8(0x80)));
+		if (vgetq_lane_u64(high_bits, 0) | vgetq_lane_u64(high_bits, 1))
+			break;
+
+		uint8x16x3_t bytes;
+		bytes.val[0] = vorrq_u8(vshlq_n_u8(v[0], 2), vshrq_n_u8(v[1], 4));
+		bytes.val[1] = vorrq_u8(vshlq_n_u8(v[1], 4), vshrq_n_u8(v[2], 2));
+		bytes.val[2] = vorrq_u8(vshlq_n_u8(v[2], 6), v[3]);
+		vst3q_u8(out, bytes);
+	}
+	return pos;
+}
+
+#else
+
+inline size_t encode_vector(const uint8_t *, size_t, char *) {
+	return 0;
+}
+
+inline size_t decode_vector(const char *, size_t, uint8_t *, size_t) {
+	return 0;
+}
+
+#endif
+
+} // namespace Detail
+
+// Returns the number of chars written (always encoded_size(in.size())),
+// or 0 if out is smaller than that
+inline size_t encode(std::span<const uint8_t> in, std::span<char> out) {
+	auto size = encoded_size(in.size());
+	if (out.size() < size)
+		return 0;
+
+	auto src = in.data();
+	auto dst = out.data();
+	auto num_bytes = in.size();
+
+	auto pos = Detail::encode_vector(src, num_bytes, dst);
+	dst += pos / 3 * 4;
+
+	for (; pos + 3 <= num_bytes; pos += 3, dst += 4)
+		Detail::encode_triplet(src + pos, dst);
+
+	if (auto remaining = num_bytes - pos) {
+		uint8_t last[3]{src[pos], remaining > 1 ? src[pos + 1] : uint8_t(0), 0};
+		Detail::encode_triplet(last, dst);
+		dst[3] = '=';
+		if (remaining == 1)
+			dst[2] = '=';
+	}
+
+	return size;
+}
+
+// Returns the number of bytes written, or nullopt if the input is not valid base64
+// or out is too small. Padding is optional.
+inline std::optional<size_t> decode(std::string_view in, std::span<uint8_t> out) {
+	auto num_chars = in.size();
+	if (num_chars >= 2 && in[num_chars - 1] == '=')
+		num_chars -= (in[num_chars - 2] == '=') ? 2 : 1;
+
+	// Padding must fill the last group of 4 exactly
+	if (num_chars % 4 == 1 || (num_chars < in.size() && in.size() % 4 != 0))
+		return std::nullopt;
+
+	auto size = num_chars / 4 * 3 + (num_chars % 4 ? num_chars % 4 - 1 : 0);
+	if (out.size() < size)
+		return std::nullopt;
+
+	auto src = in.data();
+	auto dst = out.data();
+
+	auto pos = Detail::decode_vector(src, num_chars, dst, out.size());
+	dst += pos / 4 * 3;
+
+	for (; pos + 4 <= num_chars; pos += 4, dst += 3) {
+		if (!Detail::decode_quad(src + pos, dst))
+			return std::nullopt;
+	}
+
+	if (auto remaining = num_chars - pos) {
+		char last[4]{src[pos], src[pos + 1], remaining > 2 ? src[pos + 2] : 'A', 'A'};
+		uint8_t bytes[3];
+		if (!Detail::decode_quad(last, bytes))
+			return std::nullopt;
+		std::memcpy(dst, bytes, remaining - 1);
+	}
+
+	return size;
+}
+
+} // namespace MetaModule::Base64
@@ -0,0 +1,503 @@
+#pragma once
+#include "CoreModules/dirty_rect.hh"
+#include "CoreModules/pixel_convert.hh"
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Drawing into a graphic display's pixel buffer (see CoreProcessor::show_graphic_display()).
+// Colors are raw pixel values: PixelRGBA::raw() (CoreModules/pixels.hh) for RGBA8888,
+// or RGB565 raw values for RGB565 buffers.
+// Fills and alpha blending use SSE2 or NEON when the target supports it. All paths give identical results.
+
+namespace MetaModule
+{
+
+namespace CanvasOps
+{
+
+#if defined(__SSE2__)
+constexpr std::string_view implementation{"sse2"};
+#elif defined(__ARM_NEON)
+constexpr std::string_view implementation{"neon"};
+#else
+constexpr std::string_view implementation{"scalar"};
+#endif
+
+constexpr uint32_t OpaqueAlpha = 0xFF000000;
+
+constexpr uint32_t alpha(uint32_t color) {
+	return color >> 24;
+}
+
+// x / 255, rounded. Exact for x <= 255 * 255
+constexpr uint32_t div255(uint32_t x) {
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+// Blends src over dst with the given alpha (0-255). The src alpha channel is ignored, so the
+// resulting alpha is alpha + dst_alpha * (1 - alpha).
+constexpr uint32_t blend(uint32_t dst, uint32_t src, uint32_t alpha) {
+	src |= OpaqueAlpha;
+	uint32_t inv_alpha = 255 - alpha;
+	uint32_t out = 0;
+	for (unsigned shift = 0; shift < 32; shift += 8) {
+		uint32_t s = (src >> shift) & 0xFF;
+		uint32_t d = (dst >> shift) & 0xFF;
+		out |= div255(s * alpha + d * inv_alpha) << shift;
+	}
+	return out;
+}
+
+// Color at pos (0 to len - 1) of a gradient from `from` to `to`
+constexpr uint32_t lerp(uint32_t from, uint32_t to, unsigned pos, unsigned len) {
+	if (len < 2)
+		return from;
+
+	uint32_t last = len - 1;
+	uint32_t out = 0;
+	for (unsigned shift = 0; shift < 32; shift += 8) {
+		uint32_t f = (from >> shift) & 0xFF;
+		uint32_t t = (to >> shift) & 0xFF;
+		out |= ((f * (last - pos) + t * pos + last / 2) / last) << shift;
+	}
+	return out;
+}
+
+inline void fill(uint32_t *dst, size_t num, uint32_t color) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	auto c = _mm_set1_epi32(int(color));
+	for (; num - i >= 4; i += 4)
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), c);
+#elif defined(__ARM_NEON)
+	auto c = vdupq_n_u32(color);
+	for (; num - i >= 4; i += 4)
+		vst1q_u32(dst + i, c);
+#endif
+	std::fill(dst + i, dst + num, color);
+}
+
+inline void fill(uint16_t *dst, size_t num, uint16_t color) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	auto c = _mm_set1_epi16(short(color));
+	for (; num - i >= 8; i += 8)
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), c);
+#elif defined(__ARM_NEON)
+	auto c = vdupq_n_u16(color);
+	for (; num - i >= 8; i += 8)
+		vst1q_u16(dst + i, c);
+#endif
+	std::fill(dst + i, dst + num, color);
+}
+
+#if defined(__SSE2__)
+// 2 pixels, one 16-bit lane per channel: div255(src * alpha + dst * inv_alpha)
+inline __m128i blend_lanes(__m128i dst, __m128i src_times_alpha, __m128i inv_alpha) {
+	auto t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(dst, inv_alpha), src_times_alpha), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+#elif defined(__ARM_NEON)
+// 16 values of one channel: div255(src * alpha + dst * inv_alpha)
+inline uint8x16_t blend_channel(uint8x16_t dst, uint8x16_t src, uint8x16_t alpha, uint8x16_t inv_alpha) {
+	auto lo = vmlal_u8(vmull_u8(vget_low_u8(src), vget_low_u8(alpha)), vget_low_u8(dst), vget_low_u8(inv_alpha));
+	auto hi = vmlal_u8(vmull_u8(vget_high_u8(src), vget_high_u8(alpha)), vget_high_u8(dst), vget_high_u8(inv_alpha));
+	return vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)), vraddhn_u16(hi, vrshrq_n_u16(hi, 8)));
+}
+#endif
+
+// Blends one color over num pixels, using the color's alpha
+inline void blend_fill(uint32_t *dst, size_t num, uint32_t color) {
+	auto a = alpha(color);
+	if (a == 0)
+		return;
+	if (a == 255)
+		return fill(dst, num, color);
+
+	size_t i = 0;
+#if defined(__SSE2__)
+	auto zero = _mm_setzero_si128();
+	auto src = _mm_unpacklo_epi8(_mm_set1_epi32(int(color | OpaqueAlpha)), zero);
+	auto src_times_alpha = _mm_mullo_epi16(src, _mm_set1_epi16(short(a)));
+	auto inv_alpha = _mm_set1_epi16(short(255 - a));
+
+	for (; num - i >= 4; i += 4) {
+		auto d = _mm_loadu_si128(reinterpret_cast<__m128i *>(dst + i));
+		auto lo = blend_lanes(_mm_unpacklo_epi8(d, zero), src_times_alpha, inv_alpha);
+		auto hi = blend_lanes(_mm_unpackhi_epi8(d, zero), src_times_alpha, inv_alpha);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#elif defined(__ARM_NEON)
+	auto va = vdupq_n_u8(uint8_t(a));
+	auto vinv = vdupq_n_u8(uint8_t(255 - a));
+	uint8x16_t src[4];
+	for (unsigned c = 0; c < 4; c++)
+		src[c] = vdupq_n_u8(uint8_t((color | OpaqueAlpha) >> (c * 8)));
+
+	for (; num - i >= 16; i += 16) {
+		auto px = vld4q_u8(reinterpret_cast<uint8_t *>(dst + i));
+		for (unsigned c = 0; c < 4; c++)
+			px.val[c] = blend_channel(px.val[c], src[c], va, vinv);
+		vst4q_u8(reinterpret_cast<uint8_t *>(dst + i), px);
+	}
+#endif
+	for (; i < num; i++)
+		dst[i] = blend(dst[i], color, a);
+}
+
+// Blends num src pixels over dst, each with its own alpha
+inline void blend_copy(uint32_t *dst, const uint32_t *src, size_t num) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	auto zero = _mm_setzero_si128();
+	auto alpha_mask = _mm_set1_epi32(int(OpaqueAlpha));
+	auto all_255 = _mm_set1_epi16(255);
+
+	for (; num - i >= 4; i += 4) {
+		auto s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		auto s_alpha = _mm_and_si128(s, alpha_mask);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(s_alpha, alpha_mask)) == 0xFFFF) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), s);
+			continue;
+		}
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(s_alpha, zero)) == 0xFFFF)
+			continue;
+
+		auto s_opaque = _mm_or_si128(s, alpha_mask);
+		auto s_lo = _mm_unpacklo_epi8(s, zero);
+		auto s_hi = _mm_unpackhi_epi8(s, zero);
+		// Copy each pixel's alpha lane to its other 3 lanes
+		auto a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xFF), 0xFF);
+		auto a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xFF), 0xFF);
+
+		auto d = _mm_loadu_si128(reinterpret_cast<__m128i *>(dst + i));
+		auto lo = blend_lanes(_mm_unpacklo_epi8(d, zero),
+							  _mm_mullo_epi16(_mm_unpacklo_epi8(s_opaque, zero), a_lo),
+							  _mm_sub_epi16(all_255, a_lo));
+		auto hi = blend_lanes(_mm_unpackhi_epi8(d, zero),
+							  _mm_mullo_epi16(_mm_unpackhi_epi8(s_opaque, zero), a_hi),
+							  _mm_sub_epi16(all_255, a_hi));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#elif defined(__ARM_NEON)
+	auto all_255 = vdupq_n_u8(255);
+
+	for (; num - i >= 16; i += 16) {
+		auto s = vld4q_u8(reinterpret_cast<const uint8_t *>(src + i));
+		auto d = vld4q_u8(reinterpret_cast<uint8_t *>(dst + i));
+		auto a = s.val[3];
+		auto inv_a = vsubq_u8(all_255, a);
+		s.val[3] = all_255;
+		for (unsigned c = 0; c < 4; c++)
+			d.val[c] = blend_channel(d.val[c], s.val[c], a, inv_a);
+		vst4q_u8(reinterpret_cast<uint8_t *>(dst + i), d);
+	}
+#endif
+	for (; i < num; i++)
+		dst[i] = blend(dst[i], src[i], alpha(src[i]));
+}
+
+} // namespace CanvasOps
+
+// Drawing primitives over a pixel buffer, clipped to the buffer.
+// Optionally records the area drawn into a DirtyRegion, for draw_graphic_display_rects().
+// Pixel is uint32_t for RGBA8888 buffers (Canvas) or uint16_t for RGB565 buffers (Canvas565).
+// Alpha blending is only available for RGBA8888.
+template<typename Pixel>
+class BasicCanvas {
+	static_assert(std::same_as<Pixel, uint32_t> || std::same_as<Pixel, uint16_t>);
+
+	static constexpr bool HasAlpha = std::same_as<Pixel, uint32_t>;
+
+public:
+	BasicCanvas(std::span<Pixel> pixels, unsigned width)
+		: pix{pixels}
+		, w{width}
+		, h{width ? unsigned(pixels.size() / width) : 0} {
+	}
+
+	unsigned width() const {
+		return w;
+	}
+
+	unsigned height() const {
+		return h;
+	}
+
+	std::span<Pixel> pixels() {
+		return pix;
+	}
+
+	// Every drawing call adds the area it drew to the region. nullptr to stop tracking.
+	void track_dirty(DirtyRegion<> *region) {
+		dirty = region;
+	}
+
+	// Returns 0 outside the buffer
+	Pixel get_pixel(int x, int y) const {
+		return contains(x, y) ? pix[y * w + x] : 0;
+	}
+
+	void set_pixel(int x, int y, Pixel color) {
+		if (contains(x, y)) {
+			pix[y * w + x] = color;
+			mark_dirty({unsigned(x), unsigned(y), unsigned(x) + 1, unsigned(y) + 1});
+		}
+	}
+
+	// Uses the color's alpha
+	void blend_pixel(int x, int y, uint32_t color) requires(HasAlpha)
+	{
+		if (contains(x, y)) {
+			auto &px = pix[y * w + x];
+			px = CanvasOps::blend(px, color, CanvasOps::alpha(color));
+			mark_dirty({unsigned(x), unsigned(y), unsigned(x) + 1, unsigned(y) + 1});
+		}
+	}
+
+	void clear(Pixel color = 0) {
+		fill_rect(0, 0, w, h, color);
+	}
+
+	void fill_rect(int x, int y, int width, int height, Pixel color) {
+		auto area = clip(x, y, width, height);
+		for (auto row = area.y0; row < area.y1; row++)
+			CanvasOps::fill(&pix[row * w + area.x0], area.width(), color);
+		mark_dirty(area);
+	}
+
+	// Like fill_rect(), but blends the color using its alpha
+	void blend_rect(int x, int y, int width, int height, uint32_t color) requires(HasAlpha)
+	{
+		auto area = clip(x, y, width, height);
+		for (auto row = area.y0; row < area.y1; row++)
+			CanvasOps::blend_fill(&pix[row * w + area.x0], area.width(), color);
+		mark_dirty(area);
+	}
+
+	void hline(int x, int y, int length, Pixel color) {
+		fill_rect(x, y, length, 1, color);
+	}
+
+	void vline(int x, int y, int length, Pixel color) {
+		auto area = clip(x, y, 1, length);
+		for (auto row = area.y0; row < area.y1; row++)
+			pix[row * w + area.x0] = color;
+		mark_dirty(area);
+	}
+
+	// Bresenham line, including both end points
+	void line(int x0, int y0, int x1, int y1, Pixel color) {
+		if (y0 == y1)
+			return hline(std::min(x0, x1), y0, std::abs(x1 - x0) + 1, color);
+		if (x0 == x1)
+			return vline(x0, std::min(y0, y1), std::abs(y1 - y0) + 1, color);
+
+		int dx = std::abs(x1 - x0);
+		int dy = -std::abs(y1 - y0);
+		int step_x = x0 < x1 ? 1 : -1;
+		int step_y = y0 < y1 ? 1 : -1;
+		int err = dx + dy;
+
+		auto bounds = clip(std::min(x0, x1), std::min(y0, y1), dx + 1, -dy + 1);
+		if (bounds.empty())
+			return;
+
+		while (true) {
+			if (contains(x0, y0))
+				pix[y0 * w + x0] = color;
+			if (x0 == x1 && y0 == y1)
+				break;
+			int e2 = 2 * err;
+			if (e2 >= dy) {
+				err += dy;
+				x0 += step_x;
+			}
+			if (e2 <= dx) {
+				err += dx;
+				y0 += step_y;
+			}
+		}
+		mark_dirty(bounds);
+	}
+
+	// Anti-aliased line (Xiaolin Wu's algorithm), blended using the color's alpha
+	void line_aa(float x0, float y0, float x1, float y1, uint32_t color) requires(HasAlpha)
+	{
+		bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+		if (steep) {
+			std::swap(x0, y0);
+			std::swap(x1, y1);
+		}
+		if (x0 > x1) {
+			std::swap(x0, x1);
+			std::swap(y0, y1);
+		}
+
+		float dx = x1 - x0;
+		float gradient = dx == 0.f ? 1.f : (y1 - y0) / dx;
+
+		auto plot = [&](int x, int y, float coverage) {
+			if (steep)
+				std::swap(x, y);
+			if (!contains(x, y))
+				return;
+			auto a = uint32_t(CanvasOps::alpha(color) * std::clamp(coverage, 0.f, 1.f) + 0.5f);
+			auto &px = pix[y * w + x];
+			px = CanvasOps::blend(px, color, a);
+		};
+
+		auto frac = [](float v) { return v - std::floor(v); };
+
+		// End points
+		auto end_point = [&](float x, float y) {
+			float x_end = std::round(x);
+			float y_end = y + gradient * (x_end - x);
+			float x_gap = 1.f - frac(x + 0.5f);
+			int px = int(x_end);
+			int py = int(std::floor(y_end));
+			plot(px, py, (1.f - frac(y_end)) * x_gap);
+			plot(px, py + 1, frac(y_end) * x_gap);
+			return std::pair{px, y_end};
+		};
+		auto [start_x, start_y] = end_point(x0, y0);
+		auto [end_x, end_y] = end_point(x1, y1);
+
+		float y = start_y + gradient;
+		for (int x = start_x + 1; x < end_x; x++) {
+			int iy = int(std::floor(y));
+			plot(x, iy, 1.f - frac(y));
+			plot(x, iy + 1, frac(y));
+			y += gradient;
+		}
+
+		int min_x = start_x;
+		int min_y = int(std::floor(std::min(start_y, end_y)));
+		int len_x = end_x - start_x + 1;
+		int len_y = int(std::floor(std::max(start_y, end_y))) - min_y + 2;
+		if (steep)
+			mark_dirty(clip(min_y, min_x, len_y, len_x));
+		else
+			mark_dirty(clip(min_x, min_y, len_x, len_y));
+	}
+
+	// Copies an image (src_width pixels wide) with its top left corner at (x, y)
+	void blit(std::span<const Pixel> src, unsigned src_width, int x, int y) {
+		blit_rows(src, src_width, x, y, [](Pixel *dst, const Pixel *src_row, size_t num) {
+			std::copy_n(src_row, num, dst);
+		});
+	}
+
+	// Like blit(), but blends each pixel using its alpha
+	void blit_blend(std::span<const uint32_t> src, unsigned src_width, int x, int y) requires(HasAlpha)
+	{
+		blit_rows(src, src_width, x, y, CanvasOps::blend_copy);
+	}
+
+	enum class Gradient { Horizontal, Vertical };
+
+	// Linear gradient across the rect, from `from` at the left (or top) to `to` at the right (or bottom)
+	void fill_gradient(int x, int y, int width, int height, Pixel from, Pixel to, Gradient direction) {
+		auto area = clip(x, y, width, height);
+		if (area.empty())
+			return;
+
+		if (direction == Gradient::Vertical) {
+			for (auto row = area.y0; row < area.y1; row++) {
+				auto color = lerp(from, to, row - y, height);
+				CanvasOps::fill(&pix[row * w + area.x0], area.width(), color);
+			}
+		} else {
+			// Compute the first row, then copy it to the others
+			auto first_row = &pix[area.y0 * w + area.x0];
+			for (unsigned col = 0; col < area.width(); col++)
+				first_row[col] = lerp(from, to, area.x0 + col - x, width);
+			for (auto row = area.y0 + 1; row < area.y1; row++)
+				std::copy_n(first_row, area.width(), &pix[row * w + area.x0]);
+		}
+		mark_dirty(area);
+	}
+
+private:
+	std::span<Pixel> pix;
+	unsigned w;
+	unsigned h;
+	DirtyRegion<> *dirty = nullptr;
+
+	// Half-open rect inside the buffer
+	struct Area {
+		unsigned x0, y0, x1, y1;
+
+		unsigned width() const {
+			return x1 - x0;
+		}
+
+		bool empty() const {
+			return x0 >= x1 || y0 >= y1;
+		}
+	};
+
+	bool contains(int x, int y) const {
+		return x >= 0 && y >= 0 && unsigned(x) < w && unsigned(y) < h;
+	}
+
+	Area clip(int x, int y, int width, int height) const {
+		auto x0 = std::clamp<int64_t>(x, 0, w);
+		auto y0 = std::clamp<int64_t>(y, 0, h);
+		auto x1 = std::clamp<int64_t>(int64_t(x) + std::max(width, 0), 0, w);
+		auto y1 = std::clamp<int64_t>(int64_t(y) + std::max(height, 0), 0, h);
+		return {unsigned(x0), unsigned(y0), unsigned(std::max(x0, x1)), unsigned(std::max(y0, y1))};
+	}
+
+	static Pixel lerp(Pixel from, Pixel to, unsigned pos, unsigned len) {
+		if constexpr (HasAlpha)
+			return CanvasOps::lerp(from, to, pos, len);
+		else
+			return PixelConvert::to_rgb565(
+				CanvasOps::lerp(PixelConvert::to_rgba(from), PixelConvert::to_rgba(to), pos, len));
+	}
+
+	void mark_dirty(Area area) {
+		if (dirty && !area.empty())
+			dirty->add({uint16_t(area.x0), uint16_t(area.y0), uint16_t(area.x1 - area.x0), uint16_t(area.y1 - area.y0)});
+	}
+
+	template<typename CopyRow>
+	void blit_rows(std::span<const Pixel> src, unsigned src_width, int x, int y, CopyRow copy_row) {
+		if (src_width == 0)
+			return;
+		auto src_height = src.size() / src_width;
+		auto area = clip(x, y, src_width, int(src_height));
+		if (area.empty())
+			return;
+
+		// Offset into the source, if clipped at the left or top
+		size_t src_x = area.x0 - x;
+		size_t src_y = area.y0 - y;
+		for (auto row = area.y0; row < area.y1; row++, src_y++)
+			copy_row(&pix[row * w + area.x0], &src[src_y * src_width + src_x], area.width());
+		mark_dirty(area);
+	}
+};
+
+// RGBA8888, for show_graphic_display()
+using Canvas = BasicCanvas<uint32_t>;
+
+// RGB565, for show_graphic_display_rgb565()
+using Canvas565 = BasicCanvas<uint16_t>;
+
+} // namespace MetaModule
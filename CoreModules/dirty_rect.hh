@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+namespace MetaModule
+{
+
+// A rectangle of a graphic display's pixel buffer that changed, in pixels.
+struct DirtyRect {
+	uint16_t x = 0;
+	uint16_t y = 0;
+	uint16_t width = 0;
+	uint16_t height = 0;
+
+	// Larger than any display: the host clips it to the whole pixel buffer
+	static constexpr DirtyRect whole_display() {
+		return {0, 0, UINT16_MAX, UINT16_MAX};
+	}
+
+	constexpr bool empty() const {
+		return width == 0 || height == 0;
+	}
+
+	constexpr unsigned right() const {
+		return unsigned(x) + width;
+	}
+
+	constexpr unsigned bottom() const {
+		return unsigned(y) + height;
+	}
+
+	constexpr unsigned area() const {
+		return unsigned(width) * height;
+	}
+
+	// True if the rects overlap or share an edge
+	constexpr bool touches(DirtyRect const &other) const {
+		return x <= other.right() && other.x <= right() && y <= other.bottom() && other.y <= bottom();
+	}
+
+	// Smallest rect containing both
+	constexpr DirtyRect merged(DirtyRect const &other) const {
+		if (empty())
+			return other;
+		if (other.empty())
+			return *this;
+
+		auto left = std::min(x, other.x);
+		auto top = std::min(y, other.y);
+		auto r = std::max(right(), other.right());
+		auto b = std::max(bottom(), other.bottom());
+		return {left, top, uint16_t(std::min(r - left, 0xFFFFu)), uint16_t(std::min(b - top, 0xFFFFu))};
+	}
+
+	// Part of the rect inside a buffer of the given size
+	constexpr DirtyRect clipped(unsigned buffer_width, unsigned buffer_height) const {
+		auto r = std::min(right(), buffer_width);
+		auto b = std::min(bottom(), buffer_height);
+		if (x >= r || y >= b)
+			return {};
+		return {x, y, uint16_t(r - x), uint16_t(b - y)};
+	}
+
+	constexpr bool operator==(DirtyRect const &) const = default;
+};
+
+// Collects the regions a module draws into during one frame, for draw_graphic_display_rects().
+// Rects that touch are merged as they are added. When there are more than MaxRects regions,
+// the pair that grows the least when merged is merged, so nothing is ever lost.
+template<size_t MaxRects = 8>
+class DirtyRegion {
+	static_assert(MaxRects > 0);
+
+public:
+	void add(DirtyRect rect) {
+		if (rect.empty())
+			return;
+
+		// Merging can make the rect touch others, so keep going until it doesn't
+		for (size_t i = 0; i < count;) {
+			if (rects[i].touches(rect)) {
+				rect = rect.merged(rects[i]);
+				rects[i] = rects[--count];
+				i = 0;
+			} else
+				i++;
+		}
+
+		rects[count++] = rect;
+		if (count > MaxRects)
+			merge_closest();
+	}
+
+	void add_all() {
+		count = 0;
+		add(DirtyRect::whole_display());
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	std::span<const DirtyRect> rects_view() const {
+		return {rects.data(), count};
+	}
+
+	// Writes the regions to `out` (merging them to fit), clears this, and returns the number written.
+	size_t take(std::span<DirtyRect> out) {
+		if (out.empty())
+			return 0;
+
+		while (count > out.size())
+			merge_closest();
+
+		std::copy_n(rects.begin(), count, out.begin());
+		return std::exchange(count, 0);
+	}
+
+	void clear() {
+		count = 0;
+	}
+
+private:
+	// One spare, for adding a rect before merging down to MaxRects
+	std::array<DirtyRect, MaxRects + 1> rects{};
+	size_t count = 0;
+
+	// Merges the two rects whose union adds the fewest extra pixels
+	void merge_closest() {
+		if (count < 2)
+			return;
+
+		size_t best_a = 0, best_b = 1;
+		int64_t best_cost = INT64_MAX;
+		for (size_t a = 0; a < count; a++) {
+			for (size_t b = a + 1; b < count; b++) {
+				auto cost = int64_t(rects[a].merged(rects[b]).area()) - rects[a].area() - rects[b].area();
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_a = a;
+					best_b = b;
+				}
+			}
+		}
+
+		rects[best_a] = rects[best_a].merged(rects[best_b]);
+		rects[best_b] = rects[--count];
+	}
+};
+
+} // namespace MetaModule
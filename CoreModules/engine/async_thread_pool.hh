@@ -0,0 +1,294 @@
+#pragma once
+#include "CoreModules/async_thread.hh"
+#include "CoreModules/engine/task_pool.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// An AsyncThread implementation for hosts, which runs every AsyncThread on one shared TaskPool
+// instead of giving each its own thread. Include this in exactly one translation unit of the host.
+//
+// - start(): the action runs once every METAMODULE_ASYNC_POOL_PERIOD_US until stop(). In between,
+//   the AsyncThread is off the pool's queues, so it doesn't keep the workers busy.
+// - run_once(): the action runs once more, right away, whether or not the AsyncThread is started
+// - stop(): waits for a running action to finish, unless called from inside the action itself.
+//   It doesn't wait for an action that's only queued: that run is skipped.
+//
+// An action never runs on two threads at once.
+// The number of threads is METAMODULE_ASYNC_POOL_THREADS, or the number of cores if 0 or undefined.
+
+#ifndef METAMODULE_ASYNC_POOL_THREADS
+#define METAMODULE_ASYNC_POOL_THREADS 0
+#endif
+
+#ifndef METAMODULE_ASYNC_POOL_PERIOD_US
+#define METAMODULE_ASYNC_POOL_PERIOD_US 1000
+#endif
+
+namespace MetaModule
+{
+
+// How often a started AsyncThread runs
+inline constexpr std::chrono::microseconds AsyncThreadPeriod{METAMODULE_ASYNC_POOL_PERIOD_US};
+
+inline TaskPool &async_task_pool() {
+	static TaskPool pool{METAMODULE_ASYNC_POOL_THREADS ? METAMODULE_ASYNC_POOL_THREADS :
+														 std::thread::hardware_concurrency()};
+	return pool;
+}
+
+struct AsyncThread::Internal final : PoolTask {
+	AsyncThread *owner;
+	CoreProcessor *module;
+	std::atomic<TaskPriority> priority{TaskPriority::Normal};
+
+	// Enabled: started. OncePending: run_once() was called.
+	// Queued: owned by the pool (queued, running, or waiting for its period). Cleared by the task itself, as
+	// the last thing it does, or by stop() when it takes the task back from the timer.
+	// Running: the action is about to run, or running. Waiting: on the timer. Whoever clears it queues the task.
+	// Orphaned: the AsyncThread was destroyed while the task was queued. The task deletes itself when it runs.
+	static constexpr uint8_t Enabled = 0b000001;
+	static constexpr uint8_t OncePending = 0b000010;
+	static constexpr uint8_t Queued = 0b000100;
+	static constexpr uint8_t Running = 0b001000;
+	static constexpr uint8_t Waiting = 0b010000;
+	static constexpr uint8_t Orphaned = 0b100000;
+	std::atomic<uint8_t> state{0};
+
+	// Whether the timer may have an entry for this (only touched while Running)
+	bool timed = false;
+
+	static inline thread_local Internal *running_here = nullptr;
+
+	// Queues started tasks again when their period is up. One thread, which sleeps until the next one is due.
+	class Timer {
+	public:
+		Timer() {
+			// Construct the pool first, so it's destroyed after the timer that queues tasks on it
+			async_task_pool();
+			thread = std::thread{[this] { loop(); }};
+		}
+
+		~Timer() {
+			{
+				std::lock_guard lock{mutex};
+				running = false;
+			}
+			wakeup.notify_one();
+			thread.join();
+		}
+
+		// From the end of a run: Running -> Waiting, if the task is still just started.
+		// Returns false if its state changed, so the caller can check again.
+		bool wait(Internal *task) {
+			auto due = std::chrono::steady_clock::now() + AsyncThreadPeriod;
+			std::lock_guard lock{mutex};
+
+			auto s = task->state.load();
+			if ((s & (Enabled | OncePending | Orphaned)) != Enabled)
+				return false;
+
+			// Add the entry before clearing Running, so the AsyncThread's destructor can always find it
+			task->timed = true;
+			auto entry = std::find_if(waiting.begin(), waiting.end(), [=](auto &e) { return e.task == task; });
+			if (entry == waiting.end())
+				waiting.push_back({due, task});
+			else
+				entry->due = due;
+
+			if (!task->state.compare_exchange_strong(s, uint8_t((s & ~Running) | Waiting)))
+				return false;
+
+			wakeup.notify_one();
+			return true;
+		}
+
+		// Entries can be left behind when run_once() or stop() takes a task from the timer
+		void remove(Internal *task) {
+			std::lock_guard lock{mutex};
+			std::erase_if(waiting, [=](auto &e) { return e.task == task; });
+		}
+
+	private:
+		struct Entry {
+			std::chrono::steady_clock::time_point due;
+			Internal *task;
+		};
+
+		std::mutex mutex;
+		std::condition_variable wakeup;
+		std::vector<Entry> waiting;
+		bool running = true;
+		std::thread thread;
+
+		void loop() {
+			std::unique_lock lock{mutex};
+			while (running) {
+				auto now = std::chrono::steady_clock::now();
+				auto next = std::chrono::steady_clock::time_point::max();
+
+				for (size_t i = 0; i < waiting.size();) {
+					auto [due, task] = waiting[i];
+					if (due <= now) {
+						waiting[i] = waiting.back();
+						waiting.pop_back();
+						task->wake();
+					} else {
+						next = std::min(next, due);
+						i++;
+					}
+				}
+
+				if (next == std::chrono::steady_clock::time_point::max())
+					wakeup.wait(lock);
+				else
+					wakeup.wait_until(lock, next);
+			}
+		}
+	};
+
+	static Timer &timer() {
+		static Timer timer;
+		return timer;
+	}
+
+	Internal(AsyncThread *owner, CoreProcessor *module)
+		: owner{owner}
+		, module{module} {
+	}
+
+	void request(uint8_t flag) {
+		auto s = state.fetch_or(flag | Queued);
+		if (!(s & Queued))
+			enqueue();
+		else if (flag == OncePending)
+			wake();
+	}
+
+	// Takes the task off the timer (lock-free), if it's waiting there
+	bool take_waiting() {
+		return state.fetch_and(uint8_t(~Waiting)) & Waiting;
+	}
+
+	void wake() {
+		if (take_waiting())
+			enqueue();
+	}
+
+	void enqueue() {
+		// Only fails with more than the queue's capacity of AsyncThreads at one priority
+		while (!async_task_pool().submit(this, priority.load(std::memory_order_relaxed)))
+			std::this_thread::yield();
+	}
+
+	void stop() {
+		state.fetch_and(uint8_t(~(Enabled | OncePending)));
+		if (take_waiting())
+			state.fetch_and(uint8_t(~Queued));
+
+		if (running_here == this)
+			return;
+		while (state.load() & Running)
+			std::this_thread::yield();
+	}
+
+	// After stop(), from the AsyncThread's destructor. Returns true if the task is still queued in the pool,
+	// in which case it now owns itself.
+	bool orphan() {
+		if (timed)
+			timer().remove(this);
+
+		auto s = state.load();
+		while (s & Queued) {
+			if (state.compare_exchange_weak(s, uint8_t(s | Orphaned)))
+				return true;
+		}
+		return false;
+	}
+
+	void run() override {
+		// Decide whether to run in the same step as marking Running, so stop() either waits for the run or skips it
+		auto s = state.load();
+		uint8_t next;
+		do {
+			next = (s & (Enabled | OncePending)) ? uint8_t((s & ~OncePending) | Running) : s;
+		} while (!state.compare_exchange_weak(s, next));
+
+		if (next & Running) {
+			auto outer = std::exchange(running_here, this);
+			owner->action();
+			running_here = outer;
+		}
+
+		// Queue again now after a run_once(), wait for the period if started, else leave the pool.
+		// Never touch this after leaving the pool: the AsyncThread may be destroyed right away.
+		s = state.load();
+		while (true) {
+			if (s & Orphaned) {
+				delete this;
+				return;
+			}
+
+			if (s & OncePending) {
+				if (state.compare_exchange_weak(s, uint8_t(s & ~Running))) {
+					enqueue();
+					return;
+				}
+			} else if (s & Enabled) {
+				if (timer().wait(this))
+					return;
+				s = state.load();
+			} else if (state.compare_exchange_weak(s, uint8_t(s & ~(Running | Queued))))
+				return;
+		}
+	}
+};
+
+AsyncThread::AsyncThread(CoreProcessor *module)
+	: internal{std::make_unique<Internal>(this, module)} {
+}
+
+AsyncThread::AsyncThread(CoreProcessor *module, Callback &&action)
+	: action{std::move(action)}
+	, internal{std::make_unique<Internal>(this, module)} {
+}
+
+void AsyncThread::start() {
+	internal->request(Internal::Enabled);
+}
+
+void AsyncThread::start(Callback &&new_action) {
+	internal->stop();
+	action = std::move(new_action);
+	start();
+}
+
+void AsyncThread::stop() {
+	internal->stop();
+}
+
+void AsyncThread::run_once() {
+	internal->request(Internal::OncePending);
+}
+
+bool AsyncThread::is_enabled() {
+	return internal->state.load() & Internal::Enabled;
+}
+
+void AsyncThread::set_priority(Priority priority) {
+	internal->priority.store(TaskPriority(priority), std::memory_order_relaxed);
+}
+
+AsyncThread::~AsyncThread() {
+	internal->stop();
+	if (internal->orphan())
+		internal.release();
+}
+
+} // namespace MetaModule
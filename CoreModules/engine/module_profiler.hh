@@ -0,0 +1,250 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Define METAMODULE_PROFILE_MODULES to enable timing of each module's update() and update_block().
+// When not defined, ModuleProfiler::time() just calls the function, and no stats are kept.
+
+namespace MetaModule
+{
+
+// Collects per-module timing stats, keyed by CoreProcessor::id.
+//
+// The audio thread calls time() (or record()). The GUI thread calls read(),
+// which never blocks the audio thread: each module's stats are protected by a
+// sequence counter, and read() returns nullopt if it can't get a consistent copy.
+//
+// Several audio threads (e.g. ParallelPatchEngine's workers) can time modules at once. Give each
+// module a unique id then: if two threads time modules with the same id at the same moment, one of
+// the timings is dropped (and counted in num_dropped()) rather than corrupting the stats or waiting.
+//
+// Timings are in cycles of the CPU's cycle counter (or the generic timer on aarch64,
+// or nanoseconds if no counter is available), per frame.
+// Percentiles come from a histogram with four buckets per power of 2, so they are
+// accurate to within 25%.
+//
+// PatchEngine times the modules it runs (see PatchEngine::set_profiler()). Hosts that call
+// a module's update() themselves use time_update(), or wrap the call in time().
+// Modules with an id of MaxModules or more are not timed: num_dropped() counts those calls too.
+//
+template<size_t MaxModules = 256>
+class ModuleProfilerT {
+public:
+#ifdef METAMODULE_PROFILE_MODULES
+	static constexpr bool enabled = true;
+#else
+	static constexpr bool enabled = false;
+#endif
+
+	struct Stats {
+		uint64_t count;
+		uint32_t min;
+		uint32_t max;
+		float mean;
+		uint32_t p50;
+		uint32_t p95;
+		uint32_t p99;
+	};
+
+	static uint32_t cycle_count() {
+#if defined(__x86_64__) || defined(__i386__)
+		return uint32_t(__rdtsc());
+#elif defined(__aarch64__)
+		uint64_t val;
+		asm volatile("mrs %0, cntvct_el0" : "=r"(val));
+		return uint32_t(val);
+#elif defined(__ARM_ARCH_7A__) && !defined(__linux__)
+		// PMCCNTR: the firmware enables the cycle counter
+		uint32_t val;
+		asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(val));
+		return val;
+#else
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		return uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+#endif
+	}
+
+	// Audio thread: runs func and records how long it took, divided by num_frames
+	template<typename F>
+	void time(uint32_t module_id, unsigned num_frames, F &&func) {
+		if constexpr (enabled) {
+			auto start = cycle_count();
+			func();
+			auto cycles = cycle_count() - start;
+			record(module_id, num_frames > 1 ? cycles / num_frames : cycles);
+		} else {
+			func();
+		}
+	}
+
+	// Audio thread: runs module.update() (for a CoreProcessor run outside of PatchEngine)
+	template<typename Module>
+	void time_update(Module &module) {
+		time(module.id, 1, [&] { module.update(); });
+	}
+
+	// Audio threads
+	void record(uint32_t module_id, uint32_t cycles) {
+		if constexpr (enabled) {
+			if (module_id >= MaxModules) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			// An odd seq means another thread is recording into this slot: drop this timing instead of waiting
+			auto &slot = slots[module_id];
+			auto seq = slot.seq.load(std::memory_order_relaxed);
+			if ((seq & 1) ||
+				!slot.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			std::atomic_thread_fence(std::memory_order_release);
+
+			if (slot.reset_requested.exchange(false, std::memory_order_acquire))
+				clear(slot);
+
+			auto count = slot.count.load(std::memory_order_relaxed);
+			if (count == 0 || cycles < slot.min.load(std::memory_order_relaxed))
+				slot.min.store(cycles, std::memory_order_relaxed);
+			if (cycles > slot.max.load(std::memory_order_relaxed))
+				slot.max.store(cycles, std::memory_order_relaxed);
+			slot.count.store(count + 1, std::memory_order_relaxed);
+			slot.sum.store(slot.sum.load(std::memory_order_relaxed) + cycles, std::memory_order_relaxed);
+
+			auto &bucket = slot.histogram[bucket_index(cycles)];
+			bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+			slot.seq.store(seq + 2, std::memory_order_release);
+		}
+	}
+
+	// GUI thread. Returns nullopt if the module has no stats, or the audio thread
+	// was writing them on every attempt.
+	std::optional<Stats> read(uint32_t module_id) const {
+		if constexpr (enabled) {
+			if (module_id >= MaxModules)
+				return std::nullopt;
+
+			auto &slot = slots[module_id];
+
+			for (unsigned attempt = 0; attempt < 4; attempt++) {
+				auto seq = slot.seq.load(std::memory_order_acquire);
+				if (seq & 1)
+					continue;
+
+				Stats stats{};
+				stats.count = slot.count.load(std::memory_order_relaxed);
+				stats.min = slot.min.load(std::memory_order_relaxed);
+				stats.max = slot.max.load(std::memory_order_relaxed);
+				auto sum = slot.sum.load(std::memory_order_relaxed);
+
+				std::array<uint32_t, NumBuckets> histogram;
+				for (unsigned i = 0; i < NumBuckets; i++)
+					histogram[i] = slot.histogram[i].load(std::memory_order_relaxed);
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot.seq.load(std::memory_order_relaxed) != seq)
+					continue;
+
+				if (stats.count == 0)
+					return std::nullopt;
+
+				stats.mean = float(sum) / float(stats.count);
+				stats.p50 = percentile(histogram, stats.count, 0.50f);
+				stats.p95 = percentile(histogram, stats.count, 0.95f);
+				stats.p99 = percentile(histogram, stats.count, 0.99f);
+				return stats;
+			}
+		}
+		return std::nullopt;
+	}
+
+	// Number of timings not recorded: of modules with an id of MaxModules or more, or of modules
+	// with the same id timed on two threads at once
+	uint64_t num_dropped() const {
+		if constexpr (enabled)
+			return dropped.load(std::memory_order_relaxed);
+		else
+			return 0;
+	}
+
+	// GUI thread: the stats are cleared the next time the module is timed
+	void reset(uint32_t module_id) {
+		if constexpr (enabled) {
+			if (module_id < MaxModules)
+				slots[module_id].reset_requested.store(true, std::memory_order_release);
+		}
+	}
+
+private:
+	static constexpr unsigned NumBuckets = 128;
+
+	struct Slot {
+		std::atomic<uint32_t> seq{0};
+		std::atomic<bool> reset_requested{false};
+		std::atomic<uint32_t> min{0};
+		std::atomic<uint32_t> max{0};
+		std::atomic<uint64_t> count{0};
+		std::atomic<uint64_t> sum{0};
+		std::array<std::atomic<uint32_t>, NumBuckets> histogram{};
+	};
+
+	struct Empty {};
+	[[no_unique_address]] std::conditional_t<enabled, std::array<Slot, MaxModules>, Empty> slots;
+	[[no_unique_address]] std::conditional_t<enabled, std::atomic<uint64_t>, Empty> dropped{};
+
+	static void clear(Slot &slot) {
+		slot.min.store(0, std::memory_order_relaxed);
+		slot.max.store(0, std::memory_order_relaxed);
+		slot.count.store(0, std::memory_order_relaxed);
+		slot.sum.store(0, std::memory_order_relaxed);
+		for (auto &bucket : slot.histogram)
+			bucket.store(0, std::memory_order_relaxed);
+	}
+
+	// Four buckets per power of 2: the bucket is chosen by the two bits after the leading 1
+	static unsigned bucket_index(uint32_t cycles) {
+		if (cycles < 4)
+			return cycles;
+		unsigned log2 = std::bit_width(cycles) - 1;
+		unsigned quarter = (cycles >> (log2 - 2)) & 0b11;
+		return log2 * 4 + quarter;
+	}
+
+	// Upper bound of a bucket
+	static uint32_t bucket_limit(unsigned bucket) {
+		if (bucket < 4)
+			return bucket;
+		unsigned log2 = bucket / 4;
+		uint64_t lower = (uint64_t{4} + (bucket & 0b11)) << (log2 - 2);
+		uint64_t upper = lower + (uint64_t{1} << (log2 - 2)) - 1;
+		return uint32_t(std::min<uint64_t>(upper, UINT32_MAX));
+	}
+
+	static uint32_t percentile(std::array<uint32_t, NumBuckets> const &histogram, uint64_t count, float pct) {
+		auto target = uint64_t(pct * float(count));
+		uint64_t total = 0;
+		for (unsigned i = 0; i < NumBuckets; i++) {
+			total += histogram[i];
+			if (total > target)
+				return bucket_limit(i);
+		}
+		return bucket_limit(NumBuckets - 1);
+	}
+};
+
+using ModuleProfiler = ModuleProfilerT<>;
+
+} // namespace MetaModule
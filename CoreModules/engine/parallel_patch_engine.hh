@@ -0,0 +1,199 @@
+#pragma once
+#include "CoreModules/engine/patch_engine.hh"
+#include "CoreModules/engine/work_stealing_deque.hh"
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace MetaModule
+{
+
+// ParallelPatchEngine runs process_block() on a fixed pool of threads.
+//
+// The patch is split into independent subgraphs (groups of modules with no cables
+// between them). Each subgraph is a task that runs its modules in the same order
+// PatchEngine uses. Tasks are spread over per-thread work-stealing deques, and idle
+// threads steal from the others. The calling thread also runs tasks, and
+// process_block() returns when every task for the block is done.
+//
+// Since no data flows between subgraphs, the results are bit-for-bit identical
+// to PatchEngine::process_block().
+//
+// process() (one frame at a time) is not parallelized.
+//
+class ParallelPatchEngine : public PatchEngine {
+public:
+	// num_threads includes the thread calling process_block()
+	explicit ParallelPatchEngine(unsigned num_threads = std::thread::hardware_concurrency()) {
+		num_threads = std::max(num_threads, 1u);
+
+		for (unsigned i = 0; i < num_threads; i++)
+			workers.push_back(std::make_unique<Worker>());
+
+		for (unsigned i = 1; i < num_threads; i++)
+			workers[i]->thread = std::thread([this, i] { worker_loop(i); });
+	}
+
+	~ParallelPatchEngine() override {
+		running.store(false, std::memory_order_relaxed);
+		epoch.fetch_add(1, std::memory_order_release);
+		epoch.notify_all();
+
+		for (auto &worker : workers) {
+			if (worker->thread.joinable())
+				worker->thread.join();
+		}
+	}
+
+	ParallelPatchEngine(const ParallelPatchEngine &) = delete;
+	ParallelPatchEngine &operator=(const ParallelPatchEngine &) = delete;
+
+	unsigned num_threads() const {
+		return workers.size();
+	}
+
+	// Number of independent subgraphs the patch was split into
+	size_t num_subgraphs() {
+		update_subgraphs();
+		return subgraph_starts.size() - 1;
+	}
+
+	void process_block(unsigned num_frames) override {
+		update_subgraphs();
+
+		block_frames = std::min(num_frames, block_size);
+		auto num_tasks = uint32_t(subgraph_starts.size() - 1);
+
+		if (workers.size() == 1 || num_tasks <= 1) {
+			for (uint32_t task = 0; task < num_tasks; task++)
+				run_subgraph(task);
+			return;
+		}
+
+		// All workers are parked, so the deques can be filled from this thread.
+		uint32_t task = 0;
+		for (; task < num_tasks; task++) {
+			if (!workers[task % workers.size()]->tasks.push(task))
+				break;
+		}
+		auto first_overflow_task = task;
+
+		tasks_remaining.store(num_tasks, std::memory_order_relaxed);
+		active_workers.store(workers.size() - 1, std::memory_order_relaxed);
+		epoch.fetch_add(1, std::memory_order_release);
+		epoch.notify_all();
+
+		// Tasks that did not fit in the deques are run here
+		for (task = first_overflow_task; task < num_tasks; task++) {
+			run_subgraph(task);
+			tasks_remaining.fetch_sub(1, std::memory_order_release);
+		}
+
+		run_tasks(0);
+
+		// Barrier: wait for every worker to park again
+		while (active_workers.load(std::memory_order_acquire) > 0)
+			std::this_thread::yield();
+	}
+
+private:
+	static constexpr size_t MaxTasksPerThread = 1024;
+
+	struct Worker {
+		WorkStealingDeque<uint32_t, MaxTasksPerThread> tasks;
+		std::thread thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	std::atomic<uint32_t> epoch{0};
+	std::atomic<uint32_t> tasks_remaining{0};
+	std::atomic<uint32_t> active_workers{0};
+	std::atomic<bool> running{true};
+	unsigned block_frames = 0;
+
+	// Steps of subgraph i are subgraph_steps[subgraph_starts[i]] to subgraph_steps[subgraph_starts[i + 1] - 1]
+	std::vector<uint32_t> subgraph_steps;
+	std::vector<uint32_t> subgraph_starts{0};
+	uint32_t subgraph_version = 0;
+
+	void worker_loop(unsigned self) {
+		uint32_t seen = 0;
+
+		while (true) {
+			epoch.wait(seen, std::memory_order_acquire);
+			seen = epoch.load(std::memory_order_acquire);
+
+			if (!running.load(std::memory_order_relaxed))
+				return;
+
+			run_tasks(self);
+			active_workers.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void run_tasks(unsigned self) {
+		while (tasks_remaining.load(std::memory_order_acquire) > 0) {
+			auto task = workers[self]->tasks.pop();
+
+			for (unsigned i = 1; !task && i < workers.size(); i++)
+				task = workers[(self + i) % workers.size()]->tasks.steal();
+
+			if (task) {
+				run_subgraph(*task);
+				tasks_remaining.fetch_sub(1, std::memory_order_release);
+			} else
+				std::this_thread::yield();
+		}
+	}
+
+	void run_subgraph(uint32_t subgraph) {
+		for (auto i = subgraph_starts[subgraph]; i < subgraph_starts[subgraph + 1]; i++)
+			run_step(steps[subgraph_steps[i]], block_frames);
+	}
+
+	uint32_t find_root(std::vector<uint32_t> &parent, uint32_t x) {
+		while (parent[x] != x)
+			x = parent[x] = parent[parent[x]];
+		return x;
+	}
+
+	// Groups the steps into connected components (union-find over the cables),
+	// keeping schedule order within each component.
+	void update_subgraphs() {
+		if (dirty)
+			rebuild_schedule();
+
+		if (subgraph_version == schedule_version)
+			return;
+
+		std::vector<uint32_t> parent(slots.size());
+		std::iota(parent.begin(), parent.end(), 0);
+		for (auto &cable : cables)
+			parent[find_root(parent, cable.out.module_idx)] = find_root(parent, cable.in.module_idx);
+
+		std::vector<uint32_t> subgraph_of_root(slots.size(), UINT32_MAX);
+		std::vector<std::vector<uint32_t>> subgraphs;
+		for (uint32_t i = 0; i < steps.size(); i++) {
+			auto root = find_root(parent, steps[i].module_idx);
+			if (subgraph_of_root[root] == UINT32_MAX) {
+				subgraph_of_root[root] = subgraphs.size();
+				subgraphs.emplace_back();
+			}
+			subgraphs[subgraph_of_root[root]].push_back(i);
+		}
+
+		subgraph_steps.clear();
+		subgraph_starts.assign(1, 0);
+		for (auto &subgraph : subgraphs) {
+			subgraph_steps.insert(subgraph_steps.end(), subgraph.begin(), subgraph.end());
+			subgraph_starts.push_back(subgraph_steps.size());
+		}
+
+		subgraph_version = schedule_version;
+	}
+};
+
+} // namespace MetaModule
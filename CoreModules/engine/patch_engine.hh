@@ -0,0 +1,587 @@
+#pragma once
+#include "CoreModules/CoreProcessor.hh"
+#include "CoreModules/elements/element_counter.hh"
+#include "CoreModules/engine/module_profiler.hh"
+#include "CoreModules/index_mask.hh"
+#include "CoreModules/module_events.hh"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace MetaModule
+{
+
+struct PatchJack {
+	uint32_t module_idx;
+	uint16_t jack_id;
+
+	bool operator==(const PatchJack &) const = default;
+};
+
+// A cable connects an output jack to an input jack
+struct PatchCable {
+	PatchJack out;
+	PatchJack in;
+
+	bool operator==(const PatchCable &) const = default;
+};
+
+// PatchEngine runs a set of modules connected by cables.
+//
+// Modules are run in dependency order (a module runs after all modules that feed it).
+// Feedback loops are broken by delaying one cable in the loop: the module reading
+// a feedback cable sees the value from the previous frame (process()) or the previous
+// block (process_block()).
+//
+// The schedule and the cable-copy tables are built the first time the patch is run
+// after it changes, or when calling rebuild_schedule() explicitly.
+//
+// The engine does not own the modules.
+//
+// Example:
+// 	PatchEngine engine;
+// 	auto osc = engine.add_module(&my_osc, ElementCount::count<OscInfo>());
+// 	auto vca = engine.add_module(&my_vca, ElementCount::count<VcaInfo>());
+// 	engine.add_cable({.out = {osc, 0}, .in = {vca, 1}});
+// 	engine.set_block_size(64);
+// 	engine.process_block(64);
+//
+class PatchEngine {
+public:
+	virtual ~PatchEngine() = default;
+
+	// Adds a module, returning its index in the engine.
+	// counts gives the number of jacks of the module (e.g. ElementCount::count<Info>())
+	uint32_t add_module(CoreProcessor *module, ElementCount::Counts counts) {
+		auto free_slot = std::find_if(slots.begin(), slots.end(), [](auto &s) { return s.module == nullptr; });
+		if (free_slot == slots.end())
+			free_slot = slots.insert(slots.end(), Slot{});
+
+		*free_slot = Slot{.module = module, .counts = counts, .events = std::make_unique<ModuleEventQueue>()};
+		invalidate();
+		return free_slot - slots.begin();
+	}
+
+	// Removes a module, and all cables connected to it
+	void remove_module(uint32_t module_idx) {
+		if (!valid_module(module_idx))
+			return;
+
+		slots[module_idx] = Slot{};
+		std::erase_if(cables, [=](auto &c) { return c.out.module_idx == module_idx || c.in.module_idx == module_idx; });
+		invalidate();
+	}
+
+	// Sends an event to a module from another thread, to be applied just before the module next runs.
+	// Only one thread may post events. Returns false if the module's queue is full.
+	bool post_event(uint32_t module_idx, ModuleEvent const &event) {
+		if (!valid_module(module_idx))
+			return false;
+		return slots[module_idx].events->push(event);
+	}
+
+	CoreProcessor *module(uint32_t module_idx) const {
+		return module_idx < slots.size() ? slots[module_idx].module : nullptr;
+	}
+
+	// Returns false if either jack does not exist, or the input jack already has a cable
+	bool add_cable(PatchCable cable) {
+		if (!valid_module(cable.out.module_idx) || !valid_module(cable.in.module_idx))
+			return false;
+
+		if (cable.out.jack_id >= slots[cable.out.module_idx].counts.num_outputs)
+			return false;
+
+		if (cable.in.jack_id >= slots[cable.in.module_idx].counts.num_inputs)
+			return false;
+
+		if (std::ranges::any_of(cables, [=](auto &c) { return c.in == cable.in; }))
+			return false;
+
+		cables.push_back(cable);
+		invalidate();
+		return true;
+	}
+
+	bool remove_cable(PatchCable cable) {
+		if (std::erase(cables, cable) == 0)
+			return false;
+
+		invalidate();
+		return true;
+	}
+
+	void clear() {
+		slots.clear();
+		cables.clear();
+		invalidate();
+	}
+
+	std::span<const PatchCable> get_cables() const {
+		return cables;
+	}
+
+	// Sets the maximum number of frames process_block() will be called with
+	void set_block_size(unsigned max_frames) {
+		if (max_frames != block_size) {
+			block_size = max_frames;
+			invalidate();
+		}
+	}
+
+	// Runs every module for one frame
+	void process() {
+		if (dirty)
+			rebuild_schedule();
+
+		for (auto &step : steps) {
+			for (auto &copy : std::span{copies}.subspan(step.first_copy, step.num_copies))
+				step.module->set_input(copy.input, copy.from->get_output(copy.output));
+
+			drain_events(*slots[step.module_idx].events, *step.module);
+			timed(step.module, 1, [&] { step.module->update(); });
+		}
+	}
+
+	// Runs every module for num_frames frames (num_frames must not exceed the block size).
+	// Virtual so ParallelPatchEngine runs in parallel when called through a PatchEngine & too.
+	virtual void process_block(unsigned num_frames) {
+		if (dirty)
+			rebuild_schedule();
+
+		num_frames = std::min(num_frames, block_size);
+
+		for (auto &step : steps)
+			run_step(step, num_frames);
+	}
+
+	// The samples written to an output jack during the last process_block()
+	std::span<const float> output_buffer(PatchJack jack) {
+		if (dirty)
+			rebuild_schedule();
+
+		if (!valid_module(jack.module_idx) || jack.jack_id >= slots[jack.module_idx].counts.num_outputs)
+			return {};
+
+		return std::span{block_buffers}.subspan(output_buffer_offset(jack), block_size);
+	}
+
+	// Module indices in the order they are run
+	std::span<const uint32_t> module_order() {
+		if (dirty)
+			rebuild_schedule();
+		return order;
+	}
+
+	// Whether a cable was chosen to be delayed to break a feedback loop
+	bool is_feedback(PatchCable cable) {
+		if (dirty)
+			rebuild_schedule();
+
+		auto found = std::ranges::find(cables, cable);
+		return found != cables.end() && feedback[found - cables.begin()];
+	}
+
+	// Times every module's update() or update_block() call, keyed by CoreProcessor::id.
+	// Only has an effect if METAMODULE_PROFILE_MODULES is defined.
+	// With ParallelPatchEngine, give each module a unique id: timings of modules that share
+	// an id and run at the same moment on different threads are dropped (see ModuleProfilerT).
+	void set_profiler(ModuleProfiler *module_profiler) {
+		profiler = module_profiler;
+	}
+
+	// Whole-patch snapshot: the binary state of every module, one after another in one buffer.
+	// Each module's record is a StateRecord followed by its state.
+	// Modules that don't support binary state (binary_state_size() is 0) are skipped.
+	size_t state_size() const {
+		size_t size = 0;
+		for (auto &slot : slots) {
+			if (slot.module) {
+				if (auto module_size = slot.module->binary_state_size())
+					size += sizeof(StateRecord) + module_size;
+			}
+		}
+		return size;
+	}
+
+	// Returns the number of bytes written, or 0 if the buffer is smaller than state_size()
+	size_t save_state_into(std::span<std::byte> buffer) {
+		if (buffer.size() < state_size())
+			return 0;
+
+		size_t pos = 0;
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			auto &slot = slots[i];
+			if (!slot.module || slot.module->binary_state_size() == 0)
+				continue;
+
+			slot.saved_generation = slot.module->state_generation();
+			pos += write_state_record(i, buffer.subspan(pos), [&](auto state) {
+				return slot.module->save_state_into(state);
+			});
+		}
+		return pos;
+	}
+
+	// Loads a snapshot made by save_state_into().
+	// Returns false if the snapshot is truncated, or any module is missing or rejects its state
+	// (the other modules are still loaded).
+	bool load_state_from(std::span<const std::byte> data) {
+		return read_state_records(data, [](CoreProcessor *module, auto state) { return module->load_state_from(state); });
+	}
+
+	// Delta snapshot: the same format as save_state_into(), but only of modules whose state changed
+	// since they were last saved (by either function), and only their state that changed.
+	// Loading a full snapshot and then each delta snapshot in order restores the patch.
+	//
+	// Saving records each module's state generation, so the next delta starts from there.
+	bool has_state_changes() const {
+		return std::ranges::any_of(slots, [](auto &slot) { return state_changed(slot); });
+	}
+
+	size_t state_delta_size() const {
+		size_t size = 0;
+		for (auto &slot : slots) {
+			if (state_changed(slot))
+				size += sizeof(StateRecord) + slot.module->state_delta_size(slot.saved_generation);
+		}
+		return size;
+	}
+
+	// Returns the number of bytes written, or 0 if the buffer is smaller than state_delta_size()
+	size_t save_state_delta_into(std::span<std::byte> buffer) {
+		if (buffer.size() < state_delta_size())
+			return 0;
+
+		size_t pos = 0;
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			auto &slot = slots[i];
+			if (!state_changed(slot))
+				continue;
+
+			auto since = std::exchange(slot.saved_generation, slot.module->state_generation());
+			pos += write_state_record(i, buffer.subspan(pos), [&](auto state) {
+				return slot.module->save_state_delta_into(since, state);
+			});
+		}
+		return pos;
+	}
+
+	bool load_state_delta_from(std::span<const std::byte> data) {
+		return read_state_records(
+			data, [](CoreProcessor *module, auto state) { return module->load_state_delta_from(state); });
+	}
+
+	// Sorts the modules and builds the cable-copy tables.
+	// This allocates, so hosts may want to call it after changing the patch,
+	// rather than letting the next process() or process_block() call do it.
+	void rebuild_schedule() {
+		sort_modules();
+		build_tables();
+		update_patched_jacks();
+		dirty = false;
+		schedule_version++;
+	}
+
+protected:
+	struct StateRecord {
+		uint32_t module_idx;
+		uint32_t size;
+	};
+
+	struct Slot {
+		CoreProcessor *module = nullptr;
+		ElementCount::Counts counts{};
+		uint32_t saved_generation = 0;
+		std::unique_ptr<ModuleEventQueue> events;
+	};
+
+	struct CableCopy {
+		CoreProcessor *from;
+		uint16_t output;
+		uint16_t input;
+	};
+
+	struct Step {
+		CoreProcessor *module;
+		uint32_t module_idx;
+		uint32_t first_copy;
+		uint32_t num_copies;
+		uint32_t first_input;
+		uint32_t num_inputs;
+		uint32_t first_output;
+		uint32_t num_outputs;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<PatchCable> cables;
+
+	// Schedule:
+	bool dirty = true;
+	uint32_t schedule_version = 0;
+	unsigned block_size = 1;
+	std::vector<uint32_t> order;
+	std::vector<bool> feedback;
+	std::vector<Step> steps;
+	std::vector<CableCopy> copies;
+	std::vector<uint32_t> output_offsets;
+	std::vector<float> block_buffers;
+	std::vector<const float *> input_ptrs;
+	std::vector<float *> output_ptrs;
+
+	// For running part of a block: input_ptrs and output_ptrs, offset to the first frame.
+	// Each step has its own range, so steps can run in parallel.
+	std::vector<const float *> split_input_ptrs;
+	std::vector<float *> split_output_ptrs;
+
+	ModuleProfiler *profiler = nullptr;
+
+	// Runs a module for a block, split into parts at the frames where queued events take effect
+	void run_step(const Step &step, unsigned num_frames) {
+		auto ins = std::span{input_ptrs}.subspan(step.first_input, step.num_inputs);
+		auto outs = std::span{output_ptrs}.subspan(step.first_output, step.num_outputs);
+		auto &events = *slots[step.module_idx].events;
+
+		auto end = drain_events_until(events, *step.module, 0, num_frames);
+		if (end == num_frames) {
+			timed(step.module, num_frames, [&] { step.module->update_block(ins, outs, num_frames); });
+			return;
+		}
+
+		auto split_ins = std::span{split_input_ptrs}.subspan(step.first_input, step.num_inputs);
+		auto split_outs = std::span{split_output_ptrs}.subspan(step.first_output, step.num_outputs);
+
+		for (unsigned start = 0; start < num_frames;) {
+			for (unsigned i = 0; i < ins.size(); i++)
+				split_ins[i] = ins[i] ? ins[i] + start : nullptr;
+			for (unsigned i = 0; i < outs.size(); i++)
+				split_outs[i] = outs[i] ? outs[i] + start : nullptr;
+
+			auto frames = end - start;
+			timed(step.module, frames, [&] { step.module->update_block(split_ins, split_outs, frames); });
+
+			start = end;
+			if (start < num_frames)
+				end = drain_events_until(events, *step.module, start, num_frames);
+		}
+	}
+
+	template<typename F>
+	void timed(CoreProcessor *module, unsigned num_frames, F &&func) {
+		if constexpr (ModuleProfiler::enabled) {
+			if (profiler) {
+				profiler->time(module->id, num_frames, func);
+				return;
+			}
+		}
+		func();
+	}
+
+	static bool state_changed(Slot const &slot) {
+		return slot.module && slot.module->state_generation() != slot.saved_generation &&
+			   slot.module->binary_state_size() > 0;
+	}
+
+	// Writes a StateRecord, then the state written by save(state_buffer). Returns the total size.
+	template<typename SaveFunc>
+	static size_t write_state_record(uint32_t module_idx, std::span<std::byte> buffer, SaveFunc &&save) {
+		auto size = save(buffer.subspan(sizeof(StateRecord)));
+		StateRecord record{.module_idx = module_idx, .size = uint32_t(size)};
+		std::memcpy(buffer.data(), &record, sizeof record);
+		return sizeof record + record.size;
+	}
+
+	// Calls load(module, state) for each record.
+	// Afterwards, each loaded module counts as saved at its current state generation.
+	template<typename LoadFunc>
+	bool read_state_records(std::span<const std::byte> data, LoadFunc &&load) {
+		bool ok = true;
+		size_t pos = 0;
+		while (pos < data.size()) {
+			StateRecord record;
+			if (data.size() - pos < sizeof record)
+				return false;
+			std::memcpy(&record, data.data() + pos, sizeof record);
+			pos += sizeof record;
+
+			if (data.size() - pos < record.size)
+				return false;
+
+			if (valid_module(record.module_idx)) {
+				auto &slot = slots[record.module_idx];
+				ok &= load(slot.module, data.subspan(pos, record.size));
+				slot.saved_generation = slot.module->state_generation();
+			} else
+				ok = false;
+			pos += record.size;
+		}
+		return ok;
+	}
+
+	bool valid_module(uint32_t module_idx) const {
+		return module_idx < slots.size() && slots[module_idx].module != nullptr;
+	}
+
+	void invalidate() {
+		dirty = true;
+	}
+
+	size_t output_buffer_offset(PatchJack jack) const {
+		return (output_offsets[jack.module_idx] + jack.jack_id) * block_size;
+	}
+
+private:
+	// Kahn's algorithm. Ready modules are taken lowest index first, so the order is deterministic.
+	// When only modules in a loop remain, the lowest-indexed one with the fewest unresolved
+	// inputs is run next, and its unresolved incoming cables become feedback cables.
+	void sort_modules() {
+		order.clear();
+		feedback.assign(cables.size(), false);
+
+		std::vector<unsigned> num_deps(slots.size(), 0);
+		for (auto &cable : cables) {
+			if (cable.out.module_idx != cable.in.module_idx)
+				num_deps[cable.in.module_idx]++;
+		}
+
+		std::vector<bool> scheduled(slots.size(), false);
+		std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<>> ready;
+		size_t num_modules = 0;
+
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			if (!valid_module(i))
+				continue;
+			num_modules++;
+			if (num_deps[i] == 0)
+				ready.push(i);
+		}
+
+		while (order.size() < num_modules) {
+			if (ready.empty()) {
+				uint32_t best = 0;
+				unsigned fewest = UINT32_MAX;
+				for (uint32_t i = 0; i < slots.size(); i++) {
+					if (valid_module(i) && !scheduled[i] && num_deps[i] < fewest) {
+						best = i;
+						fewest = num_deps[i];
+					}
+				}
+
+				for (size_t c = 0; c < cables.size(); c++) {
+					auto &cable = cables[c];
+					if (cable.in.module_idx == best && cable.out.module_idx != best &&
+						!scheduled[cable.out.module_idx])
+					{
+						feedback[c] = true;
+					}
+				}
+				num_deps[best] = 0;
+				ready.push(best);
+			}
+
+			auto next = ready.top();
+			ready.pop();
+			if (scheduled[next])
+				continue;
+
+			scheduled[next] = true;
+			order.push_back(next);
+
+			for (size_t c = 0; c < cables.size(); c++) {
+				auto &cable = cables[c];
+				if (cable.out.module_idx != next)
+					continue;
+
+				if (cable.in.module_idx == next) {
+					// Self-patched: always a feedback cable
+					feedback[c] = true;
+					continue;
+				}
+
+				if (feedback[c] || scheduled[cable.in.module_idx])
+					continue;
+
+				if (--num_deps[cable.in.module_idx] == 0)
+					ready.push(cable.in.module_idx);
+			}
+		}
+	}
+
+	void build_tables() {
+		output_offsets.assign(slots.size(), 0);
+		uint32_t num_outputs = 0;
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			output_offsets[i] = num_outputs;
+			num_outputs += slots[i].counts.num_outputs;
+		}
+		block_buffers.assign(num_outputs * block_size, 0.f);
+
+		steps.clear();
+		copies.clear();
+		input_ptrs.clear();
+		output_ptrs.clear();
+
+		for (auto module_idx : order) {
+			auto &slot = slots[module_idx];
+
+			Step step{
+				.module = slot.module,
+				.module_idx = module_idx,
+				.first_copy = uint32_t(copies.size()),
+				.num_copies = 0,
+				.first_input = uint32_t(input_ptrs.size()),
+				.num_inputs = uint32_t(slot.counts.num_inputs),
+				.first_output = uint32_t(output_ptrs.size()),
+				.num_outputs = uint32_t(slot.counts.num_outputs),
+			};
+
+			input_ptrs.resize(input_ptrs.size() + slot.counts.num_inputs, nullptr);
+
+			for (auto &cable : cables) {
+				if (cable.in.module_idx != module_idx)
+					continue;
+
+				copies.push_back({slots[cable.out.module_idx].module, cable.out.jack_id, cable.in.jack_id});
+				input_ptrs[step.first_input + cable.in.jack_id] = &block_buffers[output_buffer_offset(cable.out)];
+			}
+			step.num_copies = copies.size() - step.first_copy;
+
+			for (uint16_t out = 0; out < slot.counts.num_outputs; out++)
+				output_ptrs.push_back(&block_buffers[output_buffer_offset({module_idx, out})]);
+
+			steps.push_back(step);
+		}
+
+		split_input_ptrs.assign(input_ptrs.size(), nullptr);
+		split_output_ptrs.assign(output_ptrs.size(), nullptr);
+	}
+
+	void update_patched_jacks() {
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			if (!valid_module(i))
+				continue;
+
+			auto &counts = slots[i].counts;
+			std::vector<uint64_t> ins(IndexMask::num_words(counts.num_inputs), 0);
+			std::vector<uint64_t> outs(IndexMask::num_words(counts.num_outputs), 0);
+
+			for (auto &cable : cables) {
+				if (cable.in.module_idx == i)
+					IndexMask::select(ins, cable.in.jack_id);
+				if (cable.out.module_idx == i)
+					IndexMask::select(outs, cable.out.jack_id);
+			}
+
+			slots[i].module->mark_inputs_patched(ins);
+			slots[i].module->mark_outputs_patched(outs);
+		}
+	}
+};
+
+} // namespace MetaModule
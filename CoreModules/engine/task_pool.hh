@@ -0,0 +1,253 @@
+#pragma once
+#include "CoreModules/engine/work_stealing_deque.hh"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace MetaModule
+{
+
+// Bounded multi-producer, multi-consumer queue (Dmitry Vyukov's algorithm).
+// Lock-free, FIFO, and never allocates after construction.
+template<typename T, size_t Capacity>
+class MpmcQueue {
+	static_assert(std::has_single_bit(Capacity), "Capacity must be a power of 2");
+
+public:
+	MpmcQueue() {
+		for (size_t i = 0; i < Capacity; i++)
+			cells[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	// Returns false if the queue is full
+	bool push(T item) {
+		auto pos = enqueue_pos.load(std::memory_order_relaxed);
+		while (true) {
+			auto &cell = cells[pos & (Capacity - 1)];
+			auto seq = cell.seq.load(std::memory_order_acquire);
+			auto diff = intptr_t(seq) - intptr_t(pos);
+
+			if (diff == 0) {
+				if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.item = item;
+					cell.seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0)
+				return false;
+			else
+				pos = enqueue_pos.load(std::memory_order_relaxed);
+		}
+	}
+
+	std::optional<T> pop() {
+		auto pos = dequeue_pos.load(std::memory_order_relaxed);
+		while (true) {
+			auto &cell = cells[pos & (Capacity - 1)];
+			auto seq = cell.seq.load(std::memory_order_acquire);
+			auto diff = intptr_t(seq) - intptr_t(pos + 1);
+
+			if (diff == 0) {
+				if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					T item = cell.item;
+					cell.seq.store(pos + Capacity, std::memory_order_release);
+					return item;
+				}
+			} else if (diff < 0)
+				return std::nullopt;
+			else
+				pos = dequeue_pos.load(std::memory_order_relaxed);
+		}
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> seq;
+		T item;
+	};
+
+	alignas(64) std::array<Cell, Capacity> cells{};
+	alignas(64) std::atomic<size_t> enqueue_pos{0};
+	alignas(64) std::atomic<size_t> dequeue_pos{0};
+};
+
+// Task priority classes: workers take the highest priority task available, except for a fair
+// share of turns given to the lower classes (see TaskPool::FairTurn).
+enum class TaskPriority : uint8_t {
+	High,	// e.g. file I/O that feeds the audio thread
+	Normal, // default
+	Low,	// e.g. rendering graphic displays
+};
+
+// A task for TaskPool. The submitter owns it, and must keep it alive until it has run.
+struct PoolTask {
+	virtual void run() = 0;
+
+protected:
+	~PoolTask() = default;
+};
+
+// A fixed pool of worker threads shared by many tasks (e.g. all AsyncThreads in a patch),
+// instead of one thread per task.
+//
+// submit() puts tasks on a FIFO queue per priority, which all workers take from. Higher priorities
+// run first, but every FairTurn-th task a worker takes, it looks at the next lower class first,
+// so tasks that keep re-submitting themselves at a high priority can't starve the others.
+// spawn() (from inside a task) puts a task on the worker's own deque, which other workers
+// steal from when they run out of work. Idle workers sleep until a task is submitted.
+//
+class TaskPool {
+public:
+	static constexpr size_t NumPriorities = 3;
+
+	// With every class busy, Normal gets at least 1 in FairTurn turns, and Low 1 in FairTurn^2
+	static constexpr unsigned FairTurn = 4;
+
+	explicit TaskPool(unsigned num_threads = std::thread::hardware_concurrency()) {
+		num_threads = std::max(num_threads, 1u);
+
+		for (unsigned i = 0; i < num_threads; i++)
+			workers.push_back(std::make_unique<Worker>());
+
+		for (unsigned i = 0; i < num_threads; i++)
+			workers[i]->thread = std::thread([this, i] { worker_loop(i); });
+	}
+
+	~TaskPool() {
+		running.store(false, std::memory_order_relaxed);
+		wake_epoch.fetch_add(1, std::memory_order_release);
+		wake_epoch.notify_all();
+
+		for (auto &worker : workers)
+			worker->thread.join();
+	}
+
+	TaskPool(const TaskPool &) = delete;
+	TaskPool &operator=(const TaskPool &) = delete;
+
+	unsigned num_threads() const {
+		return workers.size();
+	}
+
+	// Any thread. Returns false if the queue for this priority is full.
+	bool submit(PoolTask *task, TaskPriority priority = TaskPriority::Normal) {
+		if (!queues[index(priority)].push(task))
+			return false;
+		wake();
+		return true;
+	}
+
+	// From a task running on this pool: queues the task on this worker's deque (LIFO), so it
+	// likely runs next on the same thread unless an idle worker steals it.
+	// From any other thread, the same as submit().
+	bool spawn(PoolTask *task, TaskPriority priority = TaskPriority::Normal) {
+		if (current_pool != this || !workers[current_worker]->deques[index(priority)].push(task))
+			return submit(task, priority);
+		wake();
+		return true;
+	}
+
+	// Whether the calling thread is one of this pool's workers
+	bool on_worker_thread() const {
+		return current_pool == this;
+	}
+
+private:
+	static constexpr size_t QueueCapacity = 1024;
+	static constexpr size_t DequeCapacity = 256;
+
+	struct Worker {
+		std::array<WorkStealingDeque<PoolTask *, DequeCapacity>, NumPriorities> deques;
+		std::thread thread;
+		unsigned num_taken = 0; // worker's own thread only
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::array<MpmcQueue<PoolTask *, QueueCapacity>, NumPriorities> queues;
+
+	alignas(64) std::atomic<uint32_t> wake_epoch{0};
+	std::atomic<bool> running{true};
+
+	static inline thread_local TaskPool *current_pool = nullptr;
+	static inline thread_local unsigned current_worker = 0;
+
+	static size_t index(TaskPriority priority) {
+		return std::min<size_t>(size_t(priority), NumPriorities - 1);
+	}
+
+	void wake() {
+		wake_epoch.fetch_add(1, std::memory_order_release);
+		wake_epoch.notify_one();
+	}
+
+	void worker_loop(unsigned self) {
+		current_pool = this;
+		current_worker = self;
+
+		while (running.load(std::memory_order_relaxed)) {
+			if (auto task = find_task(self)) {
+				task->run();
+				continue;
+			}
+
+			// Check again after reading the epoch, so a task submitted in between isn't missed
+			auto seen = wake_epoch.load(std::memory_order_acquire);
+			if (auto task = find_task(self)) {
+				task->run();
+				continue;
+			}
+			if (running.load(std::memory_order_relaxed))
+				wake_epoch.wait(seen, std::memory_order_acquire);
+		}
+	}
+
+	// The worker's turn decides which class it looks at first, then the rest from the highest priority
+	PoolTask *find_task(unsigned self) {
+		auto &worker = *workers[self];
+		auto first = first_priority(worker.num_taken);
+
+		auto task = find_task(self, first);
+		for (size_t prio = 0; prio < NumPriorities && !task; prio++) {
+			if (prio != first)
+				task = find_task(self, prio);
+		}
+
+		if (task)
+			worker.num_taken++;
+		return task;
+	}
+
+	// Each level of lower priority gets a turn every FairTurn turns of the level above it
+	static size_t first_priority(unsigned turn) {
+		size_t prio = 0;
+		while (prio < NumPriorities - 1 && turn % FairTurn == FairTurn - 1) {
+			prio++;
+			turn /= FairTurn;
+		}
+		return prio;
+	}
+
+	// Own deque, then the shared queue, then steal
+	PoolTask *find_task(unsigned self, size_t prio) {
+		if (auto task = workers[self]->deques[prio].pop())
+			return *task;
+
+		if (auto task = queues[prio].pop())
+			return *task;
+
+		for (unsigned i = 1; i < workers.size(); i++) {
+			if (auto task = workers[(self + i) % workers.size()]->deques[prio].steal())
+				return *task;
+		}
+		return nullptr;
+	}
+};
+
+} // namespace MetaModule
@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace MetaModule
+{
+
+// Lock-free, fixed-capacity work-stealing deque (Chase-Lev).
+//
+// The owner thread calls push() and pop(), which work on the bottom end (LIFO).
+// Any thread can call steal(), which takes from the top end (FIFO).
+// Nothing allocates after construction.
+//
+// Memory orderings follow Lê, Pop, Cohen, Zappa Nardelli:
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013)
+//
+template<typename T, size_t Capacity>
+class WorkStealingDeque {
+	static_assert(std::has_single_bit(Capacity), "Capacity must be a power of 2");
+	static_assert(std::atomic<T>::is_always_lock_free);
+
+	static constexpr int64_t Mask = Capacity - 1;
+
+public:
+	// Owner only. Returns false if the deque is full.
+	bool push(T item) {
+		auto b = bottom.load(std::memory_order_relaxed);
+		auto t = top.load(std::memory_order_acquire);
+		if (b - t >= int64_t(Capacity))
+			return false;
+
+		buffer[b & Mask].store(item, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Owner only.
+	std::optional<T> pop() {
+		auto b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto t = top.load(std::memory_order_relaxed);
+
+		if (t > b) {
+			// Empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return std::nullopt;
+		}
+
+		T item = buffer[b & Mask].load(std::memory_order_relaxed);
+
+		if (t == b) {
+			// Last item: race against thieves for it
+			bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			if (!won)
+				return std::nullopt;
+		}
+
+		return item;
+	}
+
+	// Any thread. Returns nullopt if empty, or if another thread took the item first.
+	std::optional<T> steal() {
+		auto t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto b = bottom.load(std::memory_order_acquire);
+
+		if (t >= b)
+			return std::nullopt;
+
+		T item = buffer[t & Mask].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return std::nullopt;
+
+		return item;
+	}
+
+	bool empty() const {
+		return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+	}
+
+private:
+	alignas(64) std::atomic<int64_t> top{0};
+	alignas(64) std::atomic<int64_t> bottom{0};
+	alignas(64) std::array<std::atomic<T>, Capacity> buffer{};
+};
+
+} // namespace MetaModule
@@ -0,0 +1,140 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace MetaModule::IndexMask
+{
+
+// An index mask selects a subset of indices (jacks, params, lights...).
+// Bit i of word i/64 is set if index i is selected.
+// An empty mask selects all indices.
+//
+// Example:
+// 	std::array<uint64_t, 1> mask{0b1011}; // selects indices 0, 1, and 3
+//
+
+constexpr size_t BitsPerWord = 64;
+
+constexpr size_t num_words(size_t num_indices) {
+	return (num_indices + BitsPerWord - 1) / BitsPerWord;
+}
+
+constexpr bool is_selected(std::span<const uint64_t> mask, size_t idx) {
+	if (mask.empty())
+		return true;
+
+	auto word = idx / BitsPerWord;
+	if (word >= mask.size())
+		return false;
+
+	return (mask[word] >> (idx % BitsPerWord)) & 1;
+}
+
+constexpr void select(std::span<uint64_t> mask, size_t idx) {
+	mask[idx / BitsPerWord] |= uint64_t{1} << (idx % BitsPerWord);
+}
+
+// Calls func(idx) for every selected index that is less than `size`
+template<typename F>
+constexpr void for_each_selected(std::span<const uint64_t> mask, size_t size, F &&func) {
+	if (mask.empty()) {
+		for (size_t i = 0; i < size; i++)
+			func(i);
+		return;
+	}
+
+	for (size_t word = 0; word < mask.size(); word++) {
+		auto bits = mask[word];
+		while (bits) {
+			auto idx = word * BitsPerWord + std::countr_zero(bits);
+			if (idx >= size)
+				return;
+			func(idx);
+			bits &= bits - 1;
+		}
+	}
+}
+
+// Copies from[i] to to[i] for every selected index that is valid in both spans.
+// With an empty mask this is a plain (memcpy) copy.
+template<typename T>
+constexpr void copy_selected(std::span<const T> from, std::span<T> to, std::span<const uint64_t> mask) {
+	auto size = std::min(from.size(), to.size());
+
+	if (mask.empty())
+		std::copy_n(from.begin(), size, to.begin());
+	else
+		for_each_selected(mask, size, [&](size_t i) { to[i] = from[i]; });
+}
+
+// Fixed-size mask for N indices, stored as an array of words that can be passed
+// anywhere a mask span is expected.
+template<size_t N>
+struct Bits {
+	std::array<uint64_t, num_words(N)> words{};
+
+	constexpr bool test(size_t idx) const {
+		return (words[idx / BitsPerWord] >> (idx % BitsPerWord)) & 1;
+	}
+
+	constexpr void set(size_t idx) {
+		words[idx / BitsPerWord] |= uint64_t{1} << (idx % BitsPerWord);
+	}
+
+	constexpr void reset(size_t idx) {
+		words[idx / BitsPerWord] &= ~(uint64_t{1} << (idx % BitsPerWord));
+	}
+
+	constexpr void reset_all() {
+		words.fill(0);
+	}
+
+	constexpr void set_all() {
+		words.fill(~uint64_t{0});
+		if constexpr (N % BitsPerWord)
+			words.back() = (uint64_t{1} << (N % BitsPerWord)) - 1;
+	}
+
+	// Sets indices 0 to num-1
+	constexpr void set_first(size_t num) {
+		num = std::min(num, N);
+		for (size_t i = 0; i < num / BitsPerWord; i++)
+			words[i] = ~uint64_t{0};
+		if (num % BitsPerWord)
+			words[num / BitsPerWord] |= (uint64_t{1} << (num % BitsPerWord)) - 1;
+	}
+
+	// Sets the indices selected by mask (empty mask: all)
+	constexpr void set_selected(std::span<const uint64_t> mask) {
+		if (mask.empty()) {
+			set_all();
+			return;
+		}
+
+		auto num = std::min(mask.size(), words.size());
+		for (size_t i = 0; i < num; i++)
+			words[i] |= mask[i];
+
+		if constexpr (N % BitsPerWord) {
+			if (num == words.size())
+				words.back() &= (uint64_t{1} << (N % BitsPerWord)) - 1;
+		}
+	}
+
+	// Replaces all bits with `bits` (indices beyond bits.size()*64 are reset)
+	constexpr void assign(std::span<const uint64_t> bits) {
+		reset_all();
+		if (!bits.empty())
+			set_selected(bits);
+	}
+
+	constexpr operator std::span<const uint64_t>() const {
+		return words;
+	}
+};
+
+} // namespace MetaModule::IndexMask
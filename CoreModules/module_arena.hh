@@ -0,0 +1,167 @@
+#pragma once
+#include "CoreModules/CoreProcessor.hh"
+#include "CoreModules/register_module.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace MetaModule
+{
+
+class ModulePool;
+
+// Destroys a module created by ModuleArena or ModulePool.
+// Arena memory is reclaimed all at once by ModuleArena::reset(); pool slots are returned to the pool.
+struct PlacedModuleDeleter {
+	ModulePool *pool = nullptr;
+
+	void operator()(CoreProcessor *module) const;
+};
+
+using PlacedModulePtr = std::unique_ptr<CoreProcessor, PlacedModuleDeleter>;
+
+// ModuleArena constructs modules one after another in a caller-provided block of memory.
+// Typically a host sizes the arena for a whole patch with required_size(), so all the
+// modules of the patch end up next to each other.
+//
+// The arena does not own the memory. All modules must be destroyed before calling reset()
+// or destroying the arena.
+//
+// Example:
+// 	std::vector<ModulePlacement> placements = ...; // from register_module()
+// 	std::vector<std::byte> memory(ModuleArena::required_size(placements));
+// 	ModuleArena arena{memory};
+// 	for (auto &p : placements)
+// 		modules.push_back(arena.create(p));
+//
+class ModuleArena {
+public:
+	ModuleArena(std::span<std::byte> memory)
+		: memory{memory} {
+	}
+
+	// Returns nullptr if there is not enough room left
+	PlacedModulePtr create(ModulePlacement const &placement) {
+		if (!placement.construct_at)
+			return nullptr;
+
+		auto base = reinterpret_cast<uintptr_t>(memory.data());
+		auto start = align_up(base + used, placement.alignment) - base;
+		if (start + placement.size > memory.size())
+			return nullptr;
+
+		used = start + placement.size;
+		return PlacedModulePtr{placement.construct_at(memory.data() + start)};
+	}
+
+	// Makes all the memory available again. All modules must already be destroyed.
+	void reset() {
+		used = 0;
+	}
+
+	size_t bytes_used() const {
+		return used;
+	}
+
+	size_t capacity() const {
+		return memory.size();
+	}
+
+	// Size of memory that is enough to create all the given modules,
+	// no matter how the memory is aligned
+	static size_t required_size(std::span<const ModulePlacement> placements) {
+		size_t size = 0;
+		for (auto &p : placements)
+			size += p.size + std::max<size_t>(p.alignment, 1) - 1;
+		return size;
+	}
+
+private:
+	std::span<std::byte> memory;
+	size_t used = 0;
+
+	static constexpr uintptr_t align_up(uintptr_t x, size_t alignment) {
+		alignment = std::max<size_t>(alignment, 1);
+		return (x + alignment - 1) / alignment * alignment;
+	}
+};
+
+// ModulePool holds fixed-size slots for modules of one type, in a caller-provided
+// block of memory. Destroying a module returns its slot to the pool, so a host can
+// keep a pool per module type and reuse slots as modules are added and removed.
+//
+class ModulePool {
+public:
+	ModulePool(ModulePlacement const &placement, std::span<std::byte> memory)
+		: placement{placement} {
+		auto alignment = std::max<size_t>(placement.alignment, 1);
+		slot_size = (placement.size + alignment - 1) / alignment * alignment;
+
+		auto base = reinterpret_cast<uintptr_t>(memory.data());
+		auto offset = (alignment - base % alignment) % alignment;
+
+		if (slot_size > 0 && offset < memory.size()) {
+			first_slot = memory.data() + offset;
+			auto num_slots = (memory.size() - offset) / slot_size;
+			free_slots.reserve(num_slots);
+			// Hand out slots lowest address first
+			for (size_t i = num_slots; i > 0; i--)
+				free_slots.push_back(memory.data() + offset + (i - 1) * slot_size);
+		}
+	}
+
+	ModulePool(const ModulePool &) = delete;
+	ModulePool &operator=(const ModulePool &) = delete;
+
+	// Returns nullptr if the pool is full
+	PlacedModulePtr create() {
+		if (free_slots.empty() || !placement.construct_at)
+			return nullptr;
+
+		auto slot = free_slots.back();
+		free_slots.pop_back();
+		return PlacedModulePtr{placement.construct_at(slot), PlacedModuleDeleter{this}};
+	}
+
+	size_t num_free() const {
+		return free_slots.size();
+	}
+
+	static size_t required_size(ModulePlacement const &placement, size_t num_modules) {
+		auto alignment = std::max<size_t>(placement.alignment, 1);
+		auto slot_size = (placement.size + alignment - 1) / alignment * alignment;
+		return slot_size * num_modules + alignment - 1;
+	}
+
+private:
+	friend struct PlacedModuleDeleter;
+
+	ModulePlacement placement;
+	size_t slot_size = 0;
+	std::vector<std::byte *> free_slots;
+
+	std::byte *first_slot = nullptr;
+
+	// Called after the module's destructor.
+	// The CoreProcessor base may not be at the start of the module object (e.g. with multiple
+	// inheritance), so find the slot that contains it.
+	void release(CoreProcessor *module) {
+		auto offset = reinterpret_cast<std::byte *>(module) - first_slot;
+		free_slots.push_back(first_slot + offset / slot_size * slot_size);
+	}
+};
+
+inline void PlacedModuleDeleter::operator()(CoreProcessor *module) const {
+	if (!module)
+		return;
+
+	std::destroy_at(module);
+
+	if (pool)
+		pool->release(module);
+}
+
+} // namespace MetaModule
@@ -0,0 +1,104 @@
+#pragma once
+#include "CoreModules/CoreProcessor.hh"
+#include "CoreModules/spsc_ring.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace MetaModule
+{
+
+// A change to a module, sent from another thread (e.g. the GUI) to the audio thread.
+struct ModuleEvent {
+	enum class Type : uint8_t {
+		Param,			 // set_param(index, value)
+		InputPatched,	 // mark_input_patched(index)
+		InputUnpatched,	 // mark_input_unpatched(index)
+		OutputPatched,	 // mark_output_patched(index)
+		OutputUnpatched, // mark_output_unpatched(index)
+		Bypass,			 // bypassed = (value != 0)
+	};
+
+	Type type{};
+	uint16_t index = 0;
+
+	// Frame within the next block at which the event takes effect.
+	// 0 means at the start of the block. Offsets past the end of the block are applied before
+	// its last frame. Events are applied in the order they were sent, so offsets should not decrease.
+	uint32_t sample_offset = 0;
+
+	float value = 0;
+
+	static constexpr ModuleEvent param(uint16_t param_id, float val, uint32_t sample_offset = 0) {
+		return {Type::Param, param_id, sample_offset, val};
+	}
+
+	static constexpr ModuleEvent input_patched(uint16_t input_id, bool patched, uint32_t sample_offset = 0) {
+		return {patched ? Type::InputPatched : Type::InputUnpatched, input_id, sample_offset, 0};
+	}
+
+	static constexpr ModuleEvent output_patched(uint16_t output_id, bool patched, uint32_t sample_offset = 0) {
+		return {patched ? Type::OutputPatched : Type::OutputUnpatched, output_id, sample_offset, 0};
+	}
+
+	static constexpr ModuleEvent bypass(bool bypassed, uint32_t sample_offset = 0) {
+		return {Type::Bypass, 0, sample_offset, bypassed ? 1.f : 0.f};
+	}
+};
+
+inline void apply_event(CoreProcessor &module, ModuleEvent const &event) {
+	using enum ModuleEvent::Type;
+
+	switch (event.type) {
+		case Param:
+			module.set_param(event.index, event.value);
+			break;
+		case InputPatched:
+			module.mark_input_patched(event.index);
+			break;
+		case InputUnpatched:
+			module.mark_input_unpatched(event.index);
+			break;
+		case OutputPatched:
+			module.mark_output_patched(event.index);
+			break;
+		case OutputUnpatched:
+			module.mark_output_unpatched(event.index);
+			break;
+		case Bypass:
+			module.bypassed = event.value != 0.f;
+			break;
+	}
+}
+
+// Single-producer, single-consumer queue: one thread may call push(), and one other thread may
+// call front(), pop() and try_pop(). Both sides are wait-free and never allocate.
+template<typename T, size_t Capacity>
+using SpscQueue = SpscRing<T, Capacity>;
+
+using ModuleEventQueue = SpscQueue<ModuleEvent, 256>;
+
+// Audio thread: applies all queued events to the module.
+// Call at the start of update() or of a block. Ignores the sample offsets.
+inline void drain_events(ModuleEventQueue &queue, CoreProcessor &module) {
+	while (auto event = queue.front()) {
+		apply_event(module, *event);
+		queue.pop();
+	}
+}
+
+// Audio thread: applies the queued events that are due at or before `frame` of a block of num_frames.
+// Returns the frame of the next queued event, or num_frames if there are none left in this block.
+inline unsigned drain_events_until(ModuleEventQueue &queue, CoreProcessor &module, unsigned frame, unsigned num_frames) {
+	while (auto event = queue.front()) {
+		auto offset = std::min<uint32_t>(event->sample_offset, num_frames - 1);
+		if (offset > frame)
+			return offset;
+
+		apply_event(module, *event);
+		queue.pop();
+	}
+	return num_frames;
+}
+
+} // namespace MetaModule
@@ -0,0 +1,212 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace MetaModule
+{
+
+// 64-bit FNV-1a hash of a slug. Does not allocate, and can run at compile time.
+constexpr uint64_t slug_hash(std::string_view slug) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (char c : slug) {
+		hash ^= uint8_t(c);
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// Key for a brand:module pair, from the hashes of each slug.
+// The module part can be computed at compile time and the brand part at run time.
+constexpr uint64_t module_key(uint64_t brand_hash, uint64_t module_hash) {
+	uint64_t key = brand_hash ^ (module_hash + 0x9e3779b97f4a7c15ull + (brand_hash << 6) + (brand_hash >> 2));
+	// splitmix64 finalizer, so the low bits are well mixed for table indexing
+	key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ull;
+	key = (key ^ (key >> 27)) * 0x94d049bb133111ebull;
+	return key ^ (key >> 31);
+}
+
+constexpr uint64_t module_key(std::string_view brand_slug, std::string_view module_slug) {
+	return module_key(slug_hash(brand_slug), slug_hash(module_slug));
+}
+
+// A module slug together with its hash.
+// Converts implicitly from a string, or use ModuleSlug::of<Info>() to hash at compile time.
+struct ModuleSlug {
+	std::string_view name;
+	uint64_t hash;
+
+	constexpr ModuleSlug(std::string_view name)
+		: name{name}
+		, hash{slug_hash(name)} {
+	}
+
+	constexpr ModuleSlug(const char *name)
+		: ModuleSlug{std::string_view{name}} {
+	}
+
+	template<typename ModuleInfoT>
+	static consteval ModuleSlug of() {
+		return ModuleSlug{ModuleInfoT::slug};
+	}
+};
+
+// Maps brand:module slug pairs to a value (e.g. a module's factory and info).
+//
+// Lookups compare 64-bit keys only, never strings. The table is kept at most half full,
+// so a lookup almost always takes a single probe.
+// Registering two different slug pairs with the same 64-bit key is refused
+// (add() returns false), so a key match is always the right entry.
+//
+// When a plugin is unloaded, the host must remove its modules (e.g. with remove_brand()),
+// since the values usually point into the plugin's code.
+// Pointers returned by find() are invalidated by add() and remove().
+//
+template<typename T>
+class ModuleRegistry {
+public:
+	struct Entry {
+		uint64_t key;
+		std::string brand_slug;
+		std::string module_slug;
+		T value;
+	};
+
+	// Returns false if the brand:module pair (or its key) is already registered
+	bool add(std::string_view brand_slug, ModuleSlug module_slug, T value) {
+		auto key = module_key(slug_hash(brand_slug), module_slug.hash);
+		if (find_index(key) != NotFound)
+			return false;
+
+		if ((entries.size() + 1) * 2 > table.size())
+			rehash(std::max<size_t>(table.size() * 2, MinTableSize));
+
+		entries.push_back({key, std::string{brand_slug}, std::string{module_slug.name}, std::move(value)});
+		insert(key, entries.size() - 1);
+		return true;
+	}
+
+	T *find(uint64_t key) {
+		auto idx = find_index(key);
+		return idx == NotFound ? nullptr : &entries[idx].value;
+	}
+
+	T *find(std::string_view brand_slug, std::string_view module_slug) {
+		return find(module_key(brand_slug, module_slug));
+	}
+
+	// The module slug hash is computed at compile time
+	template<typename ModuleInfoT>
+	T *find(std::string_view brand_slug) {
+		constexpr auto module_hash = slug_hash(ModuleInfoT::slug);
+		return find(module_key(slug_hash(brand_slug), module_hash));
+	}
+
+	// Returns false if the key isn't registered
+	bool remove(uint64_t key) {
+		auto slot = find_slot(key);
+		if (slot == NotFound)
+			return false;
+
+		auto entry_idx = table[slot].entry_idx;
+		erase_slot(slot);
+
+		// Move the last entry into the removed one's place
+		auto last = uint32_t(entries.size() - 1);
+		if (entry_idx != last) {
+			table[find_slot(entries[last].key)].entry_idx = entry_idx;
+			entries[entry_idx] = std::move(entries[last]);
+		}
+		entries.pop_back();
+		return true;
+	}
+
+	bool remove(std::string_view brand_slug, std::string_view module_slug) {
+		return remove(module_key(brand_slug, module_slug));
+	}
+
+	// Removes all modules of a brand. Returns the number removed.
+	size_t remove_brand(std::string_view brand_slug) {
+		size_t num = 0;
+		// Backwards, since remove() moves the last entry into the removed one's place
+		for (size_t i = entries.size(); i > 0; i--) {
+			if (entries[i - 1].brand_slug == brand_slug) {
+				remove(entries[i - 1].key);
+				num++;
+			}
+		}
+		return num;
+	}
+
+	std::vector<Entry> const &all() const {
+		return entries;
+	}
+
+	size_t size() const {
+		return entries.size();
+	}
+
+private:
+	static constexpr uint32_t NotFound = UINT32_MAX;
+	static constexpr size_t MinTableSize = 64;
+
+	struct Slot {
+		uint64_t key = 0;
+		uint32_t entry_idx = NotFound;
+	};
+
+	std::vector<Entry> entries;
+	std::vector<Slot> table;
+
+	uint32_t find_index(uint64_t key) const {
+		auto slot = find_slot(key);
+		return slot == NotFound ? NotFound : table[slot].entry_idx;
+	}
+
+	uint32_t find_slot(uint64_t key) const {
+		if (table.empty())
+			return NotFound;
+
+		auto mask = table.size() - 1;
+		for (auto i = key & mask;; i = (i + 1) & mask) {
+			auto &slot = table[i];
+			if (slot.entry_idx == NotFound)
+				return NotFound;
+			if (slot.key == key)
+				return i;
+		}
+	}
+
+	// Linear probing without tombstones: slots after the hole that probed past it move back into it
+	void erase_slot(size_t hole) {
+		auto mask = table.size() - 1;
+		table[hole] = Slot{};
+		for (auto i = (hole + 1) & mask; table[i].entry_idx != NotFound; i = (i + 1) & mask) {
+			auto home = table[i].key & mask;
+			if (((i - home) & mask) >= ((i - hole) & mask)) {
+				table[hole] = table[i];
+				table[i] = Slot{};
+				hole = i;
+			}
+		}
+	}
+
+	void insert(uint64_t key, uint32_t entry_idx) {
+		auto mask = table.size() - 1;
+		auto i = key & mask;
+		while (table[i].entry_idx != NotFound)
+			i = (i + 1) & mask;
+		table[i] = {key, entry_idx};
+	}
+
+	void rehash(size_t new_size) {
+		table.assign(new_size, Slot{});
+		for (uint32_t i = 0; i < entries.size(); i++)
+			insert(entries[i].key, i);
+	}
+};
+
+} // namespace MetaModule
@@ -0,0 +1,133 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Conversion between RGB565 (raw value of an RGB565 color: r in bits 11-15, g in 5-10, b in 0-4)
+// and RGBA8888 (raw value of a PixelRGBA, as used by graphic display buffers).
+// The bulk conversions use SSE2 or NEON when the target supports it. All paths give identical results.
+//
+// RGB565 -> RGBA8888 replicates the high bits into the low bits (so 0x1F becomes 0xFF) and is opaque.
+// RGBA8888 -> RGB565 drops the low bits and the alpha. Converting to RGBA8888 and back is lossless.
+
+namespace MetaModule::PixelConvert
+{
+
+#if defined(__SSE2__)
+constexpr std::string_view implementation{"sse2"};
+#elif defined(__ARM_NEON)
+constexpr std::string_view implementation{"neon"};
+#else
+constexpr std::string_view implementation{"scalar"};
+#endif
+
+constexpr uint32_t to_rgba(uint16_t rgb565) {
+	uint32_t r = rgb565 >> 11;
+	uint32_t g = (rgb565 >> 5) & 0x3F;
+	uint32_t b = rgb565 & 0x1F;
+	r = (r << 3) | (r >> 2);
+	g = (g << 2) | (g >> 4);
+	b = (b << 3) | (b >> 2);
+	return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+constexpr uint16_t to_rgb565(uint32_t rgba) {
+	return ((rgba >> 8) & 0xF800) | ((rgba >> 5) & 0x07E0) | ((rgba >> 3) & 0x001F);
+}
+
+// Converts min(in.size(), out.size()) pixels. Returns the number converted.
+inline size_t to_rgba(std::span<const uint16_t> in, std::span<uint32_t> out) {
+	size_t num = std::min(in.size(), out.size());
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	auto mask_5 = _mm_set1_epi16(0x1F);
+	auto mask_6 = _mm_set1_epi16(0x3F);
+	auto alpha = _mm_set1_epi16(short(0xFF00));
+
+	for (; num - i >= 8; i += 8) {
+		auto px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&in[i]));
+		auto r = _mm_srli_epi16(px, 11);
+		auto g = _mm_and_si128(_mm_srli_epi16(px, 5), mask_6);
+		auto b = _mm_and_si128(px, mask_5);
+		r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+		g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+		b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+		// Low half of each pixel is b | g << 8, high half is r | a << 8
+		auto gb = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+		auto ar = _mm_or_si128(r, alpha);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(&out[i]), _mm_unpacklo_epi16(gb, ar));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(&out[i + 4]), _mm_unpackhi_epi16(gb, ar));
+	}
+#elif defined(__ARM_NEON)
+	auto mask_5 = vdupq_n_u16(0x1F);
+	auto mask_6 = vdupq_n_u16(0x3F);
+
+	for (; num - i >= 8; i += 8) {
+		auto px = vld1q_u16(&in[i]);
+		auto r = vshrq_n_u16(px, 11);
+		auto g = vandq_u16(vshrq_n_u16(px, 5), mask_6);
+		auto b = vandq_u16(px, mask_5);
+
+		uint8x8x4_t bgra;
+		bgra.val[0] = vmovn_u16(vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2)));
+		bgra.val[1] = vmovn_u16(vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4)));
+		bgra.val[2] = vmovn_u16(vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2)));
+		bgra.val[3] = vdup_n_u8(0xFF);
+		vst4_u8(reinterpret_cast<uint8_t *>(&out[i]), bgra);
+	}
+#endif
+
+	for (; i < num; i++)
+		out[i] = to_rgba(in[i]);
+	return num;
+}
+
+// Converts min(in.size(), out.size()) pixels. Returns the number converted.
+inline size_t to_rgb565(std::span<const uint32_t> in, std::span<uint16_t> out) {
+	size_t num = std::min(in.size(), out.size());
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	auto mask_r = _mm_set1_epi32(0xF800);
+	auto mask_g = _mm_set1_epi32(0x07E0);
+	auto mask_b = _mm_set1_epi32(0x001F);
+
+	auto convert_4 = [&](__m128i px) {
+		auto rgb = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(px, 8), mask_r),
+											 _mm_and_si128(_mm_srli_epi32(px, 5), mask_g)),
+								_mm_and_si128(_mm_srli_epi32(px, 3), mask_b));
+		// Sign-extend, so the signed saturating pack keeps all 16 bits
+		return _mm_srai_epi32(_mm_slli_epi32(rgb, 16), 16);
+	};
+
+	for (; num - i >= 8; i += 8) {
+		auto lo = convert_4(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&in[i])));
+		auto hi = convert_4(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&in[i + 4])));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(&out[i]), _mm_packs_epi32(lo, hi));
+	}
+#elif defined(__ARM_NEON)
+	for (; num - i >= 8; i += 8) {
+		auto bgra = vld4_u8(reinterpret_cast<const uint8_t *>(&in[i]));
+		auto r = vshlq_n_u16(vshrq_n_u16(vmovl_u8(bgra.val[2]), 3), 11);
+		auto g = vshlq_n_u16(vshrq_n_u16(vmovl_u8(bgra.val[1]), 2), 5);
+		auto b = vshrq_n_u16(vmovl_u8(bgra.val[0]), 3);
+		vst1q_u16(&out[i], vorrq_u16(vorrq_u16(r, g), b));
+	}
+#endif
+
+	for (; i < num; i++)
+		out[i] = to_rgb565(in[i]);
+	return num;
+}
+
+} // namespace MetaModule::PixelConvert
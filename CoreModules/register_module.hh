@@ -3,6 +3,7 @@
 #include "elements/element_info_view.hh"
 #include <functional>
 #include <memory>
+#include <new>
 
 namespace MetaModule
 {
@@ -29,6 +30,28 @@ namespace MetaModule
 //
 using CreateModuleFunc = std::function<std::unique_ptr<CoreProcessor>()>;
 
+// This is also used internally: it lets the host construct a module in memory it
+// provides (see CoreModules/module_arena.hh), instead of allocating each module on the heap.
+// The host can use `size` and `alignment` to preallocate memory for a whole patch.
+//
+struct ModulePlacement {
+	size_t size = 0;
+	size_t alignment = 0;
+
+	// Constructs the module at `mem`, which must have room for `size` bytes and be aligned to `alignment`.
+	// The module must be destroyed with std::destroy_at() (not delete)
+	CoreProcessor *(*construct_at)(void *mem) = nullptr;
+
+	template<typename ModuleT>
+	static constexpr ModulePlacement of() {
+		return {
+			.size = sizeof(ModuleT),
+			.alignment = alignof(ModuleT),
+			.construct_at = [](void *mem) -> CoreProcessor * { return ::new (mem) ModuleT(); },
+		};
+	}
+};
+
 //
 // Register a module.
 // Example:
@@ -44,6 +67,20 @@ bool register_module(std::string_view brand_slug,
 					 ModuleInfoView const &info,
 					 std::string_view faceplate_filename);
 
+// Same as above, but also provides the size and alignment of the module class, and
+// a function to construct it in place. Hosts can use this to put all modules of a patch
+// into one contiguous block of memory.
+//
+// This is opt-in: only register_module_with_placement() below calls it, so plugins that don't use
+// it still load on hosts that don't implement it.
+//
+bool register_module(std::string_view brand_slug,
+					 std::string_view module_slug,
+					 CreateModuleFunc funcCreate,
+					 ModulePlacement const &placement,
+					 ModuleInfoView const &info,
+					 std::string_view faceplate_filename);
+
 // Register a module using the brand slug, module slug, and faceplate name.
 // Pass the module class and info classes as template parameters.
 // The info class must have a `slug` member and a `png_filename` member.
@@ -89,5 +126,22 @@ bool register_module(std::string_view brand_name,
 		brand_name, module_slug, []() { return std::make_unique<ModuleT>(); }, info, faceplate_filename);
 }
 
+// Same as register_module<Module, ModuleInfo>(), but also lets the host construct the module in
+// memory it provides (see ModulePlacement). Requires a host that implements the placement form
+// of register_module() above.
+// Example:
+// bool ok = register_module_with_placement<Module, ModuleInfo>("MyBrand");
+//
+template<typename ModuleT, typename ModuleInfoT>
+bool register_module_with_placement(std::string_view brand_name) {
+	return register_module(
+		brand_name,
+		ModuleInfoT::slug,
+		[]() { return std::make_unique<ModuleT>(); },
+		ModulePlacement::of<ModuleT>(),
+		ModuleInfoView::makeView<ModuleInfoT>(),
+		ModuleInfoT::png_filename);
+}
+
 } // namespace MetaModule
 
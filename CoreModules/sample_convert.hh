@@ -0,0 +1,211 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Conversion of packed audio file samples (int16, int24, float32, little or big endian) to float.
+// Integers are scaled to [-1, 1): full scale negative is -1.0.
+// The bulk conversions use SSE2 or NEON when the target supports it. All paths give identical results.
+
+namespace MetaModule::SampleConvert
+{
+
+#if defined(__SSE2__)
+constexpr std::string_view implementation{"sse2"};
+#elif defined(__ARM_NEON)
+constexpr std::string_view implementation{"neon"};
+#else
+constexpr std::string_view implementation{"scalar"};
+#endif
+
+enum class SampleFormat : uint8_t { Int16, Int24, Float32 };
+enum class ByteOrder : uint8_t { Little, Big };
+
+constexpr size_t bytes_per_sample(SampleFormat format) {
+	switch (format) {
+		case SampleFormat::Int16:
+			return 2;
+		case SampleFormat::Int24:
+			return 3;
+		case SampleFormat::Float32:
+			return 4;
+	}
+	return 0;
+}
+
+// Single samples. Integers are placed in the top bits of an int32, which converts to float exactly.
+inline float int16_to_float(const std::byte *in, ByteOrder order) {
+	auto b0 = uint32_t(in[0]);
+	auto b1 = uint32_t(in[1]);
+	auto word = order == ByteOrder::Little ? (b0 << 16 | b1 << 24) : (b1 << 16 | b0 << 24);
+	return float(int32_t(word)) * 0x1p-31f;
+}
+
+inline float int24_to_float(const std::byte *in, ByteOrder order) {
+	auto b0 = uint32_t(in[0]);
+	auto b1 = uint32_t(in[1]);
+	auto b2 = uint32_t(in[2]);
+	auto word = order == ByteOrder::Little ? (b0 << 8 | b1 << 16 | b2 << 24) : (b2 << 8 | b1 << 16 | b0 << 24);
+	return float(int32_t(word)) * 0x1p-31f;
+}
+
+inline float float32_to_float(const std::byte *in, ByteOrder order) {
+	uint32_t word;
+	std::memcpy(&word, in, 4);
+	if ((order == ByteOrder::Big) == (std::endian::native == std::endian::little))
+		word = __builtin_bswap32(word);
+	return std::bit_cast<float>(word);
+}
+
+// Bulk conversions. Convert min(in.size() / bytes per sample, out.size()) samples, and return the number converted.
+
+inline size_t int16_to_float(std::span<const std::byte> in, std::span<float> out, ByteOrder order = ByteOrder::Little) {
+	size_t num = std::min(in.size() / 2, out.size());
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	auto src = reinterpret_cast<const uint8_t *>(in.data());
+	auto zero = _mm_setzero_si128();
+	auto scale = _mm_set1_ps(0x1p-31f);
+
+	for (; num - i >= 8; i += 8) {
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+		if (order == ByteOrder::Big)
+			v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+
+		// Each sample into the top half of an int32
+		auto lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(zero, v));
+		auto hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(zero, v));
+		_mm_storeu_ps(&out[i], _mm_mul_ps(lo, scale));
+		_mm_storeu_ps(&out[i + 4], _mm_mul_ps(hi, scale));
+	}
+#elif defined(__ARM_NEON)
+	auto src = reinterpret_cast<const uint8_t *>(in.data());
+	for (; num - i >= 8; i += 8) {
+		auto bytes = vld1q_u8(src + i * 2);
+		if (order == ByteOrder::Big)
+			bytes = vrev16q_u8(bytes);
+
+		auto v = vreinterpretq_s16_u8(bytes);
+		auto lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+		auto hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+		vst1q_f32(&out[i], vmulq_n_f32(lo, 0x1p-15f));
+		vst1q_f32(&out[i + 4], vmulq_n_f32(hi, 0x1p-15f));
+	}
+#endif
+
+	for (; i < num; i++)
+		out[i] = int16_to_float(&in[i * 2], order);
+	return num;
+}
+
+inline size_t int24_to_float(std::span<const std::byte> in, std::span<float> out, ByteOrder order = ByteOrder::Little) {
+	size_t num = std::min(in.size() / 3, out.size());
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	auto src = reinterpret_cast<const uint8_t *>(in.data());
+	auto scale = _mm_set1_ps(0x1p-31f);
+	auto load32 = [src](size_t sample) {
+		uint32_t word;
+		std::memcpy(&word, src + sample * 3, 4);
+		return int(word);
+	};
+
+	// Loads 4 bytes per sample, so the last sample of a group of 4 reads one byte past it
+	for (; num - i >= 5; i += 4) {
+		auto v = _mm_set_epi32(load32(i + 3), load32(i + 2), load32(i + 1), load32(i));
+		if (order == ByteOrder::Little)
+			v = _mm_slli_epi32(v, 8);
+		else {
+			// Byte-reverse each word, then drop the next sample's byte
+			v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+			v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+			v = _mm_and_si128(v, _mm_set1_epi32(int(0xFFFFFF00)));
+		}
+		_mm_storeu_ps(&out[i], _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+#elif defined(__ARM_NEON)
+	auto src = reinterpret_cast<const uint8_t *>(in.data());
+	for (; num - i >= 16; i += 16) {
+		// De-interleaves the three bytes of 16 samples
+		auto bytes = vld3q_u8(src + i * 3);
+		auto low = bytes.val[order == ByteOrder::Little ? 0 : 2];
+		auto mid = bytes.val[1];
+		auto high = bytes.val[order == ByteOrder::Little ? 2 : 0];
+
+		for (unsigned half = 0; half < 2; half++) {
+			auto l = vmovl_u8(half ? vget_high_u8(low) : vget_low_u8(low));
+			auto m = vmovl_u8(half ? vget_high_u8(mid) : vget_low_u8(mid));
+			auto h = vmovl_u8(half ? vget_high_u8(high) : vget_low_u8(high));
+			auto lm = vorrq_u16(l, vshlq_n_u16(m, 8));
+
+			for (unsigned quarter = 0; quarter < 2; quarter++) {
+				auto lm32 = vmovl_u16(quarter ? vget_high_u16(lm) : vget_low_u16(lm));
+				auto h32 = vmovl_u16(quarter ? vget_high_u16(h) : vget_low_u16(h));
+				auto word = vorrq_u32(vshlq_n_u32(h32, 24), vshlq_n_u32(lm32, 8));
+				auto f = vcvtq_f32_s32(vreinterpretq_s32_u32(word));
+				vst1q_f32(&out[i + half * 8 + quarter * 4], vmulq_n_f32(f, 0x1p-31f));
+			}
+		}
+	}
+#endif
+
+	for (; i < num; i++)
+		out[i] = int24_to_float(&in[i * 3], order);
+	return num;
+}
+
+inline size_t float32_to_float(std::span<const std::byte> in, std::span<float> out, ByteOrder order = ByteOrder::Little) {
+	size_t num = std::min(in.size() / 4, out.size());
+
+	if ((order == ByteOrder::Little) == (std::endian::native == std::endian::little)) {
+		if (num)
+			std::memcpy(out.data(), in.data(), num * 4);
+		return num;
+	}
+
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	auto src = reinterpret_cast<const uint8_t *>(in.data());
+	for (; num - i >= 4; i += 4) {
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(&out[i]), v);
+	}
+#elif defined(__ARM_NEON)
+	auto src = reinterpret_cast<const uint8_t *>(in.data());
+	for (; num - i >= 4; i += 4)
+		vst1q_u8(reinterpret_cast<uint8_t *>(&out[i]), vrev32q_u8(vld1q_u8(src + i * 4)));
+#endif
+
+	for (; i < num; i++)
+		out[i] = float32_to_float(&in[i * 4], order);
+	return num;
+}
+
+inline size_t to_float(SampleFormat format, ByteOrder order, std::span<const std::byte> in, std::span<float> out) {
+	switch (format) {
+		case SampleFormat::Int16:
+			return int16_to_float(in, out, order);
+		case SampleFormat::Int24:
+			return int24_to_float(in, out, order);
+		case SampleFormat::Float32:
+			return float32_to_float(in, out, order);
+	}
+	return 0;
+}
+
+} // namespace MetaModule::SampleConvert
@@ -0,0 +1,169 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <optional>
+#include <span>
+
+namespace MetaModule
+{
+
+// Bounded single-producer, single-consumer ring buffer, e.g. for streaming samples between a
+// module's AsyncThread and update(). Both sides are wait-free and never allocate.
+//
+// One thread may call the producer functions, and one other thread the consumer functions.
+// Items can be passed one at a time, in bulk (copying a span), or without copying: the producer
+// fills write_region() in place and calls commit_write(), and the consumer reads read_region()
+// in place and calls commit_read(). Regions are contiguous, so they end at the end of the
+// ring's storage: after committing a region that ends there, the next one starts at the beginning.
+template<typename T, size_t Capacity>
+class SpscRing {
+	static_assert(std::has_single_bit(Capacity), "Capacity must be a power of 2");
+
+public:
+	// Producer. Returns false if the ring is full.
+	bool push(T const &item) {
+		auto head = head_idx.load(std::memory_order_relaxed);
+		if (head - cached_tail == Capacity) {
+			cached_tail = tail_idx.load(std::memory_order_acquire);
+			if (head - cached_tail == Capacity)
+				return false;
+		}
+
+		items[head & (Capacity - 1)] = item;
+		head_idx.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Producer. Pushes as many items as fit, and returns how many that was.
+	size_t push(std::span<const T> src) {
+		size_t count = 0;
+		while (count < src.size()) {
+			auto region = write_region();
+			if (region.empty())
+				break;
+
+			auto num = std::min(region.size(), src.size() - count);
+			std::copy_n(src.begin() + count, num, region.begin());
+			commit_write(num);
+			count += num;
+		}
+		return count;
+	}
+
+	// Producer: the free space that can be written in one piece (possibly empty)
+	std::span<T> write_region() {
+		auto head = head_idx.load(std::memory_order_relaxed);
+		auto start = head & (Capacity - 1);
+		auto to_end = Capacity - start;
+
+		// Only look at the consumer's index if our last view of it limits the region
+		if (Capacity - (head - cached_tail) < to_end)
+			cached_tail = tail_idx.load(std::memory_order_acquire);
+
+		return {items.data() + start, std::min(Capacity - (head - cached_tail), to_end)};
+	}
+
+	// Producer: makes the first count items of write_region() available to the consumer
+	void commit_write(size_t count) {
+		head_idx.store(head_idx.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	// Producer: how many items can be pushed
+	size_t write_available() {
+		cached_tail = tail_idx.load(std::memory_order_acquire);
+		return Capacity - (head_idx.load(std::memory_order_relaxed) - cached_tail);
+	}
+
+	// Consumer. Returns nullptr if the ring is empty.
+	T *front() {
+		auto tail = tail_idx.load(std::memory_order_relaxed);
+		if (tail == cached_head) {
+			cached_head = head_idx.load(std::memory_order_acquire);
+			if (tail == cached_head)
+				return nullptr;
+		}
+		return &items[tail & (Capacity - 1)];
+	}
+
+	// Consumer. Only call after front() returned an item.
+	void pop() {
+		commit_read(1);
+	}
+
+	// Consumer
+	std::optional<T> try_pop() {
+		auto item = front();
+		if (!item)
+			return std::nullopt;
+
+		T val = *item;
+		pop();
+		return val;
+	}
+
+	// Consumer. Pops up to dst.size() items into dst, and returns how many that was.
+	size_t pop(std::span<T> dst) {
+		size_t count = 0;
+		while (count < dst.size()) {
+			auto region = read_region();
+			if (region.empty())
+				break;
+
+			auto num = std::min(region.size(), dst.size() - count);
+			std::copy_n(region.begin(), num, dst.begin() + count);
+			commit_read(num);
+			count += num;
+		}
+		return count;
+	}
+
+	// Consumer: the items that can be read in one piece (possibly empty)
+	std::span<T> read_region() {
+		auto tail = tail_idx.load(std::memory_order_relaxed);
+		auto start = tail & (Capacity - 1);
+		auto to_end = Capacity - start;
+
+		if (cached_head - tail < to_end)
+			cached_head = head_idx.load(std::memory_order_acquire);
+
+		return {items.data() + start, std::min(cached_head - tail, to_end)};
+	}
+
+	// Consumer: frees the first count items of read_region() for the producer
+	void commit_read(size_t count) {
+		tail_idx.store(tail_idx.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	// Consumer: how many items can be popped
+	size_t read_available() {
+		cached_head = head_idx.load(std::memory_order_acquire);
+		return cached_head - tail_idx.load(std::memory_order_relaxed);
+	}
+
+	// Either thread. Only approximate while the other thread is using the ring.
+	bool empty() const {
+		return head_idx.load(std::memory_order_acquire) == tail_idx.load(std::memory_order_acquire);
+	}
+
+	static constexpr size_t capacity() {
+		return Capacity;
+	}
+
+private:
+	static constexpr size_t CacheLineSize = 64;
+
+	// Producer's cache line
+	alignas(CacheLineSize) std::atomic<size_t> head_idx{0};
+	size_t cached_tail = 0;
+
+	// Consumer's cache line
+	alignas(CacheLineSize) std::atomic<size_t> tail_idx{0};
+	size_t cached_head = 0;
+
+	alignas(CacheLineSize) std::array<T, Capacity> items{};
+};
+
+} // namespace MetaModule
@@ -0,0 +1,71 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace MetaModule
+{
+
+// Lock-free triple buffer, for passing whole values (e.g. frames) from one thread to another.
+// Neither side ever waits: the writer always has a buffer to fill, and the reader always has the
+// newest complete value. Values the reader doesn't get to in time are skipped.
+//
+// The writer fills back() and then calls publish(). The reader calls acquire(), then reads front(),
+// which stays unchanged until the reader's next acquire().
+template<typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() = default;
+
+	explicit TripleBuffer(T const &initial)
+		: buffers{initial, initial, initial} {
+	}
+
+	// Writer
+	T &back() {
+		return buffers[back_idx];
+	}
+
+	// Writer: makes back() the newest value, and gives the writer a different buffer.
+	// The new back() holds an older value (not necessarily the one published before this).
+	void publish() {
+		auto prev = state.exchange(back_idx | FreshBit, std::memory_order_acq_rel);
+		back_idx = prev & IndexMask;
+	}
+
+	// Reader: returns true if a value was published since the last acquire(), and makes it front().
+	bool acquire() {
+		if (!(state.load(std::memory_order_relaxed) & FreshBit))
+			return false;
+
+		auto prev = state.exchange(front_idx, std::memory_order_acq_rel);
+		front_idx = prev & IndexMask;
+		return true;
+	}
+
+	// Reader
+	T const &front() const {
+		return buffers[front_idx];
+	}
+
+	// All three buffers, e.g. to allocate them.
+	// Only while neither the reader nor the writer is using the buffer.
+	std::array<T, 3> &all() {
+		return buffers;
+	}
+
+private:
+	static constexpr uint8_t IndexMask = 0b011;
+	static constexpr uint8_t FreshBit = 0b100;
+	static constexpr size_t CacheLineSize = 64;
+
+	std::array<T, 3> buffers{};
+
+	// Index of the middle buffer (between writer and reader), and whether it's newer than front()
+	alignas(CacheLineSize) std::atomic<uint8_t> state{1};
+
+	alignas(CacheLineSize) uint8_t back_idx = 0;
+	alignas(CacheLineSize) uint8_t front_idx = 2;
+};
+
+} // namespace MetaModule
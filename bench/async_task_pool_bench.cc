@@ -0,0 +1,157 @@
+#include "CoreModules/engine/task_pool.hh"
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace MetaModule;
+
+// A shared TaskPool vs. one thread per async task (the model where each AsyncThread owns a thread).
+// Wakeup: round-trip latency of waking one idle task and waiting for it to finish.
+// Burst: all tasks are woken at once and each does a few microseconds of work, as when many
+// modules' AsyncThreads have work at the same time.
+
+namespace
+{
+
+// Stand-in for the work an async task does
+void do_work(unsigned iterations) {
+	volatile unsigned x = 0;
+	for (unsigned i = 0; i < iterations; i++)
+		x = x + i;
+}
+
+class DedicatedThread {
+public:
+	explicit DedicatedThread(unsigned work)
+		: work{work} {
+		thread = std::thread([this] { loop(); });
+	}
+
+	~DedicatedThread() {
+		running.store(false);
+		requests.fetch_add(1);
+		requests.notify_one();
+		thread.join();
+	}
+
+	void trigger() {
+		requests.fetch_add(1, std::memory_order_release);
+		requests.notify_one();
+	}
+
+	std::atomic<uint32_t> completed{0};
+
+private:
+	unsigned work;
+	std::atomic<uint32_t> requests{0};
+	std::atomic<bool> running{true};
+	std::thread thread;
+
+	void loop() {
+		uint32_t seen = 0;
+		while (true) {
+			requests.wait(seen, std::memory_order_acquire);
+			seen = requests.load(std::memory_order_acquire);
+			if (!running.load())
+				return;
+			do_work(work);
+			completed.fetch_add(1, std::memory_order_release);
+		}
+	}
+};
+
+struct CountingTask : PoolTask {
+	unsigned work;
+	std::atomic<uint32_t> &completed;
+
+	CountingTask(unsigned work, std::atomic<uint32_t> &completed)
+		: work{work}
+		, completed{completed} {
+	}
+
+	void run() override {
+		do_work(work);
+		completed.fetch_add(1, std::memory_order_release);
+	}
+};
+
+void wait_until(std::atomic<uint32_t> &count, uint32_t target) {
+	while (count.load(std::memory_order_acquire) < target)
+		std::this_thread::yield();
+}
+
+constexpr unsigned BurstWork = 2000;
+
+// Arg: number of async tasks
+void BM_Wakeup_PerThread(benchmark::State &state) {
+	std::vector<std::unique_ptr<DedicatedThread>> threads;
+	for (int i = 0; i < state.range(0); i++)
+		threads.push_back(std::make_unique<DedicatedThread>(0));
+
+	size_t next = 0;
+	for (auto _ : state) {
+		auto &thread = *threads[next++ % threads.size()];
+		auto target = thread.completed.load() + 1;
+		thread.trigger();
+		wait_until(thread.completed, target);
+	}
+}
+BENCHMARK(BM_Wakeup_PerThread)->Arg(1)->Arg(40)->UseRealTime();
+
+void BM_Wakeup_TaskPool(benchmark::State &state) {
+	TaskPool pool;
+	std::atomic<uint32_t> completed{0};
+	std::vector<std::unique_ptr<CountingTask>> tasks;
+	for (int i = 0; i < state.range(0); i++)
+		tasks.push_back(std::make_unique<CountingTask>(0, completed));
+
+	size_t next = 0;
+	for (auto _ : state) {
+		auto target = completed.load() + 1;
+		pool.submit(tasks[next++ % tasks.size()].get());
+		wait_until(completed, target);
+	}
+	state.counters["threads"] = pool.num_threads();
+}
+BENCHMARK(BM_Wakeup_TaskPool)->Arg(1)->Arg(40)->UseRealTime();
+
+void BM_Burst_PerThread(benchmark::State &state) {
+	std::vector<std::unique_ptr<DedicatedThread>> threads;
+	for (int i = 0; i < state.range(0); i++)
+		threads.push_back(std::make_unique<DedicatedThread>(BurstWork));
+
+	std::vector<uint32_t> targets(threads.size());
+	for (auto _ : state) {
+		for (size_t i = 0; i < threads.size(); i++) {
+			targets[i] = threads[i]->completed.load() + 1;
+			threads[i]->trigger();
+		}
+		for (size_t i = 0; i < threads.size(); i++)
+			wait_until(threads[i]->completed, targets[i]);
+	}
+	state.SetItemsProcessed(state.iterations() * threads.size());
+}
+BENCHMARK(BM_Burst_PerThread)->Arg(8)->Arg(40)->UseRealTime();
+
+void BM_Burst_TaskPool(benchmark::State &state) {
+	TaskPool pool;
+	std::atomic<uint32_t> completed{0};
+	std::vector<std::unique_ptr<CountingTask>> tasks;
+	for (int i = 0; i < state.range(0); i++)
+		tasks.push_back(std::make_unique<CountingTask>(BurstWork, completed));
+
+	for (auto _ : state) {
+		auto target = completed.load() + uint32_t(tasks.size());
+		for (auto &task : tasks)
+			pool.submit(task.get());
+		wait_until(completed, target);
+	}
+	state.SetItemsProcessed(state.iterations() * tasks.size());
+	state.counters["threads"] = pool.num_threads();
+}
+BENCHMARK(BM_Burst_TaskPool)->Arg(8)->Arg(40)->UseRealTime();
+
+} // namespace
@@ -0,0 +1,52 @@
+#include "CoreModules/base64.hh"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+using namespace MetaModule;
+
+namespace
+{
+
+std::vector<uint8_t> make_data(size_t size) {
+	std::vector<uint8_t> data(size);
+	uint32_t x = 1;
+	for (auto &c : data) {
+		x = x * 1664525 + 1013904223;
+		c = uint8_t(x >> 24);
+	}
+	return data;
+}
+
+// Arg: number of bytes to encode
+void BM_Base64Encode(benchmark::State &state) {
+	auto data = make_data(state.range(0));
+	std::string encoded(Base64::encoded_size(data.size()), '\0');
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(Base64::encode(data, encoded));
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(state.iterations() * data.size());
+	state.SetLabel(std::string{Base64::implementation});
+}
+BENCHMARK(BM_Base64Encode)->RangeMultiplier(16)->Range(64, 1 << 20);
+
+// Arg: number of decoded bytes
+void BM_Base64Decode(benchmark::State &state) {
+	auto data = make_data(state.range(0));
+	std::string encoded(Base64::encoded_size(data.size()), '\0');
+	Base64::encode(data, encoded);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(Base64::decode(encoded, data));
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(state.iterations() * data.size());
+	state.SetLabel(std::string{Base64::implementation});
+}
+BENCHMARK(BM_Base64Decode)->RangeMultiplier(16)->Range(64, 1 << 20);
+
+} // namespace
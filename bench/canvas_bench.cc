@@ -0,0 +1,238 @@
+#include "CoreModules/canvas.hh"
+#include "CoreModules/pixel_convert.hh"
+#include "CoreModules/pixels.hh"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+using namespace MetaModule;
+
+// Canvas primitives vs. the per-pixel PixelRGBA loops modules write by hand,
+// on a full-screen 320x240 buffer.
+
+namespace
+{
+
+constexpr unsigned Width = 320;
+constexpr unsigned Height = 240;
+
+std::vector<uint32_t> make_image(uint32_t seed) {
+	std::vector<uint32_t> pixels(Width * Height);
+	for (auto &px : pixels) {
+		seed = seed * 1664525 + 1013904223;
+		px = seed;
+	}
+	return pixels;
+}
+
+// Typical hand-written blend: one pixel at a time, in float
+PixelRGBA naive_blend(PixelRGBA dst, PixelRGBA src) {
+	float a = src.a / 255.f;
+	return PixelRGBA(src.r * a + dst.r * (1.f - a),
+					 src.g * a + dst.g * (1.f - a),
+					 src.b * a + dst.b * (1.f - a),
+					 255.f * a + dst.a * (1.f - a));
+}
+
+void set_label(benchmark::State &state) {
+	state.SetItemsProcessed(state.iterations() * Width * Height);
+	state.SetLabel(std::string{CanvasOps::implementation});
+}
+
+void BM_FillRect_PixelRGBA(benchmark::State &state) {
+	auto pixels = make_image(1);
+	uint8_t shade = 0;
+	for (auto _ : state) {
+		for (unsigned y = 0; y < Height; y++)
+			for (unsigned x = 0; x < Width; x++)
+				pixels[y * Width + x] = PixelRGBA(int(shade), 0x40, 0x80).raw();
+		shade++;
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_FillRect_PixelRGBA);
+
+void BM_FillRect_Canvas(benchmark::State &state) {
+	auto pixels = make_image(1);
+	Canvas canvas{pixels, Width};
+	uint8_t shade = 0;
+	for (auto _ : state) {
+		canvas.fill_rect(0, 0, Width, Height, PixelRGBA(int(shade++), 0x40, 0x80).raw());
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_FillRect_Canvas);
+
+void BM_BlendRect_PixelRGBA(benchmark::State &state) {
+	auto pixels = make_image(1);
+	PixelRGBA color{0x20, 0x40, 0x80, 0x60};
+	for (auto _ : state) {
+		for (auto &px : pixels)
+			px = naive_blend(PixelRGBA{px}, color).raw();
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_BlendRect_PixelRGBA);
+
+void BM_BlendRect_Canvas(benchmark::State &state) {
+	auto pixels = make_image(1);
+	Canvas canvas{pixels, Width};
+	for (auto _ : state) {
+		canvas.blend_rect(0, 0, Width, Height, PixelRGBA{0x20, 0x40, 0x80, 0x60}.raw());
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_BlendRect_Canvas);
+
+void BM_BlitBlend_PixelRGBA(benchmark::State &state) {
+	auto pixels = make_image(1);
+	auto image = make_image(2);
+	for (auto _ : state) {
+		for (size_t i = 0; i < pixels.size(); i++)
+			pixels[i] = naive_blend(PixelRGBA{pixels[i]}, PixelRGBA{image[i]}).raw();
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_BlitBlend_PixelRGBA);
+
+void BM_BlitBlend_Canvas(benchmark::State &state) {
+	auto pixels = make_image(1);
+	auto image = make_image(2);
+	Canvas canvas{pixels, Width};
+	for (auto _ : state) {
+		canvas.blit_blend(image, Width, 0, 0);
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_BlitBlend_Canvas);
+
+void BM_Gradient_PixelRGBA(benchmark::State &state) {
+	auto pixels = make_image(1);
+	for (auto _ : state) {
+		for (unsigned y = 0; y < Height; y++) {
+			for (unsigned x = 0; x < Width; x++) {
+				float pos = float(x) / (Width - 1);
+				pixels[y * Width + x] = PixelRGBA(pos, 0.25f, 1.f - pos).raw();
+			}
+		}
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_Gradient_PixelRGBA);
+
+void BM_Gradient_Canvas(benchmark::State &state) {
+	auto pixels = make_image(1);
+	Canvas canvas{pixels, Width};
+	for (auto _ : state) {
+		canvas.fill_gradient(0, 0, Width, Height, 0xFF0040FF, 0xFFFF4000, Canvas::Gradient::Horizontal);
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_Gradient_Canvas);
+
+void BM_Lines_Canvas(benchmark::State &state) {
+	auto pixels = make_image(1);
+	Canvas canvas{pixels, Width};
+	for (auto _ : state) {
+		for (unsigned i = 0; i < 64; i++)
+			canvas.line(0, i * 3, Width - 1, Height - 1 - i * 3, 0xFFFFFFFF);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK(BM_Lines_Canvas);
+
+void BM_LinesAA_Canvas(benchmark::State &state) {
+	auto pixels = make_image(1);
+	Canvas canvas{pixels, Width};
+	for (auto _ : state) {
+		for (unsigned i = 0; i < 64; i++)
+			canvas.line_aa(0.f, i * 3.f, Width - 1.f, Height - 1.f - i * 3.f, 0xFFFFFFFF);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK(BM_LinesAA_Canvas);
+
+// Typical hand-written conversion, one pixel at a time through PixelRGBA
+void BM_Rgb565ToRgba_PixelRGBA(benchmark::State &state) {
+	std::vector<uint16_t> in(Width * Height);
+	for (size_t i = 0; i < in.size(); i++)
+		in[i] = uint16_t(i * 2654435761u);
+	std::vector<uint32_t> out(in.size());
+
+	for (auto _ : state) {
+		for (size_t i = 0; i < in.size(); i++) {
+			auto c = in[i];
+			out[i] = PixelRGBA((c >> 11) * 255 / 31, ((c >> 5) & 0x3F) * 255 / 63, (c & 0x1F) * 255 / 31).raw();
+		}
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_Rgb565ToRgba_PixelRGBA);
+
+void BM_Rgb565ToRgba(benchmark::State &state) {
+	std::vector<uint16_t> in(Width * Height);
+	for (size_t i = 0; i < in.size(); i++)
+		in[i] = uint16_t(i * 2654435761u);
+	std::vector<uint32_t> out(in.size());
+
+	for (auto _ : state) {
+		PixelConvert::to_rgba(in, out);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * in.size());
+	state.SetLabel(std::string{PixelConvert::implementation});
+}
+BENCHMARK(BM_Rgb565ToRgba);
+
+void BM_RgbaToRgb565_PixelRGBA(benchmark::State &state) {
+	auto in = make_image(1);
+	std::vector<uint16_t> out(in.size());
+
+	for (auto _ : state) {
+		for (size_t i = 0; i < in.size(); i++) {
+			PixelRGBA px{in[i]};
+			out[i] = uint16_t(((px.r >> 3) << 11) | ((px.g >> 2) << 5) | (px.b >> 3));
+		}
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_RgbaToRgb565_PixelRGBA);
+
+void BM_RgbaToRgb565(benchmark::State &state) {
+	auto in = make_image(1);
+	std::vector<uint16_t> out(in.size());
+
+	for (auto _ : state) {
+		PixelConvert::to_rgb565(in, out);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * in.size());
+	state.SetLabel(std::string{PixelConvert::implementation});
+}
+BENCHMARK(BM_RgbaToRgb565);
+
+void BM_FillRect_Canvas565(benchmark::State &state) {
+	std::vector<uint16_t> pixels(Width * Height);
+	Canvas565 canvas{pixels, Width};
+	uint16_t shade = 0;
+	for (auto _ : state) {
+		canvas.fill_rect(0, 0, Width, Height, shade++);
+		benchmark::ClobberMemory();
+	}
+	set_label(state);
+}
+BENCHMARK(BM_FillRect_Canvas565);
+
+} // namespace
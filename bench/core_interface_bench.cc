@@ -0,0 +1,387 @@
+#include "CoreModules/SmartCoreProcessor.hh"
+#include "CoreModules/elements/element_info.hh"
+#include "CoreModules/elements/element_info_view.hh"
+#include <benchmark/benchmark.h>
+#include <charconv>
+#include <string>
+#include <vector>
+
+using namespace MetaModule;
+
+namespace
+{
+
+// Synthetic modules with N elements, cycling through Knob, JackInput, JackOutput, MonoLight.
+// So element 0 is a knob, 1 is an input, 2 is an output, 3 is a light.
+template<size_t N>
+consteval std::array<Element, N> make_elements() {
+	std::array<Element, N> elements{};
+	for (size_t i = 0; i < N; i++) {
+		auto set_pos = [i](auto el) {
+			el.x_mm = float(i);
+			return el;
+		};
+
+		switch (i % 4) {
+			case 0:
+				elements[i] = set_pos(Knob{});
+				break;
+			case 1:
+				elements[i] = set_pos(JackInput{});
+				break;
+			case 2:
+				elements[i] = set_pos(JackOutput{});
+				break;
+			case 3:
+				elements[i] = set_pos(MonoLight{});
+				break;
+		}
+	}
+	return elements;
+}
+
+template<size_t N>
+struct SyntheticInfo : ModuleInfoBase {
+	static constexpr std::string_view slug{"Synthetic"};
+	static constexpr std::array<Element, N> Elements = make_elements<N>();
+
+	enum class Elem : unsigned {};
+};
+
+template<size_t N>
+struct SyntheticModule : SmartCoreProcessor<SyntheticInfo<N>, WithParamSmoothing | WithBinaryState> {
+	using Info = SyntheticInfo<N>;
+	using Elem = typename Info::Elem;
+	static constexpr auto Knob0 = Elem(0);
+	static constexpr auto In0 = Elem(1);
+	static constexpr auto Out0 = Elem(2);
+	static constexpr auto Light0 = Elem(3);
+
+	static constexpr auto counts = ElementCount::count<Info>();
+
+	void update() override {
+	}
+	void set_samplerate(float sr) override {
+	}
+
+	// Text state: comma-separated param values
+	std::string save_state() override {
+		std::string state;
+		state.reserve(counts.num_params * 12);
+		char buf[32];
+		for (size_t i = 0; i < counts.num_params; i++) {
+			auto res = std::to_chars(buf, buf + sizeof buf, this->get_param(i));
+			state.append(buf, res.ptr);
+			state.push_back(',');
+		}
+		return state;
+	}
+
+	void load_state(std::string_view state) override {
+		auto ptr = state.data();
+		auto end = state.data() + state.size();
+		for (size_t i = 0; i < counts.num_params && ptr < end; i++) {
+			float val{};
+			auto res = std::from_chars(ptr, end, val);
+			this->set_param(i, val);
+			ptr = res.ptr + 1;
+		}
+	}
+
+	// Public access to the protected accessors
+	auto input() {
+		return this->template getInput<In0>();
+	}
+	void output(float val) {
+		this->template setOutput<Out0>(val);
+	}
+	auto state() {
+		return this->template getState<Knob0>();
+	}
+	void led(float val) {
+		this->template setLED<Light0>(val);
+	}
+	void smooth(unsigned num_frames) {
+		this->smoothParams(num_frames);
+	}
+};
+
+//
+// SmartCoreProcessor accessors
+//
+
+template<size_t N>
+void BM_GetInput(benchmark::State &state) {
+	SyntheticModule<N> module;
+	module.set_input(0, 1.f);
+	for (auto _ : state)
+		benchmark::DoNotOptimize(module.input());
+}
+BENCHMARK_TEMPLATE(BM_GetInput, 10);
+BENCHMARK_TEMPLATE(BM_GetInput, 100);
+BENCHMARK_TEMPLATE(BM_GetInput, 1000);
+
+template<size_t N>
+void BM_SetOutput(benchmark::State &state) {
+	SyntheticModule<N> module;
+	float val = 0;
+	for (auto _ : state) {
+		module.output(val);
+		val += 1.f;
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(BM_SetOutput, 10);
+BENCHMARK_TEMPLATE(BM_SetOutput, 100);
+BENCHMARK_TEMPLATE(BM_SetOutput, 1000);
+
+template<size_t N>
+void BM_GetState(benchmark::State &state) {
+	SyntheticModule<N> module;
+	module.set_param(0, 0.25f);
+	for (auto _ : state)
+		benchmark::DoNotOptimize(module.state());
+}
+BENCHMARK_TEMPLATE(BM_GetState, 10);
+BENCHMARK_TEMPLATE(BM_GetState, 100);
+BENCHMARK_TEMPLATE(BM_GetState, 1000);
+
+template<size_t N>
+void BM_SetLED(benchmark::State &state) {
+	SyntheticModule<N> module;
+	float val = 0;
+	for (auto _ : state) {
+		module.led(val);
+		val += 1.f;
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(BM_SetLED, 10);
+BENCHMARK_TEMPLATE(BM_SetLED, 100);
+BENCHMARK_TEMPLATE(BM_SetLED, 1000);
+
+// Smooths every knob (a quarter of the elements), once per 64-frame block
+template<size_t N>
+void BM_SmoothParams(benchmark::State &state) {
+	SyntheticModule<N> module;
+	constexpr auto num_params = SyntheticModule<N>::counts.num_params;
+	for (unsigned i = 0; i < num_params; i++)
+		module.set_param(i, 1.f);
+
+	for (auto _ : state) {
+		module.smooth(64);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * num_params);
+}
+BENCHMARK_TEMPLATE(BM_SmoothParams, 10);
+BENCHMARK_TEMPLATE(BM_SmoothParams, 100);
+BENCHMARK_TEMPLATE(BM_SmoothParams, 1000);
+
+//
+// Virtual jack I/O: every jack, one call per jack vs. one bulk call
+//
+
+template<size_t N>
+void BM_VirtualSetInput(benchmark::State &state) {
+	SyntheticModule<N> module;
+	CoreProcessor *core = &module;
+	benchmark::DoNotOptimize(core); // prevent devirtualization
+	constexpr auto num_inputs = SyntheticModule<N>::counts.num_inputs;
+	for (auto _ : state) {
+		for (unsigned i = 0; i < num_inputs; i++)
+			core->set_input(i, float(i));
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * num_inputs);
+}
+BENCHMARK_TEMPLATE(BM_VirtualSetInput, 10);
+BENCHMARK_TEMPLATE(BM_VirtualSetInput, 100);
+BENCHMARK_TEMPLATE(BM_VirtualSetInput, 1000);
+
+template<size_t N>
+void BM_VirtualGetOutput(benchmark::State &state) {
+	SyntheticModule<N> module;
+	CoreProcessor *core = &module;
+	benchmark::DoNotOptimize(core); // prevent devirtualization
+	constexpr auto num_outputs = SyntheticModule<N>::counts.num_outputs;
+	for (auto _ : state) {
+		float sum = 0;
+		for (unsigned i = 0; i < num_outputs; i++)
+			sum += core->get_output(i);
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * num_outputs);
+}
+BENCHMARK_TEMPLATE(BM_VirtualGetOutput, 10);
+BENCHMARK_TEMPLATE(BM_VirtualGetOutput, 100);
+BENCHMARK_TEMPLATE(BM_VirtualGetOutput, 1000);
+
+template<size_t N>
+void BM_BulkSetInputs(benchmark::State &state) {
+	SyntheticModule<N> module;
+	CoreProcessor *core = &module;
+	benchmark::DoNotOptimize(core); // prevent devirtualization
+	std::vector<float> vals(SyntheticModule<N>::counts.num_inputs, 1.f);
+	for (auto _ : state) {
+		core->set_inputs(vals);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * vals.size());
+}
+BENCHMARK_TEMPLATE(BM_BulkSetInputs, 10);
+BENCHMARK_TEMPLATE(BM_BulkSetInputs, 100);
+BENCHMARK_TEMPLATE(BM_BulkSetInputs, 1000);
+
+template<size_t N>
+void BM_BulkGetOutputs(benchmark::State &state) {
+	SyntheticModule<N> module;
+	CoreProcessor *core = &module;
+	benchmark::DoNotOptimize(core); // prevent devirtualization
+	std::vector<float> vals(SyntheticModule<N>::counts.num_outputs);
+	for (auto _ : state) {
+		core->get_outputs(vals);
+		benchmark::DoNotOptimize(vals.data());
+	}
+	state.SetItemsProcessed(state.iterations() * vals.size());
+}
+BENCHMARK_TEMPLATE(BM_BulkGetOutputs, 10);
+BENCHMARK_TEMPLATE(BM_BulkGetOutputs, 100);
+BENCHMARK_TEMPLATE(BM_BulkGetOutputs, 1000);
+
+//
+// GUI reading lights: polling every light vs. only the changed ones (one light changes per frame)
+//
+
+template<size_t N>
+void BM_PollLEDs(benchmark::State &state) {
+	SyntheticModule<N> module;
+	CoreProcessor *core = &module;
+	benchmark::DoNotOptimize(core); // prevent devirtualization
+	constexpr auto num_lights = SyntheticModule<N>::counts.num_lights;
+	std::vector<float> vals(num_lights);
+	float val = 0;
+	for (auto _ : state) {
+		module.led(val += 1.f);
+		for (unsigned i = 0; i < num_lights; i++)
+			vals[i] = core->get_led_brightness(i);
+		benchmark::DoNotOptimize(vals.data());
+	}
+}
+BENCHMARK_TEMPLATE(BM_PollLEDs, 10);
+BENCHMARK_TEMPLATE(BM_PollLEDs, 100);
+BENCHMARK_TEMPLATE(BM_PollLEDs, 1000);
+
+template<size_t N>
+void BM_ChangedLEDs(benchmark::State &state) {
+	SyntheticModule<N> module;
+	CoreProcessor *core = &module;
+	benchmark::DoNotOptimize(core); // prevent devirtualization
+	constexpr auto num_lights = SyntheticModule<N>::counts.num_lights;
+	std::vector<uint16_t> ids(num_lights);
+	std::vector<float> vals(num_lights);
+	float val = 0;
+	for (auto _ : state) {
+		module.led(val += 1.f);
+		benchmark::DoNotOptimize(core->get_changed_leds(ids, vals));
+		benchmark::DoNotOptimize(vals.data());
+	}
+}
+BENCHMARK_TEMPLATE(BM_ChangedLEDs, 10);
+BENCHMARK_TEMPLATE(BM_ChangedLEDs, 100);
+BENCHMARK_TEMPLATE(BM_ChangedLEDs, 1000);
+
+//
+// Element info
+//
+
+template<size_t N>
+void BM_GetIndicesRuntime(benchmark::State &state) {
+	std::span<const Element> elements = SyntheticInfo<N>::Elements;
+	std::vector<ElementCount::Indices> indices(elements.size());
+	for (auto _ : state) {
+		ElementCount::get_indices(elements, indices);
+		benchmark::DoNotOptimize(indices.data());
+	}
+	state.SetItemsProcessed(state.iterations() * elements.size());
+}
+BENCHMARK_TEMPLATE(BM_GetIndicesRuntime, 10);
+BENCHMARK_TEMPLATE(BM_GetIndicesRuntime, 100);
+BENCHMARK_TEMPLATE(BM_GetIndicesRuntime, 1000);
+
+template<size_t N>
+void BM_MakeView(benchmark::State &state) {
+	for (auto _ : state)
+		benchmark::DoNotOptimize(ModuleInfoView::makeView<SyntheticInfo<N>>());
+}
+BENCHMARK_TEMPLATE(BM_MakeView, 10);
+BENCHMARK_TEMPLATE(BM_MakeView, 100);
+BENCHMARK_TEMPLATE(BM_MakeView, 1000);
+
+//
+// State save/load
+//
+
+template<size_t N>
+void BM_SaveState(benchmark::State &state) {
+	SyntheticModule<N> module;
+	for (unsigned i = 0; i < SyntheticModule<N>::counts.num_params; i++)
+		module.set_param(i, 0.001f * i);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(module.save_state());
+}
+BENCHMARK_TEMPLATE(BM_SaveState, 10);
+BENCHMARK_TEMPLATE(BM_SaveState, 100);
+BENCHMARK_TEMPLATE(BM_SaveState, 1000);
+
+template<size_t N>
+void BM_LoadState(benchmark::State &state) {
+	SyntheticModule<N> module;
+	for (unsigned i = 0; i < SyntheticModule<N>::counts.num_params; i++)
+		module.set_param(i, 0.001f * i);
+	auto saved = module.save_state();
+
+	for (auto _ : state) {
+		module.load_state(saved);
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(BM_LoadState, 10);
+BENCHMARK_TEMPLATE(BM_LoadState, 100);
+BENCHMARK_TEMPLATE(BM_LoadState, 1000);
+
+template<size_t N>
+void BM_SaveStateBinary(benchmark::State &state) {
+	SyntheticModule<N> module;
+	for (unsigned i = 0; i < SyntheticModule<N>::counts.num_params; i++)
+		module.set_param(i, 0.001f * i);
+	std::vector<std::byte> buffer(module.binary_state_size());
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(module.save_state_into(buffer));
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(BM_SaveStateBinary, 10);
+BENCHMARK_TEMPLATE(BM_SaveStateBinary, 100);
+BENCHMARK_TEMPLATE(BM_SaveStateBinary, 1000);
+
+template<size_t N>
+void BM_LoadStateBinary(benchmark::State &state) {
+	SyntheticModule<N> module;
+	for (unsigned i = 0; i < SyntheticModule<N>::counts.num_params; i++)
+		module.set_param(i, 0.001f * i);
+	std::vector<std::byte> buffer(module.binary_state_size());
+	module.save_state_into(buffer);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(module.load_state_from(buffer));
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(BM_LoadStateBinary, 10);
+BENCHMARK_TEMPLATE(BM_LoadStateBinary, 100);
+BENCHMARK_TEMPLATE(BM_LoadStateBinary, 1000);
+
+} // namespace
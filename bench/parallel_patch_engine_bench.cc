@@ -0,0 +1,84 @@
+#include "CoreModules/engine/parallel_patch_engine.hh"
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <thread>
+
+using namespace MetaModule;
+
+namespace
+{
+
+// Stand-in for a module with some DSP cost: a saturating one-pole filter, run a few times per frame
+struct FilterModule : CoreProcessor {
+	float in = 0;
+	float out = 0;
+	float state = 0;
+	float coef = 0.1f;
+
+	void update() override {
+		float x = in + 0.01f;
+		for (int i = 0; i < 8; i++) {
+			state += coef * (std::tanh(x) - state);
+			x = state;
+		}
+		out = state;
+	}
+	void set_samplerate(float sr) override {
+	}
+	void set_param(int param_id, float val) override {
+	}
+	void set_input(int input_id, float val) override {
+		in = val;
+	}
+	float get_output(int output_id) const override {
+		return out;
+	}
+};
+
+constexpr unsigned NumChains = 16;
+constexpr unsigned ChainLength = 4;
+constexpr unsigned BlockSize = 64;
+
+void build_patch(PatchEngine &engine, std::vector<FilterModule> &modules) {
+	for (auto &m : modules)
+		engine.add_module(&m, {.num_inputs = 1, .num_outputs = 1});
+
+	for (uint32_t chain = 0; chain < NumChains; chain++) {
+		auto first = chain * ChainLength;
+		for (uint32_t i = first; i < first + ChainLength - 1; i++)
+			engine.add_cable({{i, 0}, {i + 1, 0}});
+	}
+
+	engine.set_block_size(BlockSize);
+	engine.rebuild_schedule();
+}
+
+void BM_PatchEngine_Serial(benchmark::State &state) {
+	std::vector<FilterModule> modules(NumChains * ChainLength);
+	PatchEngine engine;
+	build_patch(engine, modules);
+
+	for (auto _ : state)
+		engine.process_block(BlockSize);
+
+	state.SetItemsProcessed(state.iterations() * BlockSize);
+}
+BENCHMARK(BM_PatchEngine_Serial)->UseRealTime();
+
+// Arg: number of threads
+void BM_PatchEngine_Parallel(benchmark::State &state) {
+	std::vector<FilterModule> modules(NumChains * ChainLength);
+	ParallelPatchEngine engine(state.range(0));
+	build_patch(engine, modules);
+
+	for (auto _ : state)
+		engine.process_block(BlockSize);
+
+	state.SetItemsProcessed(state.iterations() * BlockSize);
+	state.counters["threads"] = engine.num_threads();
+}
+BENCHMARK(BM_PatchEngine_Parallel)
+	->DenseRange(1, std::max(std::thread::hardware_concurrency(), 1u))
+	->UseRealTime();
+
+} // namespace
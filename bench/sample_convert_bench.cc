@@ -0,0 +1,66 @@
+#include "CoreModules/sample_convert.hh"
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace MetaModule;
+using namespace MetaModule::SampleConvert;
+
+// Converting a chunk of audio file samples to float: one sample at a time (as hand-written
+// readers do) vs. the bulk conversion.
+
+namespace
+{
+
+constexpr size_t NumSamples = 4096;
+
+std::vector<std::byte> make_data(size_t bytes) {
+	std::vector<std::byte> data(bytes);
+	uint32_t seed = 1;
+	for (auto &b : data) {
+		seed = seed * 1664525 + 1013904223;
+		b = std::byte(seed >> 24);
+	}
+	return data;
+}
+
+template<SampleFormat Format, ByteOrder Order>
+void BM_Convert_PerSample(benchmark::State &state) {
+	auto size = bytes_per_sample(Format);
+	auto data = make_data(NumSamples * size);
+	std::vector<float> out(NumSamples);
+	for (auto _ : state) {
+		for (size_t i = 0; i < NumSamples; i++) {
+			auto sample = &data[i * size];
+			out[i] = Format == SampleFormat::Int16 ? int16_to_float(sample, Order) :
+					 Format == SampleFormat::Int24 ? int24_to_float(sample, Order) :
+													 float32_to_float(sample, Order);
+		}
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * NumSamples);
+}
+
+template<SampleFormat Format, ByteOrder Order>
+void BM_Convert_Bulk(benchmark::State &state) {
+	auto data = make_data(NumSamples * bytes_per_sample(Format));
+	std::vector<float> out(NumSamples);
+	for (auto _ : state) {
+		to_float(Format, Order, data, out);
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * NumSamples);
+	state.SetLabel(std::string{implementation});
+}
+
+BENCHMARK(BM_Convert_PerSample<SampleFormat::Int16, ByteOrder::Little>);
+BENCHMARK(BM_Convert_Bulk<SampleFormat::Int16, ByteOrder::Little>);
+BENCHMARK(BM_Convert_PerSample<SampleFormat::Int24, ByteOrder::Little>);
+BENCHMARK(BM_Convert_Bulk<SampleFormat::Int24, ByteOrder::Little>);
+BENCHMARK(BM_Convert_PerSample<SampleFormat::Int24, ByteOrder::Big>);
+BENCHMARK(BM_Convert_Bulk<SampleFormat::Int24, ByteOrder::Big>);
+BENCHMARK(BM_Convert_PerSample<SampleFormat::Float32, ByteOrder::Big>);
+BENCHMARK(BM_Convert_Bulk<SampleFormat::Float32, ByteOrder::Big>);
+
+} // namespace
@@ -0,0 +1,131 @@
+#include "CoreModules/spsc_ring.hh"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <span>
+#include <thread>
+
+using namespace MetaModule;
+
+// SpscRing throughput, streaming floats as a sample player would: one item at a time, in bulk
+// (copying a block), and in place through the regions.
+// The Threaded benchmarks run the producer on another thread, as AsyncThread and update() do.
+
+namespace
+{
+
+constexpr size_t RingSize = 4096;
+constexpr size_t BlockSize = 64;
+using Ring = SpscRing<float, RingSize>;
+
+void BM_SpscRing_SingleItems(benchmark::State &state) {
+	Ring ring;
+	float sum = 0;
+	for (auto _ : state) {
+		for (size_t i = 0; i < BlockSize; i++)
+			ring.push(float(i));
+		for (size_t i = 0; i < BlockSize; i++)
+			sum += *ring.try_pop();
+	}
+	benchmark::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * BlockSize);
+}
+BENCHMARK(BM_SpscRing_SingleItems);
+
+void BM_SpscRing_Bulk(benchmark::State &state) {
+	Ring ring;
+	std::array<float, BlockSize> in{};
+	std::array<float, BlockSize> out{};
+	for (auto _ : state) {
+		ring.push(in);
+		ring.pop(out);
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * BlockSize);
+}
+BENCHMARK(BM_SpscRing_Bulk);
+
+void BM_SpscRing_Regions(benchmark::State &state) {
+	Ring ring;
+	float sum = 0;
+	for (auto _ : state) {
+		// RingSize is a multiple of BlockSize, so each block is one region
+		auto region = ring.write_region();
+		for (size_t i = 0; i < BlockSize; i++)
+			region[i] = float(i);
+		ring.commit_write(BlockSize);
+
+		auto readable = ring.read_region();
+		for (size_t i = 0; i < BlockSize; i++)
+			sum += readable[i];
+		ring.commit_read(BlockSize);
+	}
+	benchmark::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * BlockSize);
+}
+BENCHMARK(BM_SpscRing_Regions);
+
+// Producer thread keeps the ring full, the benchmark loop consumes a block per iteration
+template<bool UseRegions>
+void threaded(benchmark::State &state) {
+	Ring ring;
+	std::atomic<bool> running = true;
+
+	std::thread producer{[&] {
+		float x = 0;
+		std::array<float, BlockSize> block{};
+		while (running.load(std::memory_order_relaxed)) {
+			if (UseRegions) {
+				auto region = ring.write_region();
+				for (auto &sample : region)
+					sample = x++;
+				ring.commit_write(region.size());
+				if (region.empty())
+					std::this_thread::yield();
+			} else {
+				for (auto &sample : block)
+					sample = x++;
+				if (ring.push(block) < block.size())
+					std::this_thread::yield();
+			}
+		}
+	}};
+
+	std::array<float, BlockSize> out{};
+	size_t num_items = 0;
+	for (auto _ : state) {
+		size_t got = 0;
+		while (got < BlockSize) {
+			if (UseRegions) {
+				auto readable = ring.read_region();
+				auto num = std::min(readable.size(), BlockSize - got);
+				std::copy_n(readable.begin(), num, out.begin() + got);
+				ring.commit_read(num);
+				got += num;
+			} else
+				got += ring.pop(std::span{out}.subspan(got));
+
+			if (got < BlockSize)
+				std::this_thread::yield();
+		}
+		num_items += got;
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	running = false;
+	producer.join();
+	state.SetItemsProcessed(num_items);
+}
+
+void BM_SpscRing_Threaded_Bulk(benchmark::State &state) {
+	threaded<false>(state);
+}
+BENCHMARK(BM_SpscRing_Threaded_Bulk)->UseRealTime();
+
+void BM_SpscRing_Threaded_Regions(benchmark::State &state) {
+	threaded<true>(state);
+}
+BENCHMARK(BM_SpscRing_Threaded_Regions)->UseRealTime();
+
+} // namespace
@@ -0,0 +1,230 @@
+#pragma once
+#include "CoreModules/sample_convert.hh"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+
+namespace MetaModule
+{
+
+// Where the samples are in an uncompressed audio file, and how they're stored
+struct AudioFileInfo {
+	SampleConvert::SampleFormat format = SampleConvert::SampleFormat::Int16;
+	SampleConvert::ByteOrder byte_order = SampleConvert::ByteOrder::Little;
+	uint16_t num_channels = 0;
+	uint32_t sample_rate = 0;
+	uint32_t num_frames = 0;
+
+	// File offset of the first frame. Frames are interleaved and packed.
+	uint64_t data_offset = 0;
+
+	uint32_t bytes_per_frame() const {
+		return num_channels * SampleConvert::bytes_per_sample(format);
+	}
+};
+
+namespace AudioFileHeader
+{
+
+inline uint32_t read_le(const std::byte *p, unsigned num_bytes) {
+	uint32_t val = 0;
+	for (unsigned i = 0; i < num_bytes; i++)
+		val |= uint32_t(p[i]) << (i * 8);
+	return val;
+}
+
+inline uint32_t read_be(const std::byte *p, unsigned num_bytes) {
+	uint32_t val = 0;
+	for (unsigned i = 0; i < num_bytes; i++)
+		val = (val << 8) | uint32_t(p[i]);
+	return val;
+}
+
+inline bool is_id(const std::byte *p, const char (&id)[5]) {
+	return std::memcmp(p, id, 4) == 0;
+}
+
+// AIFF sample rates are 80-bit extended floats
+inline uint32_t read_extended(const std::byte *p) {
+	int exponent = int(read_be(p, 2) & 0x7FFF) - 16383;
+	uint64_t mantissa = (uint64_t(read_be(p + 2, 4)) << 32) | read_be(p + 6, 4);
+	if (exponent < 0 || exponent > 31)
+		return 0;
+	return uint32_t(mantissa >> (63 - exponent));
+}
+
+inline std::optional<SampleConvert::SampleFormat> pcm_format(unsigned bits) {
+	if (bits == 16)
+		return SampleConvert::SampleFormat::Int16;
+	if (bits == 24)
+		return SampleConvert::SampleFormat::Int24;
+	return std::nullopt;
+}
+
+// Chunks are padded to an even size in both formats
+constexpr uint64_t padded(uint64_t size) {
+	return size + (size & 1);
+}
+
+constexpr unsigned MaxChunks = 64;
+
+template<typename Read>
+std::optional<AudioFileInfo> parse_wav(Read &read, uint64_t file_size) {
+	using SampleConvert::SampleFormat;
+
+	AudioFileInfo info;
+	bool have_fmt = false;
+	uint64_t data_size = 0;
+
+	uint64_t pos = 12;
+	for (unsigned chunk = 0; chunk < MaxChunks && pos + 8 <= file_size; chunk++) {
+		std::array<std::byte, 8> header;
+		if (read(pos, std::span{header}) != header.size())
+			return std::nullopt;
+		uint64_t size = read_le(&header[4], 4);
+
+		if (is_id(&header[0], "fmt ")) {
+			// Tag, channels, rate, byte rate, block align, bits, extension size, valid bits, channel mask, sub-format
+			std::array<std::byte, 26> fmt{};
+			if (size < 16 || read(pos + 8, std::span{fmt}.first(std::min<size_t>(size, fmt.size()))) < 16)
+				return std::nullopt;
+
+			unsigned tag = read_le(&fmt[0], 2);
+			if (tag == 0xFFFE && size >= fmt.size())
+				tag = read_le(&fmt[24], 2);
+
+			info.num_channels = read_le(&fmt[2], 2);
+			info.sample_rate = read_le(&fmt[4], 4);
+			unsigned block_align = read_le(&fmt[12], 2);
+			unsigned bits = read_le(&fmt[14], 2);
+
+			if (tag == 1) {
+				auto format = pcm_format(bits);
+				if (!format)
+					return std::nullopt;
+				info.format = *format;
+			} else if (tag == 3 && bits == 32)
+				info.format = SampleFormat::Float32;
+			else
+				return std::nullopt;
+
+			if (info.num_channels == 0 || block_align != info.bytes_per_frame())
+				return std::nullopt;
+			have_fmt = true;
+
+		} else if (is_id(&header[0], "data")) {
+			info.data_offset = pos + 8;
+			data_size = size;
+			if (have_fmt)
+				break;
+		}
+
+		pos += 8 + padded(size);
+	}
+
+	if (!have_fmt || info.data_offset == 0)
+		return std::nullopt;
+
+	info.byte_order = SampleConvert::ByteOrder::Little;
+	data_size = std::min(data_size, file_size - std::min(file_size, info.data_offset));
+	info.num_frames = data_size / info.bytes_per_frame();
+	return info;
+}
+
+template<typename Read>
+std::optional<AudioFileInfo> parse_aiff(Read &read, uint64_t file_size, bool is_aifc) {
+	using SampleConvert::ByteOrder;
+	using SampleConvert::SampleFormat;
+
+	AudioFileInfo info;
+	bool have_comm = false;
+
+	uint64_t pos = 12;
+	for (unsigned chunk = 0; chunk < MaxChunks && pos + 8 <= file_size; chunk++) {
+		std::array<std::byte, 8> header;
+		if (read(pos, std::span{header}) != header.size())
+			return std::nullopt;
+		uint64_t size = read_be(&header[4], 4);
+
+		if (is_id(&header[0], "COMM")) {
+			// Channels, frames, bits, rate, and for AIFC: compression type
+			std::array<std::byte, 22> comm{};
+			auto needed = is_aifc ? 22u : 18u;
+			if (size < needed || read(pos + 8, std::span{comm}.first(needed)) != needed)
+				return std::nullopt;
+
+			info.num_channels = read_be(&comm[0], 2);
+			info.num_frames = read_be(&comm[2], 4);
+			unsigned bits = read_be(&comm[6], 2);
+			info.sample_rate = read_extended(&comm[8]);
+			info.byte_order = ByteOrder::Big;
+
+			auto compression = is_aifc ? &comm[18] : nullptr;
+			if (!compression || is_id(compression, "NONE") || is_id(compression, "sowt")) {
+				auto format = pcm_format(bits);
+				if (!format)
+					return std::nullopt;
+				info.format = *format;
+				if (compression && is_id(compression, "sowt"))
+					info.byte_order = ByteOrder::Little;
+			} else if (is_id(compression, "fl32") || is_id(compression, "FL32"))
+				info.format = SampleFormat::Float32;
+			else
+				return std::nullopt;
+
+			if (info.num_channels == 0)
+				return std::nullopt;
+			have_comm = true;
+
+		} else if (is_id(&header[0], "SSND")) {
+			// Offset to the first frame, then block size
+			std::array<std::byte, 8> ssnd;
+			if (size < 8 || read(pos + 8, std::span{ssnd}) != ssnd.size())
+				return std::nullopt;
+			info.data_offset = pos + 16 + read_be(&ssnd[0], 4);
+			if (have_comm)
+				break;
+		}
+
+		pos += 8 + padded(size);
+	}
+
+	if (!have_comm || info.data_offset == 0)
+		return std::nullopt;
+
+	auto data_size = file_size - std::min(file_size, info.data_offset);
+	info.num_frames = std::min<uint64_t>(info.num_frames, data_size / info.bytes_per_frame());
+	return info;
+}
+
+} // namespace AudioFileHeader
+
+// Parses the header of a WAV (16/24-bit PCM or 32-bit float, including WAVE_FORMAT_EXTENSIBLE)
+// or AIFF/AIFC (16/24-bit PCM, little endian 'sowt', or 32-bit float) file.
+// read(uint64_t offset, std::span<std::byte> buffer) reads from the file, and returns the number of bytes read.
+// Returns nullopt for other formats and malformed files.
+template<typename Read>
+std::optional<AudioFileInfo> parse_audio_file_header(Read &&read, uint64_t file_size) {
+	using namespace AudioFileHeader;
+
+	std::array<std::byte, 12> header;
+	if (file_size < header.size() || read(uint64_t{0}, std::span{header}) != header.size())
+		return std::nullopt;
+
+	if (is_id(&header[0], "RIFF") && is_id(&header[8], "WAVE"))
+		return parse_wav(read, file_size);
+
+	if (is_id(&header[0], "FORM") && is_id(&header[8], "AIFF"))
+		return parse_aiff(read, file_size, false);
+
+	if (is_id(&header[0], "FORM") && is_id(&header[8], "AIFC"))
+		return parse_aiff(read, file_size, true);
+
+	return std::nullopt;
+}
+
+} // namespace MetaModule
@@ -0,0 +1,280 @@
+#pragma once
+#include "CoreModules/async_thread.hh"
+#include "CoreModules/sample_convert.hh"
+#include "CoreModules/spsc_ring.hh"
+#include "filesystem/audio_file_header.hh"
+#include "filesystem/fatfs_adaptor.hh"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace MetaModule
+{
+
+enum class AudioFileStatus : uint8_t { Closed, Loading, Streaming, Error };
+
+// Streams a WAV or AIFF file from FatFS, so long samples don't have to be loaded into RAM.
+//
+// The module's AsyncThread opens the file, parses its header, and keeps a ring of upcoming samples
+// (converted to float) filled. The audio thread only reads from the ring, so it never waits for I/O.
+// All the public functions are for the audio thread (e.g. update()): open(), seek() and close()
+// just post a request for the AsyncThread, and read() returns nothing until the request is done.
+//
+// Usage:
+//   AudioFileStream stream{this, fs};
+//   stream.open("sample.wav");
+//   update(): stream.read(frame) (returns 0 samples while loading, on errors, and at the end)
+template<size_t RingSamples = 16384>
+class BasicAudioFileStream {
+public:
+	using Status = AudioFileStatus;
+
+	static constexpr size_t MaxPathLength = 255;
+
+	BasicAudioFileStream(CoreProcessor *module, FatFS &fs)
+		: fs{fs}
+		, thread{module, [this] { run(); }} {
+	}
+
+	~BasicAudioFileStream() {
+		thread.stop();
+		close_file();
+	}
+
+	BasicAudioFileStream(const BasicAudioFileStream &) = delete;
+	BasicAudioFileStream &operator=(const BasicAudioFileStream &) = delete;
+
+	// Opens a file, and starts streaming from start_frame.
+	// Returns false if the path is too long, or if the previous open() or close() wasn't picked up yet.
+	bool open(std::string_view filename, uint32_t start_frame = 0) {
+		if (filename.size() > MaxPathLength || path_pending.load(std::memory_order_acquire))
+			return false;
+
+		std::copy(filename.begin(), filename.end(), path.begin());
+		path[filename.size()] = '\0';
+		path_pending.store(true, std::memory_order_release);
+		seek(start_frame);
+		return true;
+	}
+
+	bool close() {
+		return open("");
+	}
+
+	// Continues streaming from a frame (clamped to the end of the file)
+	void seek(uint32_t frame) {
+		seek_frame.store(frame, std::memory_order_relaxed);
+		request_gen.store(++requested, std::memory_order_release);
+		thread.run_once();
+	}
+
+	Status status() const {
+		if (done_gen.load(std::memory_order_acquire) != requested)
+			return Status::Loading;
+		return file_status.load(std::memory_order_acquire);
+	}
+
+	// Only valid while status() is Streaming
+	AudioFileInfo const &info() const {
+		return file_info;
+	}
+
+	// Reads up to out.size() samples (whole frames, interleaved), and returns the number read.
+	// Reads less than requested if the ring runs low, and nothing until a request is done.
+	// After a read error, status() is Error until the next seek() or open().
+	size_t read(std::span<float> out) {
+		if (status() != Status::Streaming)
+			return 0;
+
+		// Drop samples pushed before the latest request
+		auto flush = flush_point.load(std::memory_order_relaxed);
+		while (pending(flush)) {
+			auto region = ring.read_region();
+			if (region.empty())
+				break;
+			auto num = std::min<size_t>(region.size(), flush - popped);
+			ring.commit_read(num);
+			popped += num;
+		}
+
+		size_t num = 0;
+		if (!pending(flush)) {
+			// A push that wraps around the ring is committed in two parts, so only take the whole frames
+			auto channels = file_info.num_channels;
+			auto whole_frames = std::min(out.size(), ring.read_available()) / channels * channels;
+			num = ring.pop(out.first(whole_frames));
+			popped += num;
+		}
+
+		if (!end_reached.load(std::memory_order_relaxed) && ring.read_available() <= RingSamples / 2)
+			thread.run_once();
+		return num;
+	}
+
+	// Frame that the next read() starts at
+	uint32_t position() const {
+		if (status() != Status::Streaming)
+			return 0;
+		auto flush = flush_point.load(std::memory_order_relaxed);
+		return start_frame + (pending(flush) ? 0 : (popped - flush) / file_info.num_channels);
+	}
+
+	// Whether all frames up to the end of the file were read
+	bool at_end() {
+		return status() == Status::Streaming && end_reached.load(std::memory_order_acquire) &&
+			   ring.read_available() == 0;
+	}
+
+private:
+	static constexpr size_t ChunkSamples = 2048;
+	static constexpr size_t MaxBytesPerSample = 4;
+
+	FatFS &fs;
+
+	SpscRing<float, RingSamples> ring;
+
+	// Requests: written by the audio thread, then request_gen is incremented.
+	// path_pending is set while path holds a new file for the AsyncThread.
+	std::array<char, MaxPathLength + 1> path{};
+	std::atomic<bool> path_pending{false};
+	std::atomic<uint32_t> seek_frame{0};
+	std::atomic<uint32_t> request_gen{0};
+
+	// Results: written by the AsyncThread, then done_gen is set to the request it did.
+	// The audio thread reads these only when done_gen is its latest request.
+	std::atomic<uint32_t> done_gen{0};
+	std::atomic<size_t> flush_point{0};
+	std::atomic<bool> end_reached{false};
+	std::atomic<Status> file_status{Status::Closed}; // also set to Error by a read error while streaming
+	AudioFileInfo file_info{};
+	uint32_t start_frame = 0;
+
+	// Audio thread only
+	uint32_t requested = 0;
+	size_t popped = 0;
+
+	// AsyncThread only
+	File file{};
+	bool file_open = false;
+	uint32_t handled_gen = 0;
+	uint32_t next_frame = 0;
+	size_t pushed = 0;
+	std::array<std::byte, ChunkSamples * MaxBytesPerSample> raw;
+	std::array<float, ChunkSamples> samples;
+
+	AsyncThread thread;
+
+	bool pending(size_t flush) const {
+		return ptrdiff_t(flush - popped) > 0;
+	}
+
+	void run() {
+		auto gen = request_gen.load(std::memory_order_acquire);
+		if (gen != handled_gen) {
+			if (path_pending.load(std::memory_order_acquire)) {
+				auto new_path = path;
+				path_pending.store(false, std::memory_order_release);
+				open_file(new_path.data());
+			}
+
+			if (file_open) {
+				// A seek tries again after a read error
+				file_status.store(Status::Streaming, std::memory_order_relaxed);
+				next_frame = std::min(seek_frame.load(std::memory_order_relaxed), file_info.num_frames);
+				start_frame = next_frame;
+				fs.f_lseek(&file, file_info.data_offset + uint64_t(next_frame) * file_info.bytes_per_frame());
+			}
+
+			handled_gen = gen;
+			end_reached.store(false, std::memory_order_relaxed);
+			flush_point.store(pushed, std::memory_order_relaxed);
+			done_gen.store(gen, std::memory_order_release);
+		}
+
+		fill();
+	}
+
+	void open_file(const char *filename) {
+		close_file();
+		file_status.store(Status::Closed, std::memory_order_relaxed);
+		if (filename[0] == '\0')
+			return;
+
+		file_status.store(Status::Error, std::memory_order_relaxed);
+		if (fs.f_open(&file, filename, FA_READ) != FR_OK)
+			return;
+		file_open = true;
+
+		auto read = [this](uint64_t offset, std::span<std::byte> buffer) -> size_t {
+			unsigned bytes_read = 0;
+			if (fs.f_lseek(&file, offset) != FR_OK || fs.f_read(&file, buffer.data(), buffer.size(), &bytes_read) != FR_OK)
+				return 0;
+			return bytes_read;
+		};
+
+		if (auto info = parse_audio_file_header(read, FatFS::f_size(&file))) {
+			file_info = *info;
+			file_status.store(Status::Streaming, std::memory_order_relaxed);
+		} else
+			close_file();
+	}
+
+	void close_file() {
+		if (file_open)
+			fs.f_close(&file);
+		file_open = false;
+	}
+
+	// Converts and pushes whole frames until the ring is full, the file ends, there's a new request, or a read fails
+	void fill() {
+		if (!file_open)
+			return;
+
+		auto channels = file_info.num_channels;
+		auto bytes_per_frame = file_info.bytes_per_frame();
+
+		while (next_frame < file_info.num_frames) {
+			if (request_gen.load(std::memory_order_relaxed) != handled_gen) {
+				thread.run_once();
+				return;
+			}
+
+			auto frames = std::min<size_t>({ring.write_available() / channels,
+											samples.size() / channels,
+											file_info.num_frames - next_frame});
+			if (frames == 0)
+				return;
+
+			unsigned bytes_read = 0;
+			if (fs.f_read(&file, raw.data(), frames * bytes_per_frame, &bytes_read) != FR_OK) {
+				file_status.store(Status::Error, std::memory_order_release);
+				return;
+			}
+			// The file is shorter than its header says
+			if (bytes_read == 0)
+				break;
+
+			frames = bytes_read / bytes_per_frame;
+			if (bytes_read % bytes_per_frame)
+				fs.f_lseek(&file, file_info.data_offset + uint64_t(next_frame + frames) * bytes_per_frame);
+
+			auto num = SampleConvert::to_float(file_info.format,
+											   file_info.byte_order,
+											   std::span{raw}.first(frames * bytes_per_frame),
+											   std::span{samples}.first(frames * channels));
+			ring.push(std::span<const float>{samples}.first(num));
+			pushed += num;
+			next_frame += frames;
+		}
+
+		end_reached.store(true, std::memory_order_release);
+	}
+};
+
+using AudioFileStream = BasicAudioFileStream<>;
+
+} // namespace MetaModule
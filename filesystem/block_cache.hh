@@ -0,0 +1,342 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace MetaModule
+{
+
+struct BlockCacheConfig {
+	uint32_t block_size = 4096;
+	uint32_t num_blocks = 16;	 // Cache size is block_size * num_blocks
+	uint32_t max_read_ahead = 4; // Most blocks fetched ahead of sequential reads
+};
+
+struct BlockCacheStats {
+	uint64_t hits = 0;		  // Blocks read from the cache
+	uint64_t misses = 0;	  // Blocks fetched because a read needed them
+	uint64_t read_ahead = 0;  // Blocks fetched ahead of sequential reads
+	uint64_t fetches = 0;	  // Reads from the file system
+	uint64_t bypassed = 0;	  // Reads of a block or more, which skip the cache
+	uint64_t invalidated = 0; // Blocks dropped by writes, truncates, unlinks and renames
+};
+
+// LRU cache of file blocks, so many small reads (e.g. f_gets() loops) become a few block-sized
+// reads from the file system. When a file is read sequentially, blocks after the one that missed
+// are fetched in the same read, doubling the number each time up to max_read_ahead.
+//
+// Blocks are keyed by path, so all open handles to a file share them, and a write through one
+// handle invalidates what the others would read. Paths are normalized first (see normalize_path()),
+// so different spellings of a path are the same file. Not thread-safe (like FatFS itself).
+class BlockCache {
+public:
+	explicit BlockCache(BlockCacheConfig config = {})
+		: config{sanitize(config)}
+		, blocks(this->config.num_blocks)
+		, data(size_t(this->config.num_blocks) * this->config.block_size)
+		, staging(size_t(this->config.max_read_ahead + 1) * this->config.block_size) {
+	}
+
+	// From f_open(): handle identifies the open file (e.g. its File *).
+	// Relative paths are relative to working_dir.
+	void open_file(const void *handle, std::string_view path, std::string_view working_dir = "") {
+		close_file(handle);
+		auto key = normalize_path(path, working_dir);
+		auto id = find_path(key);
+		if (id == NoFile)
+			id = add_path(key);
+		paths[id].num_handles++;
+		handles.push_back({handle, id});
+	}
+
+	// From f_close()
+	void close_file(const void *handle) {
+		auto it = std::find_if(handles.begin(), handles.end(), [=](auto &h) { return h.handle == handle; });
+		if (it == handles.end())
+			return;
+		paths[it->file].num_handles--;
+		handles.erase(it);
+	}
+
+	// From f_read(): reads dst.size() bytes at offset (fewer at the end of the file).
+	// fetch(uint64_t offset, std::span<std::byte>) reads from the file system, and returns the number
+	// of bytes read or nullopt on errors. Returns the number of bytes read, or nullopt on errors.
+	template<typename Fetch>
+	std::optional<size_t> read(const void *handle, uint64_t offset, std::span<std::byte> dst, Fetch &&fetch) {
+		auto id = file_of(handle);
+		if (id == NoFile || dst.size() >= config.block_size) {
+			stats_.bypassed++;
+			stats_.fetches++;
+			auto num = fetch(offset, dst);
+			if (id != NoFile && num)
+				paths[id].next_offset = offset + *num;
+			return num;
+		}
+
+		auto &file = paths[id];
+		bool sequential = offset == file.next_offset;
+
+		size_t done = 0;
+		while (done < dst.size()) {
+			auto pos = offset + done;
+			auto index = pos / config.block_size;
+			size_t in_block = pos % config.block_size;
+
+			auto slot = find_block(id, index);
+			if (slot != NoBlock)
+				stats_.hits++;
+			else {
+				stats_.misses++;
+				slot = load(id, index, sequential, fetch);
+				if (slot == NoBlock)
+					return std::nullopt;
+			}
+			blocks[slot].last_used = ++tick;
+
+			auto &block = blocks[slot];
+			if (in_block >= block.size)
+				break;
+
+			auto num = std::min(block.size - in_block, dst.size() - done);
+			std::memcpy(dst.data() + done, block_data(slot) + in_block, num);
+			done += num;
+
+			// A short block is the end of the file
+			if (block.size < config.block_size && in_block + num == block.size)
+				break;
+		}
+
+		file.next_offset = offset + done;
+		return done;
+	}
+
+	// From f_write(): drops the blocks overlapping what was written, and any block that ended at the old end of the file
+	void write(const void *handle, uint64_t offset, size_t size) {
+		auto id = file_of(handle);
+		if (id == NoFile || size == 0)
+			return;
+
+		auto first = offset / config.block_size;
+		auto last = (offset + size - 1) / config.block_size;
+		drop_blocks(id, [&](Block const &block) {
+			return (block.index >= first && block.index <= last) || block.size < config.block_size;
+		});
+	}
+
+	// From f_truncate()
+	void truncate(const void *handle) {
+		auto id = file_of(handle);
+		if (id != NoFile)
+			drop_blocks(id, [](Block const &) { return true; });
+	}
+
+	// From f_unlink() and f_rename() (both paths)
+	void invalidate(std::string_view path, std::string_view working_dir = "") {
+		auto id = find_path(normalize_path(path, working_dir));
+		if (id != NoFile)
+			drop_blocks(id, [](Block const &) { return true; });
+	}
+
+	void clear() {
+		for (auto &block : blocks)
+			block.file = NoFile;
+		for (auto &path : paths)
+			path.num_blocks = 0;
+	}
+
+	BlockCacheStats const &stats() const {
+		return stats_;
+	}
+
+	void reset_stats() {
+		stats_ = {};
+	}
+
+	BlockCacheConfig const &get_config() const {
+		return config;
+	}
+
+	// The key for a path: an absolute path, with "." and "..", and repeated and trailing slashes resolved.
+	// E.g. "x", "./x", "a/../x" and "/root/x" are all "/root/x" with working_dir "/root".
+	// Paths with a volume (e.g. "sdc:/x") are absolute.
+	static std::string normalize_path(std::string_view path, std::string_view working_dir = "") {
+		std::string key;
+		if (!path.starts_with('/') && path.find(':') == std::string_view::npos)
+			append_components(key, working_dir);
+		append_components(key, path);
+		return key.empty() ? "/" : key;
+	}
+
+private:
+	static constexpr uint32_t NoFile = UINT32_MAX;
+	static constexpr uint32_t NoBlock = UINT32_MAX;
+
+	struct Block {
+		uint32_t file = NoFile;
+		uint32_t size = 0; // Less than block_size at the end of the file
+		uint64_t index = 0;
+		uint64_t last_used = 0;
+	};
+
+	struct Path {
+		std::string path;
+		uint32_t num_handles = 0;
+		uint32_t num_blocks = 0;
+		uint32_t read_ahead = 0;
+		uint64_t next_offset = 0;
+	};
+
+	struct Handle {
+		const void *handle;
+		uint32_t file;
+	};
+
+	BlockCacheConfig config;
+	std::vector<Block> blocks;
+	std::vector<std::byte> data;
+	std::vector<std::byte> staging;
+
+	std::vector<Path> paths;
+	std::vector<Handle> handles;
+
+	BlockCacheStats stats_;
+	uint64_t tick = 0;
+
+	static BlockCacheConfig sanitize(BlockCacheConfig config) {
+		config.block_size = std::max(config.block_size, 1u);
+		config.num_blocks = std::max(config.num_blocks, 1u);
+		config.max_read_ahead = std::min(config.max_read_ahead, config.num_blocks - 1);
+		return config;
+	}
+
+	// Appends "/name" for each component of path
+	static void append_components(std::string &key, std::string_view path) {
+		while (!path.empty()) {
+			auto end = std::min(path.find('/'), path.size());
+			auto name = path.substr(0, end);
+			path.remove_prefix(std::min(end + 1, path.size()));
+
+			if (name.empty() || name == ".")
+				continue;
+			if (name == "..")
+				key.resize(std::min(key.rfind('/'), key.size()));
+			else {
+				key += '/';
+				key += name;
+			}
+		}
+	}
+
+	std::byte *block_data(uint32_t slot) {
+		return data.data() + size_t(slot) * config.block_size;
+	}
+
+	uint32_t file_of(const void *handle) const {
+		for (auto &h : handles) {
+			if (h.handle == handle)
+				return h.file;
+		}
+		return NoFile;
+	}
+
+	uint32_t find_path(std::string_view path) const {
+		for (uint32_t i = 0; i < paths.size(); i++) {
+			if (paths[i].path == path && (paths[i].num_handles || paths[i].num_blocks))
+				return i;
+		}
+		return NoFile;
+	}
+
+	// Reuses the entry of a path that's no longer open or cached
+	uint32_t add_path(std::string_view path) {
+		for (uint32_t i = 0; i < paths.size(); i++) {
+			if (!paths[i].num_handles && !paths[i].num_blocks) {
+				paths[i] = {.path = std::string{path}};
+				return i;
+			}
+		}
+		paths.push_back({.path = std::string{path}});
+		return paths.size() - 1;
+	}
+
+	uint32_t find_block(uint32_t file, uint64_t index) const {
+		for (uint32_t i = 0; i < blocks.size(); i++) {
+			if (blocks[i].file == file && blocks[i].index == index)
+				return i;
+		}
+		return NoBlock;
+	}
+
+	uint32_t least_recently_used() const {
+		uint32_t lru = 0;
+		for (uint32_t i = 0; i < blocks.size(); i++) {
+			if (blocks[i].file == NoFile)
+				return i;
+			if (blocks[i].last_used < blocks[lru].last_used)
+				lru = i;
+		}
+		return lru;
+	}
+
+	template<typename Pred>
+	void drop_blocks(uint32_t file, Pred &&should_drop) {
+		for (auto &block : blocks) {
+			if (block.file == file && should_drop(block)) {
+				block.file = NoFile;
+				paths[file].num_blocks--;
+				stats_.invalidated++;
+			}
+		}
+	}
+
+	// Fetches a block, plus blocks after it if the file is being read sequentially.
+	// Returns the slot of the block.
+	template<typename Fetch>
+	uint32_t load(uint32_t file, uint64_t index, bool sequential, Fetch &fetch) {
+		auto &path = paths[file];
+		path.read_ahead = sequential ? std::min(std::max(path.read_ahead * 2, 1u), config.max_read_ahead) : 0;
+
+		// Stop at the first block that's already cached
+		uint32_t count = 1;
+		while (count <= path.read_ahead && find_block(file, index + count) == NoBlock)
+			count++;
+
+		auto bytes = std::span{staging}.first(size_t(count) * config.block_size);
+		stats_.fetches++;
+		auto num = fetch(index * config.block_size, bytes);
+		if (!num)
+			return NoBlock;
+
+		// Blocks after the first are only kept if they have data. Read-ahead blocks are older than the
+		// block that was asked for, so they're evicted first if not used.
+		uint32_t first_slot = NoBlock;
+		for (uint32_t i = 0; i < count; i++) {
+			size_t start = size_t(i) * config.block_size;
+			if (i > 0 && start >= *num)
+				break;
+
+			auto slot = least_recently_used();
+			if (blocks[slot].file != NoFile)
+				paths[blocks[slot].file].num_blocks--;
+
+			auto size = std::min<size_t>(config.block_size, *num - std::min(start, *num));
+			blocks[slot] = {.file = file, .size = uint32_t(size), .index = index + i, .last_used = ++tick};
+			path.num_blocks++;
+			std::memcpy(block_data(slot), bytes.data() + start, size);
+
+			if (i == 0)
+				first_slot = slot;
+			else
+				stats_.read_ahead++;
+		}
+		return first_slot;
+	}
+};
+
+} // namespace MetaModule
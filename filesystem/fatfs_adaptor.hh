@@ -1,7 +1,11 @@
 #pragma once
+#include "block_cache.hh"
 #include "ff_host.hh"
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 
@@ -58,6 +62,16 @@ struct FatFS {
 
 	bool find_valid_root(std::string_view path);
 
+	// Optional block cache for f_read(), with read-ahead for sequential reads. Off by default.
+	// Implemented by the host, which keeps the cache in its FsProxy (so FatFS's layout, which plugins
+	// and hosts share, doesn't change), and calls the cache helpers below from its implementations of
+	// f_open(), f_close(), f_read(), f_write(), f_truncate(), f_unlink() and f_rename().
+	// See block_cache.hh
+	void enable_block_cache(BlockCacheConfig config = {});
+	void disable_block_cache();
+	BlockCacheStats block_cache_stats() const;
+	void reset_block_cache_stats();
+
 #undef f_eof
 	static bool f_eof(File *fp);
 
@@ -85,5 +99,66 @@ private:
 	std::string cwd;
 
 	std::string full_path(const char *path);
+
+	// For the host's implementations, with the cache from its FsProxy.
+	// Each does nothing (or just fetches) when cache is null.
+
+	// From f_read(): reads btr bytes at the file's position through the cache, and moves the position past them.
+	// fetch(uint64_t offset, void *buff, unsigned btr, unsigned *br) reads from the file system at offset.
+	// E.g.: return cached_read(impl->cache.get(), fp, buff, btr, br, [&](uint64_t ofs, void *b, unsigned n, unsigned *r) {
+	//     ...
+	// });
+	template<typename Fetch>
+	FRESULT cached_read(BlockCache *cache, File *fp, void *buff, unsigned btr, unsigned *br, Fetch &&fetch) {
+		auto offset = f_tell(fp);
+		if (!cache) {
+			if (auto res = fetch(offset, buff, btr, br); res != FR_OK)
+				return res;
+			return f_lseek(fp, offset + *br);
+		}
+
+		auto num = cache->read(fp,
+							   offset,
+							   std::span{static_cast<std::byte *>(buff), btr},
+							   [&](uint64_t ofs, std::span<std::byte> dst) -> std::optional<size_t> {
+								   unsigned num_read = 0;
+								   if (fetch(ofs, dst.data(), unsigned(dst.size()), &num_read) != FR_OK)
+									   return std::nullopt;
+								   return num_read;
+							   });
+
+		*br = num ? unsigned(*num) : 0;
+		if (!num)
+			return FR_DISK_ERR;
+		return f_lseek(fp, offset + *num);
+	}
+
+	// From f_open() and f_close(), when they succeed
+	void cache_opened(BlockCache *cache, File *fp, const char *path) {
+		if (cache)
+			cache->open_file(fp, path, cwd);
+	}
+
+	void cache_closed(BlockCache *cache, File *fp) {
+		if (cache)
+			cache->close_file(fp);
+	}
+
+	// From f_write() (with the position before the write) and f_truncate()
+	void cache_wrote(BlockCache *cache, File *fp, uint64_t offset, unsigned size) {
+		if (cache)
+			cache->write(fp, offset, size);
+	}
+
+	void cache_truncated(BlockCache *cache, File *fp) {
+		if (cache)
+			cache->truncate(fp);
+	}
+
+	// From f_unlink() and f_rename() (both paths)
+	void cache_removed(BlockCache *cache, const char *path) {
+		if (cache)
+			cache->invalidate(path, cwd);
+	}
 };
 } // namespace MetaModule
@@ -0,0 +1,394 @@
+#define METAMODULE_ASYNC_POOL_THREADS 2
+#include "CoreModules/async_job.hh"
+#include "CoreModules/engine/async_thread_pool.hh"
+#include "CoreModules/engine/task_pool.hh"
+#include "doctest.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace MetaModule;
+
+namespace
+{
+
+struct FunctionTask : PoolTask {
+	std::function<void()> func;
+
+	FunctionTask(std::function<void()> func)
+		: func{std::move(func)} {
+	}
+
+	void run() override {
+		func();
+	}
+};
+
+void wait_for(std::atomic<bool> &flag) {
+	while (!flag.load())
+		std::this_thread::yield();
+}
+
+struct NullModule : CoreProcessor {
+	void update() override {
+	}
+	void set_samplerate(float sr) override {
+	}
+	void set_param(int param_id, float val) override {
+	}
+	void set_input(int input_id, float val) override {
+	}
+	float get_output(int output_id) const override {
+		return 0;
+	}
+};
+
+} // namespace
+
+TEST_CASE("Task pool runs higher priority tasks first") {
+	TaskPool pool{1};
+
+	std::atomic<bool> started = false;
+	std::atomic<bool> release = false;
+	std::atomic<bool> done = false;
+	std::mutex order_mutex;
+	std::vector<int> order;
+
+	auto record = [&](int id) {
+		std::lock_guard lock{order_mutex};
+		order.push_back(id);
+	};
+
+	// Keep the only worker busy while the others are queued
+	FunctionTask gate{[&] {
+		started = true;
+		wait_for(release);
+	}};
+	FunctionTask low{[&] { record(3); }};
+	FunctionTask normal{[&] { record(2); }};
+	FunctionTask high{[&] { record(1); }};
+	FunctionTask last{[&] { done = true; }};
+
+	REQUIRE(pool.submit(&gate));
+	wait_for(started);
+	pool.submit(&low, TaskPriority::Low);
+	pool.submit(&normal, TaskPriority::Normal);
+	pool.submit(&high, TaskPriority::High);
+	pool.submit(&last, TaskPriority::Low);
+	release = true;
+	wait_for(done);
+
+	CHECK(order == std::vector<int>{1, 2, 3});
+}
+
+TEST_CASE("Task pool gives lower priorities a turn when higher ones are always busy") {
+	// Declared before the pool, so they outlive its workers
+	std::atomic<bool> low_ran = false;
+	std::atomic<unsigned> high_runs = 0;
+	FunctionTask high{{}};
+	FunctionTask low{[&] { low_ran = true; }};
+
+	TaskPool pool{1};
+	high.func = [&] {
+		high_runs++;
+		if (!low_ran)
+			pool.submit(&high, TaskPriority::High);
+	};
+
+	REQUIRE(pool.submit(&high, TaskPriority::High));
+	REQUIRE(pool.submit(&low, TaskPriority::Low));
+
+	auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds{2};
+	while (!low_ran && std::chrono::steady_clock::now() < timeout)
+		std::this_thread::yield();
+
+	CHECK(low_ran);
+	CHECK(high_runs <= TaskPool::FairTurn * TaskPool::FairTurn);
+}
+
+TEST_CASE("Task pool runs every task, including spawned ones") {
+	TaskPool pool{3};
+	constexpr unsigned NumTasks = 200;
+
+	std::atomic<unsigned> count = 0;
+	std::vector<std::unique_ptr<FunctionTask>> children;
+	std::vector<std::unique_ptr<FunctionTask>> parents;
+	for (unsigned i = 0; i < NumTasks; i++) {
+		children.push_back(std::make_unique<FunctionTask>([&] { count++; }));
+		parents.push_back(std::make_unique<FunctionTask>([&, child = children.back().get()] {
+			CHECK(pool.on_worker_thread());
+			pool.spawn(child);
+			count++;
+		}));
+	}
+
+	for (auto &task : parents)
+		REQUIRE(pool.submit(task.get()));
+
+	while (count.load() < NumTasks * 2)
+		std::this_thread::yield();
+	CHECK_FALSE(pool.on_worker_thread());
+}
+
+TEST_CASE("AsyncThread on the shared pool") {
+	NullModule module;
+	std::atomic<unsigned> runs = 0;
+	std::atomic<unsigned> running = 0;
+	std::atomic<bool> overlapped = false;
+
+	AsyncThread thread{&module, [&] {
+		if (running.fetch_add(1) != 0)
+			overlapped = true;
+		runs++;
+		running.fetch_sub(1);
+	}};
+	CHECK_FALSE(thread.is_enabled());
+
+	thread.run_once();
+	while (runs.load() < 1)
+		std::this_thread::yield();
+
+	thread.set_priority(AsyncThread::Priority::High);
+	thread.start();
+	CHECK(thread.is_enabled());
+	while (runs.load() < 100) {
+		thread.run_once();
+		std::this_thread::yield();
+	}
+
+	thread.stop();
+	CHECK_FALSE(thread.is_enabled());
+	auto stopped_runs = runs.load();
+	std::this_thread::sleep_for(std::chrono::milliseconds{5});
+	CHECK(runs.load() == stopped_runs);
+	CHECK_FALSE(overlapped);
+
+	SUBCASE("An action can stop its own AsyncThread") {
+		std::atomic<unsigned> self_stopping_runs = 0;
+		AsyncThread self_stopping{&module};
+		self_stopping.start([&] {
+			if (++self_stopping_runs == 3)
+				self_stopping.stop();
+		});
+
+		while (self_stopping.is_enabled())
+			std::this_thread::yield();
+		self_stopping.stop();
+		CHECK(self_stopping_runs == 3);
+	}
+}
+
+TEST_CASE("Started AsyncThreads wait for their period, and don't starve each other") {
+	NullModule module;
+	std::atomic<unsigned> high_runs = 0;
+	std::atomic<unsigned> low_runs = 0;
+
+	AsyncThread high{&module, [&] { high_runs++; }};
+	AsyncThread low{&module, [&] { low_runs++; }};
+	high.set_priority(AsyncThread::Priority::High);
+	low.set_priority(AsyncThread::Priority::Low);
+	high.start();
+	low.start();
+
+	std::this_thread::sleep_for(AsyncThreadPeriod * 50);
+	high.stop();
+	low.stop();
+
+	CHECK(low_runs > 0);
+	// Re-queuing right away runs millions of times in 50 periods
+	CHECK(high_runs <= 60);
+	CHECK(low_runs <= 60);
+}
+
+TEST_CASE("AsyncThread stop() doesn't wait for a run that's only queued") {
+	NullModule module;
+	std::atomic<bool> release = false;
+	std::atomic<unsigned> num_blocked = 0;
+	std::atomic<unsigned> num_released = 0;
+	std::atomic<bool> ran = false;
+
+	// Keep every worker busy
+	std::vector<std::unique_ptr<FunctionTask>> blockers;
+	for (unsigned i = 0; i < async_task_pool().num_threads(); i++) {
+		blockers.push_back(std::make_unique<FunctionTask>([&] {
+			num_blocked++;
+			wait_for(release);
+			num_released++;
+		}));
+		REQUIRE(async_task_pool().submit(blockers.back().get(), TaskPriority::High));
+	}
+	while (num_blocked.load() < blockers.size())
+		std::this_thread::yield();
+
+	{
+		AsyncThread queued{&module, [&] { ran = true; }};
+		queued.set_priority(AsyncThread::Priority::Low);
+		queued.run_once();
+		queued.stop();
+		// Destroyed while still queued: the pool cleans it up when it gets to it
+	}
+
+	release = true;
+	while (num_released.load() < blockers.size())
+		std::this_thread::yield();
+	std::this_thread::sleep_for(std::chrono::milliseconds{5});
+	CHECK_FALSE(ran);
+}
+
+TEST_CASE("AsyncJob futures") {
+	NullModule module;
+	std::atomic<bool> release = false;
+
+	AsyncJob<int(int, int)> add{&module, [&](int a, int b) {
+		wait_for(release);
+		return a + b;
+	}};
+
+	CHECK_FALSE(AsyncFuture<int>{}.valid());
+
+	auto future = add.request(2, 3);
+	CHECK(future.valid());
+	CHECK(add.busy());
+
+	// Only one request at a time
+	CHECK_FALSE(add.request(4, 5).valid());
+	CHECK_FALSE(future.ready());
+	CHECK_FALSE(future.take());
+
+	release = true;
+	while (!future.ready())
+		std::this_thread::yield();
+	CHECK_FALSE(add.busy());
+	CHECK(future.take() == 5);
+	CHECK_FALSE(future.valid());
+
+	// A newer request's result never shows up in an older future
+	auto first = add.request(1, 1);
+	while (!first.ready())
+		std::this_thread::yield();
+	auto stale = first;
+	CHECK(first.take() == 2);
+
+	auto second = add.request(10, 20);
+	while (!second.ready())
+		std::this_thread::yield();
+	CHECK_FALSE(stale.ready());
+	CHECK(second.take() == 30);
+}
+
+TEST_CASE("AsyncJob coroutines co_await other jobs and coroutines") {
+	NullModule module;
+	std::atomic<unsigned> reads = 0;
+
+	AsyncJob<std::vector<int>(int)> read_block{&module, [&](int block) {
+		reads++;
+		return std::vector<int>{block, block + 1, block + 2};
+	}};
+	read_block.set_priority(AsyncThread::Priority::High);
+
+	auto decode = [](std::vector<int> data) -> AsyncCoroutine<int> {
+		int sum = 0;
+		for (auto x : data) {
+			sum += x;
+			co_await async_yield();
+		}
+		co_return sum;
+	};
+
+	AsyncJob<int(int)> load{&module, [&](int num_blocks) -> AsyncCoroutine<int> {
+		int total = 0;
+		for (int block = 0; block < num_blocks; block++) {
+			auto data = co_await read_block.request(block * 10);
+			total += co_await decode(std::move(*data));
+		}
+		co_return total;
+	}};
+
+	auto future = load.request(3);
+	REQUIRE(future.valid());
+	while (!future.ready())
+		std::this_thread::yield();
+
+	// (0+1+2) + (10+11+12) + (20+21+22)
+	CHECK(future.take() == 99);
+	CHECK(reads == 3);
+
+	// Coroutine jobs can be requested again
+	auto again = load.request(1);
+	while (!again.ready())
+		std::this_thread::yield();
+	CHECK(again.take() == 3);
+}
+
+TEST_CASE("co_await on a refused request gives nullopt instead of waiting") {
+	NullModule module;
+	std::atomic<bool> release = false;
+
+	AsyncJob<int(int)> busy{&module, [&](int x) {
+		wait_for(release);
+		return x;
+	}};
+
+	AsyncJob<int(int)> caller{&module, [&](int x) -> AsyncCoroutine<int> {
+		auto value = co_await busy.request(x);
+		co_return value ? *value : -1;
+	}};
+
+	auto first = busy.request(1);
+	REQUIRE(first.valid());
+
+	// busy is still running the first request, so the caller's request is refused
+	auto refused = caller.request(2);
+	while (!refused.ready())
+		std::this_thread::yield();
+	CHECK(refused.take() == -1);
+
+	release = true;
+	while (!first.ready())
+		std::this_thread::yield();
+	CHECK(first.take() == 1);
+
+	auto accepted = caller.request(3);
+	while (!accepted.ready())
+		std::this_thread::yield();
+	CHECK(accepted.take() == 3);
+}
+
+TEST_CASE("A job waiting for another job sleeps until that job wakes it") {
+	NullModule module;
+	std::atomic<int> delay_ms = 0;
+
+	AsyncJob<int(int)> slow{&module, [&](int x) {
+		std::this_thread::sleep_for(std::chrono::milliseconds{delay_ms.load()});
+		return x * 2;
+	}};
+
+	AsyncJob<int(int)> sum{&module, [&](int n) -> AsyncCoroutine<int> {
+		int total = 0;
+		for (int i = 0; i < n; i++)
+			total += *co_await slow.request(i);
+		co_return total;
+	}};
+
+	// Finishing right away or just after the waiting job subscribes: no wake is lost
+	auto many = sum.request(500);
+	REQUIRE(many.valid());
+	while (!many.ready())
+		std::this_thread::yield();
+	CHECK(many.take() == 500 * 499);
+
+	// A busy-polling waiter would use about as much CPU time as the awaited job takes
+	delay_ms = 50;
+	auto cpu_start = std::clock();
+	auto one = sum.request(1);
+	while (!one.ready())
+		std::this_thread::sleep_for(std::chrono::milliseconds{1});
+	auto cpu_ms = (std::clock() - cpu_start) * 1000 / CLOCKS_PER_SEC;
+
+	CHECK(one.take() == 0);
+	CHECK(cpu_ms < 25);
+}
@@ -0,0 +1,377 @@
+#define METAMODULE_ASYNC_POOL_THREADS 2
+#include "CoreModules/engine/async_thread_pool.hh"
+#include "doctest.h"
+#include "filesystem/audio_file_stream.hh"
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace MetaModule;
+
+// FatFS backed by files in memory (normally the host implements FatFS)
+namespace MetaModule
+{
+
+struct FsProxy {
+	std::map<std::string, std::vector<std::byte>> files;
+	std::map<File *, std::pair<std::vector<std::byte> *, uint64_t>> open_files;
+	std::atomic<bool> fail_reads{false};
+};
+
+} // namespace MetaModule
+
+namespace
+{
+
+FsProxy *test_fs = nullptr;
+
+} // namespace
+
+FatFS::FatFS(std::string_view root)
+	: impl{std::make_unique<FsProxy>()}
+	, root{root} {
+	test_fs = impl.get();
+}
+
+FatFS::~FatFS() = default;
+
+FRESULT FatFS::f_open(File *fp, const char *path, uint8_t) {
+	auto file = impl->files.find(path);
+	if (file == impl->files.end())
+		return FR_NO_FILE;
+	impl->open_files[fp] = {&file->second, 0};
+	return FR_OK;
+}
+
+FRESULT FatFS::f_close(File *fp) {
+	impl->open_files.erase(fp);
+	return FR_OK;
+}
+
+FRESULT FatFS::f_read(File *fp, void *buff, unsigned btr, unsigned *br) {
+	if (impl->fail_reads)
+		return FR_DISK_ERR;
+	auto &[data, pos] = impl->open_files.at(fp);
+	*br = std::min<uint64_t>(btr, data->size() - std::min<uint64_t>(pos, data->size()));
+	std::memcpy(buff, data->data() + pos, *br);
+	pos += *br;
+	return FR_OK;
+}
+
+FRESULT FatFS::f_lseek(File *fp, uint64_t ofs) {
+	impl->open_files.at(fp).second = ofs;
+	return FR_OK;
+}
+
+uint64_t FatFS::f_size(File *fp) {
+	return test_fs->open_files.at(fp).first->size();
+}
+
+namespace
+{
+
+struct NullModule : CoreProcessor {
+	void update() override {
+	}
+	void set_samplerate(float sr) override {
+	}
+	void set_param(int param_id, float val) override {
+	}
+	void set_input(int input_id, float val) override {
+	}
+	float get_output(int output_id) const override {
+		return 0;
+	}
+};
+
+struct ByteWriter {
+	std::vector<std::byte> bytes;
+	bool big_endian = false;
+
+	void id(const char *id) {
+		for (unsigned i = 0; i < 4; i++)
+			bytes.push_back(std::byte(id[i]));
+	}
+
+	void uint(uint32_t val, unsigned num_bytes) {
+		for (unsigned i = 0; i < num_bytes; i++) {
+			auto shift = big_endian ? (num_bytes - 1 - i) * 8 : i * 8;
+			bytes.push_back(shift < 32 ? std::byte(val >> shift) : std::byte{0});
+		}
+	}
+};
+
+// Sample i of a test file, as an int16
+int16_t test_sample(unsigned i) {
+	return int16_t(i * 37 - 20000);
+}
+
+std::vector<std::byte> make_wav(unsigned channels, unsigned num_frames, unsigned format_tag, unsigned bits) {
+	unsigned bytes = bits / 8;
+	ByteWriter w;
+	w.id("RIFF");
+	w.uint(0, 4);
+	w.id("WAVE");
+	w.id("junk");
+	w.uint(3, 4);
+	w.uint(0, 4); // 3 bytes, padded to 4
+
+	w.id("fmt ");
+	w.uint(format_tag == 0xFFFE ? 40 : 16, 4);
+	w.uint(format_tag, 2);
+	w.uint(channels, 2);
+	w.uint(44100, 4);
+	w.uint(44100 * channels * bytes, 4);
+	w.uint(channels * bytes, 2);
+	w.uint(bits, 2);
+	if (format_tag == 0xFFFE) {
+		w.uint(22, 2);
+		w.uint(bits, 2);
+		w.uint(0, 4);
+		w.uint(1, 2); // PCM sub-format
+		w.uint(0, 14);
+	}
+
+	w.id("data");
+	w.uint(channels * num_frames * bytes, 4);
+	for (unsigned i = 0; i < channels * num_frames; i++) {
+		if (bits == 32) {
+			float f = test_sample(i) / 32768.f;
+			uint32_t word;
+			std::memcpy(&word, &f, 4);
+			w.uint(word, 4);
+		} else
+			w.uint(bits >= 16 ? uint32_t(test_sample(i)) << (bits - 16) : uint32_t(test_sample(i)) >> (16 - bits), bytes);
+	}
+	return w.bytes;
+}
+
+std::vector<std::byte> make_aiff(unsigned channels, unsigned num_frames, const char *compression) {
+	ByteWriter w{.bytes = {}, .big_endian = true};
+	w.id("FORM");
+	w.uint(0, 4);
+	w.id(compression ? "AIFC" : "AIFF");
+
+	w.id("COMM");
+	w.uint(compression ? 22 : 18, 4);
+	w.uint(channels, 2);
+	w.uint(num_frames, 4);
+	w.uint(16, 2);
+	// 48000 as an 80-bit extended float
+	w.uint(0x400E, 2);
+	w.uint(0xBB800000, 4);
+	w.uint(0, 4);
+	if (compression)
+		w.id(compression);
+
+	w.id("SSND");
+	w.uint(8 + 4 + channels * num_frames * 2, 4);
+	w.uint(4, 4); // offset
+	w.uint(0, 4);
+	w.uint(0, 4);
+
+	w.big_endian = !(compression && std::string_view{compression} == "sowt");
+	for (unsigned i = 0; i < channels * num_frames; i++)
+		w.uint(uint16_t(test_sample(i)), 2);
+	return w.bytes;
+}
+
+std::optional<AudioFileInfo> parse(std::vector<std::byte> const &file) {
+	return parse_audio_file_header(
+		[&](uint64_t offset, std::span<std::byte> buffer) {
+			auto num = std::min<size_t>(buffer.size(), file.size() - std::min<size_t>(offset, file.size()));
+			std::memcpy(buffer.data(), file.data() + offset, num);
+			return num;
+		},
+		file.size());
+}
+
+} // namespace
+
+TEST_CASE("Sample conversion matches the scalar conversion") {
+	using namespace SampleConvert;
+
+	std::vector<std::byte> raw(4 * 101 + 1);
+	uint32_t seed = 1;
+	for (auto &b : raw) {
+		seed = seed * 1664525 + 1013904223;
+		b = std::byte(seed >> 24);
+	}
+
+	std::array<float, 101> out;
+	for (auto format : {SampleFormat::Int16, SampleFormat::Int24, SampleFormat::Float32}) {
+		for (auto order : {ByteOrder::Little, ByteOrder::Big}) {
+			auto size = bytes_per_sample(format);
+			// Unaligned, and an odd number of samples so the SIMD loops have a tail
+			auto in = std::span<const std::byte>{raw}.subspan(1, out.size() * size);
+			CHECK(to_float(format, order, in, out) == out.size());
+
+			unsigned errors = 0;
+			for (unsigned i = 0; i < out.size(); i++) {
+				auto sample = &in[i * size];
+				auto expected = format == SampleFormat::Int16 ? int16_to_float(sample, order) :
+								format == SampleFormat::Int24 ? int24_to_float(sample, order) :
+																float32_to_float(sample, order);
+				errors += std::memcmp(&expected, &out[i], 4) != 0;
+			}
+			CHECK(errors == 0);
+		}
+	}
+
+	std::array<std::byte, 3> min24{std::byte{0}, std::byte{0}, std::byte{0x80}};
+	std::array<std::byte, 2> max16{std::byte{0x7F}, std::byte{0xFF}};
+	CHECK(int24_to_float(min24.data(), ByteOrder::Little) == -1.f);
+	CHECK(int16_to_float(max16.data(), ByteOrder::Big) == 32767 / 32768.f);
+}
+
+TEST_CASE("Audio file headers") {
+	using SampleConvert::ByteOrder;
+	using SampleConvert::SampleFormat;
+
+	auto wav = parse(make_wav(2, 100, 1, 16));
+	REQUIRE(wav);
+	CHECK(wav->format == SampleFormat::Int16);
+	CHECK(wav->byte_order == ByteOrder::Little);
+	CHECK(wav->num_channels == 2);
+	CHECK(wav->sample_rate == 44100);
+	CHECK(wav->num_frames == 100);
+	CHECK(wav->data_offset == 12 + 12 + 24 + 8);
+
+	auto extensible = parse(make_wav(1, 10, 0xFFFE, 24));
+	REQUIRE(extensible);
+	CHECK(extensible->format == SampleFormat::Int24);
+	CHECK(extensible->num_frames == 10);
+
+	auto wav_float = parse(make_wav(1, 10, 3, 32));
+	REQUIRE(wav_float);
+	CHECK(wav_float->format == SampleFormat::Float32);
+
+	auto aiff = parse(make_aiff(2, 50, nullptr));
+	REQUIRE(aiff);
+	CHECK(aiff->format == SampleFormat::Int16);
+	CHECK(aiff->byte_order == ByteOrder::Big);
+	CHECK(aiff->sample_rate == 48000);
+	CHECK(aiff->num_frames == 50);
+	CHECK(aiff->data_offset == 12 + 26 + 16 + 4);
+
+	auto sowt = parse(make_aiff(1, 50, "sowt"));
+	REQUIRE(sowt);
+	CHECK(sowt->byte_order == ByteOrder::Little);
+
+	// Unsupported or truncated
+	CHECK_FALSE(parse(make_wav(1, 10, 1, 8)));
+	CHECK_FALSE(parse(make_aiff(1, 10, "ulaw")));
+	auto truncated = make_wav(2, 100, 1, 16);
+	truncated.resize(30);
+	CHECK_FALSE(parse(truncated));
+
+	// Frames are limited to the data actually in the file
+	auto short_file = make_wav(2, 100, 1, 16);
+	short_file.resize(short_file.size() - 41);
+	CHECK(parse(short_file)->num_frames == 89);
+}
+
+TEST_CASE("Streaming an audio file") {
+	NullModule module;
+	FatFS fs;
+	constexpr unsigned NumFrames = 20000;
+	test_fs->files["stereo.wav"] = make_wav(2, NumFrames, 1, 16);
+
+	BasicAudioFileStream<1024> stream{&module, fs};
+	CHECK(stream.status() == AudioFileStatus::Closed);
+
+	std::array<float, 64> block;
+	auto read_block = [&] {
+		size_t num = 0;
+		while (num == 0 && !stream.at_end()) {
+			num = stream.read(block);
+			if (num == 0)
+				std::this_thread::yield();
+		}
+		return num;
+	};
+
+	REQUIRE(stream.open("stereo.wav"));
+	unsigned i = 0;
+	unsigned errors = 0;
+	while (auto num = read_block()) {
+		CHECK(num % 2 == 0);
+		for (unsigned k = 0; k < num; k++)
+			errors += block[k] != test_sample(i++) / 32768.f;
+	}
+	CHECK(errors == 0);
+	CHECK(i == NumFrames * 2);
+	CHECK(stream.at_end());
+	CHECK(stream.position() == NumFrames);
+	CHECK(stream.info().num_channels == 2);
+
+	// Seeking drops the samples already in the ring
+	stream.seek(1000);
+	CHECK(stream.status() != AudioFileStatus::Closed);
+	REQUIRE(read_block() > 0);
+	CHECK(block[0] == test_sample(2000) / 32768.f);
+	CHECK(block[1] == test_sample(2001) / 32768.f);
+
+	stream.seek(NumFrames - 1);
+	REQUIRE(read_block() == 2);
+	CHECK(block[0] == test_sample(NumFrames * 2 - 2) / 32768.f);
+
+	REQUIRE(stream.open("missing.wav"));
+	while (stream.status() == AudioFileStatus::Loading)
+		std::this_thread::yield();
+	CHECK(stream.status() == AudioFileStatus::Error);
+	CHECK(stream.read(block) == 0);
+
+	REQUIRE(stream.close());
+	while (stream.status() == AudioFileStatus::Loading)
+		std::this_thread::yield();
+	CHECK(stream.status() == AudioFileStatus::Closed);
+}
+
+TEST_CASE("Streaming reads whole frames when frames don't divide the ring") {
+	NullModule module;
+	FatFS fs;
+	constexpr unsigned NumFrames = 30000;
+	test_fs->files["three.wav"] = make_wav(3, NumFrames, 1, 16);
+
+	// 1024 isn't a multiple of 3, so pushes wrap around the ring in the middle of a frame
+	BasicAudioFileStream<1024> stream{&module, fs};
+	REQUIRE(stream.open("three.wav"));
+
+	std::array<float, 64> block;
+	unsigned i = 0;
+	unsigned errors = 0;
+	unsigned partial_frames = 0;
+	while (!stream.at_end() && stream.status() != AudioFileStatus::Error) {
+		auto num = stream.read(block);
+		partial_frames += num % 3 != 0;
+		for (unsigned k = 0; k < num; k++)
+			errors += block[k] != test_sample(i++) / 32768.f;
+	}
+	CHECK(partial_frames == 0);
+	CHECK(errors == 0);
+	CHECK(i == NumFrames * 3);
+	CHECK(stream.position() == NumFrames);
+
+	SUBCASE("A read error is an error, not the end of the file") {
+		test_fs->fail_reads = true;
+		stream.seek(0);
+		while (stream.status() == AudioFileStatus::Loading || stream.status() == AudioFileStatus::Streaming)
+			std::this_thread::yield();
+		CHECK(stream.status() == AudioFileStatus::Error);
+		CHECK_FALSE(stream.at_end());
+		CHECK(stream.read(block) == 0);
+
+		// Seeking tries again
+		test_fs->fail_reads = false;
+		stream.seek(10);
+		size_t num = 0;
+		while (num == 0 && stream.status() != AudioFileStatus::Error)
+			num = stream.read(block);
+		REQUIRE(num > 0);
+		CHECK(block[0] == test_sample(30) / 32768.f);
+	}
+}
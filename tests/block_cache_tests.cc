@@ -0,0 +1,332 @@
+#include "doctest.h"
+#include "filesystem/block_cache.hh"
+#include "filesystem/fatfs_adaptor.hh"
+#include <array>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace MetaModule;
+
+// A host's FatFS, backed by files in memory, which passes reads through the block cache
+namespace MetaModule
+{
+
+struct FsProxy {
+	std::map<std::string, std::vector<std::byte>> files;
+	std::map<File *, std::vector<std::byte> *> open_files;
+	std::unique_ptr<BlockCache> cache;
+	unsigned num_fetches = 0;
+};
+
+} // namespace MetaModule
+
+namespace
+{
+
+FsProxy *test_fs = nullptr;
+
+} // namespace
+
+FatFS::FatFS(std::string_view root)
+	: impl{std::make_unique<FsProxy>()}
+	, root{root}
+	, cwd{"/root"} {
+	test_fs = impl.get();
+}
+
+FatFS::~FatFS() = default;
+
+FRESULT FatFS::f_open(File *fp, const char *path, uint8_t) {
+	auto file = impl->files.find(BlockCache::normalize_path(path, cwd));
+	if (file == impl->files.end())
+		return FR_NO_FILE;
+	impl->open_files[fp] = &file->second;
+	fp->fptr = 0;
+	cache_opened(impl->cache.get(), fp, path);
+	return FR_OK;
+}
+
+FRESULT FatFS::f_close(File *fp) {
+	impl->open_files.erase(fp);
+	cache_closed(impl->cache.get(), fp);
+	return FR_OK;
+}
+
+FRESULT FatFS::f_read(File *fp, void *buff, unsigned btr, unsigned *br) {
+	auto &data = *impl->open_files.at(fp);
+	return cached_read(impl->cache.get(), fp, buff, btr, br, [&](uint64_t ofs, void *dst, unsigned num, unsigned *num_read) {
+		impl->num_fetches++;
+		*num_read = std::min<uint64_t>(num, data.size() - std::min<uint64_t>(ofs, data.size()));
+		std::memcpy(dst, data.data() + ofs, *num_read);
+		return FR_OK;
+	});
+}
+
+FRESULT FatFS::f_write(File *fp, const void *buff, unsigned btw, unsigned *bw) {
+	auto &data = *impl->open_files.at(fp);
+	data.resize(std::max<size_t>(data.size(), fp->fptr + btw));
+	std::memcpy(data.data() + fp->fptr, buff, btw);
+	cache_wrote(impl->cache.get(), fp, fp->fptr, btw);
+	fp->fptr += btw;
+	*bw = btw;
+	return FR_OK;
+}
+
+FRESULT FatFS::f_unlink(const char *path) {
+	impl->files.erase(BlockCache::normalize_path(path, cwd));
+	cache_removed(impl->cache.get(), path);
+	return FR_OK;
+}
+
+FRESULT FatFS::f_lseek(File *fp, uint64_t ofs) {
+	fp->fptr = ofs;
+	return FR_OK;
+}
+
+uint64_t FatFS::f_tell(File *fp) {
+	return fp->fptr;
+}
+
+void FatFS::enable_block_cache(BlockCacheConfig config) {
+	impl->cache = std::make_unique<BlockCache>(config);
+}
+
+void FatFS::disable_block_cache() {
+	impl->cache.reset();
+}
+
+BlockCacheStats FatFS::block_cache_stats() const {
+	return impl->cache ? impl->cache->stats() : BlockCacheStats{};
+}
+
+void FatFS::reset_block_cache_stats() {
+	if (impl->cache)
+		impl->cache->reset_stats();
+}
+
+namespace
+{
+
+struct MemoryFile {
+	std::vector<std::byte> bytes;
+	unsigned num_fetches = 0;
+	bool fail = false;
+
+	explicit MemoryFile(size_t size, uint8_t seed = 0)
+		: bytes(size) {
+		for (size_t i = 0; i < size; i++)
+			bytes[i] = std::byte(i * 7 + seed);
+	}
+
+	auto fetcher() {
+		return [this](uint64_t offset, std::span<std::byte> dst) -> std::optional<size_t> {
+			num_fetches++;
+			if (fail)
+				return std::nullopt;
+			auto num = std::min<size_t>(dst.size(), bytes.size() - std::min<size_t>(offset, bytes.size()));
+			std::memcpy(dst.data(), bytes.data() + offset, num);
+			return num;
+		};
+	}
+
+	bool matches(uint64_t offset, std::span<const std::byte> data) const {
+		return std::memcmp(bytes.data() + offset, data.data(), data.size()) == 0;
+	}
+};
+
+} // namespace
+
+TEST_CASE("Block cache turns small sequential reads into a few block reads") {
+	MemoryFile file{10000};
+	BlockCache cache{{.block_size = 512, .num_blocks = 8, .max_read_ahead = 4}};
+	int handle;
+	cache.open_file(&handle, "/a.txt");
+
+	std::array<std::byte, 16> buf;
+	uint64_t pos = 0;
+	unsigned errors = 0;
+	while (auto num = cache.read(&handle, pos, buf, file.fetcher())) {
+		if (*num == 0)
+			break;
+		errors += !file.matches(pos, std::span{buf}.first(*num));
+		pos += *num;
+	}
+	CHECK(errors == 0);
+	CHECK(pos == file.bytes.size());
+
+	// 20 blocks, fetched 2, 3, 5, 5 and 5 at a time (the last fetch is short)
+	auto &stats = cache.stats();
+	CHECK(file.num_fetches == 5);
+	CHECK(stats.fetches == 5);
+	CHECK(stats.misses == 5);
+	CHECK(stats.read_ahead == 15);
+	CHECK(stats.hits > 600);
+
+	cache.reset_stats();
+	CHECK(cache.stats().hits == 0);
+
+	SUBCASE("Random reads don't read ahead") {
+		cache.read(&handle, 100, buf, file.fetcher());
+		cache.read(&handle, 5000, buf, file.fetcher());
+		cache.read(&handle, 300, buf, file.fetcher());
+		CHECK(cache.stats().read_ahead == 0);
+	}
+
+	SUBCASE("Reads of a block or more skip the cache") {
+		std::vector<std::byte> big(2000);
+		CHECK(cache.read(&handle, 1000, big, file.fetcher()) == big.size());
+		CHECK(file.matches(1000, big));
+		CHECK(cache.stats().bypassed == 1);
+	}
+}
+
+TEST_CASE("Block cache evicts the least recently used block") {
+	MemoryFile file{4096};
+	BlockCache cache{{.block_size = 256, .num_blocks = 2, .max_read_ahead = 0}};
+	int handle;
+	cache.open_file(&handle, "/b.bin");
+
+	std::array<std::byte, 8> buf;
+	cache.read(&handle, 0, buf, file.fetcher());
+	cache.read(&handle, 256, buf, file.fetcher());
+	cache.read(&handle, 8, buf, file.fetcher());
+	CHECK(cache.stats().hits == 1);
+
+	// Block 1 is the least recently used, so block 2 replaces it
+	cache.read(&handle, 512, buf, file.fetcher());
+	cache.read(&handle, 16, buf, file.fetcher());
+	CHECK(cache.stats().hits == 2);
+	cache.read(&handle, 264, buf, file.fetcher());
+	CHECK(cache.stats().misses == 4);
+}
+
+TEST_CASE("Block cache is invalidated by writes, truncates and unlinks") {
+	MemoryFile file{2000};
+	BlockCache cache{{.block_size = 512, .num_blocks = 8, .max_read_ahead = 4}};
+	int reader;
+	int writer;
+	cache.open_file(&reader, "/c.wav");
+	cache.open_file(&writer, "/c.wav");
+
+	std::array<std::byte, 32> buf;
+	auto read = [&](uint64_t offset) {
+		auto num = cache.read(&reader, offset, buf, file.fetcher());
+		if (!num || *num == 0)
+			return size_t{0};
+		return file.matches(offset, std::span{buf}.first(*num)) ? *num : 0;
+	};
+
+	for (uint64_t pos = 0; pos < 2000; pos += 32)
+		read(pos);
+	CHECK(read(1990) == 10);
+
+	// A write through another handle to the same path
+	std::memset(file.bytes.data() + 700, 0xAA, 10);
+	cache.write(&writer, 700, 10);
+	CHECK(read(690) == 32);
+	CHECK(read(100) == 32);
+	CHECK(cache.stats().invalidated == 2); // The written block, and the short block at the end
+
+	// Appending
+	file.bytes.resize(3000, std::byte{0x55});
+	cache.write(&writer, 2000, 1000);
+	CHECK(read(1990) == 32);
+
+	file.bytes.resize(600);
+	cache.truncate(&writer);
+	CHECK(read(590) == 10);
+	CHECK(read(700) == 0);
+
+	// Unlinked and replaced by another file
+	file = MemoryFile{1000, 3};
+	cache.invalidate("/c.wav");
+	CHECK(read(0) == 32);
+
+	cache.close_file(&reader);
+	cache.close_file(&writer);
+
+	SUBCASE("Fetch errors are returned") {
+		int handle;
+		cache.open_file(&handle, "/d.wav");
+		file.fail = true;
+		CHECK_FALSE(cache.read(&handle, 0, buf, file.fetcher()));
+	}
+}
+
+TEST_CASE("Block cache keys different spellings of a path as the same file") {
+	CHECK(BlockCache::normalize_path("x", "/root") == "/root/x");
+	CHECK(BlockCache::normalize_path("./x", "/root") == "/root/x");
+	CHECK(BlockCache::normalize_path("/root/x", "/other") == "/root/x");
+	CHECK(BlockCache::normalize_path("a/../x/", "/root/") == "/root/x");
+	CHECK(BlockCache::normalize_path("//root///x") == "/root/x");
+	CHECK(BlockCache::normalize_path("../..", "/root") == "/");
+	CHECK(BlockCache::normalize_path("sdc:/x", "/root") == "/sdc:/x");
+
+	MemoryFile file{2000};
+	BlockCache cache{{.block_size = 512, .num_blocks = 4, .max_read_ahead = 0}};
+	int reader;
+	int writer;
+	cache.open_file(&reader, "x", "/root");
+	cache.open_file(&writer, "./x", "/root");
+
+	std::array<std::byte, 16> buf;
+	cache.read(&reader, 0, buf, file.fetcher());
+	cache.write(&writer, 0, 1);
+	CHECK(cache.stats().invalidated == 1);
+
+	cache.read(&reader, 0, buf, file.fetcher());
+	cache.invalidate("/root/x");
+	CHECK(cache.stats().invalidated == 2);
+}
+
+TEST_CASE("FatFS reads go through the block cache when it's enabled") {
+	FatFS fs;
+	std::vector<std::byte> contents(3000);
+	for (size_t i = 0; i < contents.size(); i++)
+		contents[i] = std::byte(i * 13);
+	test_fs->files["/root/data.bin"] = contents;
+
+	auto read_all = [&](File &file) {
+		std::vector<std::byte> out;
+		std::array<std::byte, 10> buf;
+		unsigned num = 0;
+		while (fs.f_read(&file, buf.data(), buf.size(), &num) == FR_OK && num)
+			out.insert(out.end(), buf.begin(), buf.begin() + num);
+		return out;
+	};
+
+	File file{};
+	REQUIRE(fs.f_open(&file, "data.bin", FA_READ) == FR_OK);
+	CHECK(read_all(file) == contents);
+	CHECK(test_fs->num_fetches > 300);
+	fs.f_close(&file);
+
+	fs.enable_block_cache({.block_size = 512, .num_blocks = 8, .max_read_ahead = 4});
+	test_fs->num_fetches = 0;
+	REQUIRE(fs.f_open(&file, "./data.bin", FA_READ) == FR_OK);
+	CHECK(read_all(file) == contents);
+	CHECK(test_fs->num_fetches < 10);
+	CHECK(fs.block_cache_stats().hits > 250);
+
+	// A write through another handle, by another spelling of the path, is seen by the reader
+	File writer{};
+	REQUIRE(fs.f_open(&writer, "/root/data.bin", FA_WRITE) == FR_OK);
+	std::byte changed{0xEE};
+	unsigned num = 0;
+	fs.f_lseek(&writer, 5);
+	fs.f_write(&writer, &changed, 1, &num);
+	contents[5] = changed;
+
+	fs.f_lseek(&file, 0);
+	CHECK(read_all(file) == contents);
+	CHECK(fs.block_cache_stats().invalidated > 0);
+
+	fs.f_close(&writer);
+	fs.f_close(&file);
+	CHECK(fs.f_unlink("data.bin") == FR_OK);
+}
@@ -0,0 +1,342 @@
+#include "CoreModules/CoreProcessor.hh"
+#include "CoreModules/async_display.hh"
+#include "CoreModules/canvas.hh"
+#include "CoreModules/dirty_rect.hh"
+#include "CoreModules/pixel_convert.hh"
+#include "doctest.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace MetaModule;
+
+TEST_CASE("Dirty rects") {
+	DirtyRect a{10, 10, 5, 5};
+
+	CHECK(a.touches({15, 10, 5, 5}));
+	CHECK_FALSE(a.touches({16, 10, 5, 5}));
+	CHECK(a.merged({20, 0, 5, 5}) == DirtyRect{10, 0, 15, 15});
+	CHECK(a.merged({}) == a);
+
+	CHECK(DirtyRect::whole_display().clipped(240, 160) == DirtyRect{0, 0, 240, 160});
+	CHECK(a.clipped(12, 100) == DirtyRect{10, 10, 2, 5});
+	CHECK(a.clipped(10, 100).empty());
+}
+
+TEST_CASE("Dirty region merges touching rects") {
+	DirtyRegion<4> region;
+	CHECK(region.empty());
+
+	region.add({0, 0, 10, 10});
+	region.add({100, 0, 10, 10});
+	CHECK(region.size() == 2);
+
+	// Touches both, so all three become one
+	region.add({10, 0, 90, 2});
+	REQUIRE(region.size() == 1);
+	CHECK(region.rects_view()[0] == DirtyRect{0, 0, 110, 10});
+
+	region.add({});
+	CHECK(region.size() == 1);
+}
+
+TEST_CASE("Dirty region merges the closest rects when full") {
+	DirtyRegion<2> region;
+	region.add({0, 0, 4, 4});
+	region.add({100, 100, 4, 4});
+	region.add({6, 0, 4, 4});
+	REQUIRE(region.size() == 2);
+	CHECK(region.rects_view()[0] == DirtyRect{0, 0, 10, 4});
+	CHECK(region.rects_view()[1] == DirtyRect{100, 100, 4, 4});
+
+	SUBCASE("take() merges to fit the output") {
+		std::array<DirtyRect, 1> out;
+		REQUIRE(region.take(out) == 1);
+		CHECK(out[0] == DirtyRect{0, 0, 104, 104});
+		CHECK(region.empty());
+	}
+
+	SUBCASE("take() writes all rects that fit") {
+		std::array<DirtyRect, 4> out;
+		CHECK(region.take(out) == 2);
+		CHECK(region.take(out) == 0);
+	}
+}
+
+struct DrawsWholeDisplay : CoreProcessor {
+	void update() override {
+	}
+	void set_samplerate(float) override {
+	}
+	void set_param(int, float) override {
+	}
+	void set_input(int, float) override {
+	}
+	float get_output(int) const override {
+		return 0;
+	}
+
+	bool changed = false;
+	bool draw_graphic_display(int) override {
+		return changed;
+	}
+};
+
+TEST_CASE("Default draw_graphic_display_rects() marks the whole display") {
+	DrawsWholeDisplay module;
+	std::array<DirtyRect, 4> rects;
+
+	CHECK(module.draw_graphic_display_rects(0, rects) == 0);
+
+	module.changed = true;
+	REQUIRE(module.draw_graphic_display_rects(0, rects) == 1);
+	CHECK(rects[0] == DirtyRect::whole_display());
+}
+
+namespace
+{
+
+std::vector<uint32_t> random_pixels(size_t size, uint32_t seed) {
+	std::vector<uint32_t> pixels(size);
+	for (auto &px : pixels) {
+		seed = seed * 1664525 + 1013904223;
+		px = seed;
+	}
+	return pixels;
+}
+
+} // namespace
+
+TEST_CASE("Canvas blending matches the scalar blend") {
+	// Odd sizes, so the vector loops and the scalar tails are both used
+	for (size_t size : {1u, 3u, 4u, 17u, 33u, 100u}) {
+		auto dst = random_pixels(size, 1);
+		auto src = random_pixels(size, 2);
+		src[0] |= 0xFF000000; // opaque
+		src[size - 1] &= 0x00FFFFFF; // transparent
+
+		auto expected = dst;
+		for (size_t i = 0; i < size; i++)
+			expected[i] = CanvasOps::blend(dst[i], src[i], CanvasOps::alpha(src[i]));
+
+		auto blended = dst;
+		CanvasOps::blend_copy(blended.data(), src.data(), size);
+		CHECK(blended == expected);
+
+		for (uint32_t color : {0x80406080u, 0x00FFFFFFu, 0xFF102030u, 0x01FF00FFu}) {
+			for (size_t i = 0; i < size; i++)
+				expected[i] = CanvasOps::blend(dst[i], color, CanvasOps::alpha(color));
+			blended = dst;
+			CanvasOps::blend_fill(blended.data(), size, color);
+			CHECK(blended == expected);
+		}
+	}
+
+	CHECK(CanvasOps::blend(0xFF000000, 0x80FFFFFF, 0x80) == 0xFF808080);
+	CHECK(CanvasOps::blend(0x00000000, 0x80FFFFFF, 0x80) == 0x80808080);
+}
+
+TEST_CASE("Canvas drawing is clipped to the buffer") {
+	std::vector<uint32_t> pixels(10 * 8);
+	Canvas canvas{pixels, 10};
+	CHECK(canvas.height() == 8);
+
+	DirtyRegion<> dirty;
+	canvas.track_dirty(&dirty);
+
+	canvas.fill_rect(-5, 6, 8, 10, 0xFF0000FF);
+	CHECK(canvas.get_pixel(0, 6) == 0xFF0000FF);
+	CHECK(canvas.get_pixel(2, 7) == 0xFF0000FF);
+	CHECK(canvas.get_pixel(3, 7) == 0);
+	CHECK(canvas.get_pixel(2, 5) == 0);
+	REQUIRE(dirty.size() == 1);
+	CHECK(dirty.rects_view()[0] == DirtyRect{0, 6, 3, 2});
+
+	canvas.fill_rect(20, 0, 5, 5, 0xFFFFFFFF);
+	CHECK(dirty.size() == 1);
+
+	canvas.vline(9, -1, 3, 0xFF00FF00);
+	CHECK(canvas.get_pixel(9, 0) == 0xFF00FF00);
+	CHECK(canvas.get_pixel(9, 1) == 0xFF00FF00);
+	CHECK(canvas.get_pixel(9, 2) == 0);
+
+	SUBCASE("Blit with clipping") {
+		std::array<uint32_t, 6> image{1, 2, 3, 4, 5, 6}; // 3x2
+		canvas.blit(image, 3, -1, 7);
+		CHECK(canvas.get_pixel(0, 7) == 2);
+		CHECK(canvas.get_pixel(1, 7) == 3);
+		CHECK(canvas.get_pixel(2, 7) == 0xFF0000FF);
+	}
+}
+
+TEST_CASE("Canvas lines and gradients") {
+	std::vector<uint32_t> pixels(16 * 16);
+	Canvas canvas{pixels, 16};
+
+	canvas.line(1, 1, 10, 4, 0xFFFFFFFF);
+	CHECK(canvas.get_pixel(1, 1) == 0xFFFFFFFF);
+	CHECK(canvas.get_pixel(10, 4) == 0xFFFFFFFF);
+	CHECK(std::ranges::count(pixels, 0xFFFFFFFF) == 10);
+
+	canvas.clear();
+	canvas.line_aa(0.f, 0.f, 15.f, 15.f, 0xFFFFFFFF);
+	CHECK(canvas.get_pixel(0, 0) != 0);
+	CHECK(canvas.get_pixel(8, 8) == 0xFFFFFFFF);
+	CHECK(canvas.get_pixel(15, 0) == 0);
+
+	canvas.fill_gradient(-4, 0, 20, 2, 0xFF000000, 0xFF000013, Canvas::Gradient::Horizontal);
+	CHECK(canvas.get_pixel(0, 0) == 0xFF000004);
+	CHECK(canvas.get_pixel(15, 1) == 0xFF000013);
+
+	canvas.fill_gradient(0, 0, 16, 16, 0xFFFF0000, 0xFF0000FF, Canvas::Gradient::Vertical);
+	CHECK(canvas.get_pixel(7, 0) == 0xFFFF0000);
+	CHECK(canvas.get_pixel(7, 15) == 0xFF0000FF);
+}
+
+TEST_CASE("RGB565 conversion") {
+	CHECK(PixelConvert::to_rgba(0xFFFF) == 0xFFFFFFFF);
+	CHECK(PixelConvert::to_rgba(0x0000) == 0xFF000000);
+	CHECK(PixelConvert::to_rgba(0xF800) == 0xFFFF0000);
+	CHECK(PixelConvert::to_rgb565(0x80FF8040) == 0xFC08);
+
+	// Every RGB565 value survives a round trip, through the vector loops and the scalar tail
+	std::vector<uint16_t> all(0x10000 + 3);
+	for (size_t i = 0; i < all.size(); i++)
+		all[i] = uint16_t(i);
+
+	std::vector<uint32_t> rgba(all.size());
+	CHECK(PixelConvert::to_rgba(all, rgba) == all.size());
+	CHECK(rgba[0x1234] == PixelConvert::to_rgba(0x1234));
+	CHECK(rgba[all.size() - 1] == PixelConvert::to_rgba(2));
+
+	std::vector<uint16_t> back(all.size());
+	CHECK(PixelConvert::to_rgb565(rgba, back) == all.size());
+	CHECK(back == all);
+
+	SUBCASE("RGBA8888 to RGB565 matches the scalar conversion") {
+		auto pixels = random_pixels(101, 3);
+		std::vector<uint16_t> converted(pixels.size());
+		PixelConvert::to_rgb565(pixels, converted);
+		for (size_t i = 0; i < pixels.size(); i++)
+			CHECK(converted[i] == PixelConvert::to_rgb565(pixels[i]));
+	}
+
+	SUBCASE("Converts as many pixels as fit") {
+		std::array<uint32_t, 2> out{};
+		CHECK(PixelConvert::to_rgba(all, out) == 2);
+	}
+}
+
+TEST_CASE("RGB565 canvas") {
+	std::vector<uint16_t> pixels(12 * 4);
+	Canvas565 canvas{pixels, 12};
+
+	canvas.fill_rect(1, 1, 10, 2, 0xF800);
+	CHECK(canvas.get_pixel(0, 1) == 0);
+	CHECK(canvas.get_pixel(1, 1) == 0xF800);
+	CHECK(canvas.get_pixel(10, 2) == 0xF800);
+	CHECK(canvas.get_pixel(11, 2) == 0);
+
+	canvas.fill_gradient(0, 0, 12, 1, 0x0000, 0xFFFF, Canvas565::Gradient::Horizontal);
+	CHECK(canvas.get_pixel(0, 0) == 0x0000);
+	CHECK(canvas.get_pixel(11, 0) == 0xFFFF);
+
+	canvas.line(0, 3, 11, 3, 0x07E0);
+	CHECK(std::ranges::count(pixels, 0x07E0) == 12);
+}
+
+TEST_CASE("Triple buffer") {
+	TripleBuffer<int> buffer{0};
+	CHECK_FALSE(buffer.acquire());
+
+	buffer.back() = 1;
+	buffer.publish();
+	buffer.back() = 2;
+	buffer.publish();
+
+	// Only the newest value is read
+	CHECK(buffer.acquire());
+	CHECK(buffer.front() == 2);
+	CHECK_FALSE(buffer.acquire());
+	CHECK(buffer.front() == 2);
+
+	buffer.back() = 3;
+	CHECK(buffer.front() == 2);
+	buffer.publish();
+	CHECK(buffer.acquire());
+	CHECK(buffer.front() == 3);
+}
+
+TEST_CASE("Async display frames are never torn") {
+	std::vector<uint32_t> pix_buffer(32 * 16);
+	AsyncDisplay display;
+	CHECK_FALSE(display.draw());
+	CHECK_FALSE(display.render([](Canvas &) {}));
+
+	display.show(pix_buffer, 32);
+
+	constexpr uint32_t NumFrames = 20'000;
+	std::thread render_thread{[&] {
+		for (uint32_t frame = 1; frame <= NumFrames; frame++) {
+			display.render([frame](Canvas &canvas) {
+				CHECK(canvas.width() == 32);
+				canvas.clear(frame);
+			});
+			std::this_thread::yield();
+		}
+	}};
+
+	uint32_t last_frame = 0;
+	bool all_whole = true;
+	bool in_order = true;
+	while (last_frame < NumFrames) {
+		if (!display.draw()) {
+			std::this_thread::yield();
+			continue;
+		}
+		auto frame = pix_buffer[0];
+		all_whole = all_whole && std::ranges::all_of(pix_buffer, [=](uint32_t px) { return px == frame; });
+		in_order = in_order && frame > last_frame;
+		last_frame = frame;
+	}
+	render_thread.join();
+
+	CHECK(all_whole);
+	CHECK(in_order);
+
+	display.hide();
+	CHECK_FALSE(display.render([](Canvas &) {}));
+}
+
+TEST_CASE("Async display resizing waits for the render in progress") {
+	std::vector<uint32_t> small(16 * 8);
+	std::vector<uint32_t> large(32 * 16);
+	AsyncDisplay display;
+	display.show(small, 16);
+
+	std::atomic<bool> started{false};
+	std::atomic<bool> finished{false};
+	std::thread render_thread{[&] {
+		display.render([&](Canvas &canvas) {
+			started = true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			canvas.clear(1);
+			finished = true;
+		});
+	}};
+
+	while (!started)
+		std::this_thread::yield();
+	display.show(large, 32);
+	CHECK(finished);
+	render_thread.join();
+
+	CHECK(display.render([](Canvas &canvas) {
+		CHECK(canvas.width() == 32);
+		canvas.clear(2);
+	}));
+	CHECK(display.draw());
+	CHECK(large.back() == 2);
+}
@@ -0,0 +1,180 @@
+#include "CoreModules/elements/element_info.hh"
+#include "CoreModules/module_arena.hh"
+#include "CoreModules/register_module.hh"
+#include "doctest.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace MetaModule;
+
+namespace
+{
+
+unsigned num_alive = 0;
+
+struct SmallModule : CoreProcessor {
+	char tag = 's';
+
+	SmallModule() {
+		num_alive++;
+	}
+	~SmallModule() override {
+		num_alive--;
+	}
+	void update() override {
+	}
+	void set_samplerate(float sr) override {
+	}
+	void set_param(int param_id, float val) override {
+	}
+	void set_input(int input_id, float val) override {
+	}
+	float get_output(int output_id) const override {
+		return 0;
+	}
+};
+
+struct alignas(64) AlignedModule : SmallModule {
+	float buffer[20]{};
+};
+
+// CoreProcessor is not the first base, so it's not at the start of the object
+struct Extra {
+	uint64_t data[3]{};
+	virtual ~Extra() = default;
+};
+struct OffsetModule : Extra, SmallModule {};
+
+bool is_aligned(const void *ptr, size_t alignment) {
+	return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+struct ArenaInfo : ModuleInfoBase {
+	static constexpr std::string_view slug{"Arena"};
+	static constexpr std::string_view description{""};
+	static constexpr uint32_t width_hp = 4;
+	static constexpr std::string_view png_filename{"arena.png"};
+	static constexpr std::array<Element, 1> Elements{{Knob{}}};
+};
+
+// Which host function the plugin-side templates call
+std::vector<std::string> registered;
+
+} // namespace
+
+namespace MetaModule
+{
+
+bool register_module(std::string_view, std::string_view module_slug, CreateModuleFunc, ModuleInfoView const &, std::string_view) {
+	registered.push_back("plain " + std::string{module_slug});
+	return true;
+}
+
+bool register_module(std::string_view,
+					 std::string_view module_slug,
+					 CreateModuleFunc,
+					 ModulePlacement const &placement,
+					 ModuleInfoView const &,
+					 std::string_view) {
+	registered.push_back("placement " + std::string{module_slug} + " " + std::to_string(placement.size));
+	return true;
+}
+
+} // namespace MetaModule
+
+TEST_CASE("Templated register_module() only needs the original host function") {
+	registered.clear();
+	register_module<SmallModule, ArenaInfo>("Brand");
+	register_module<SmallModule, ArenaInfo>("Brand", "Other", "other.png");
+	register_module<SmallModule>("Brand", "Manual", ModuleInfoView::makeView<ArenaInfo>(), "manual.png");
+	register_module_with_placement<AlignedModule, ArenaInfo>("Brand");
+
+	REQUIRE(registered.size() == 4);
+	CHECK(registered[0] == "plain Arena");
+	CHECK(registered[1] == "plain Other");
+	CHECK(registered[2] == "plain Manual");
+	CHECK(registered[3] == "placement Arena " + std::to_string(sizeof(AlignedModule)));
+}
+
+TEST_CASE("Module arena aligns modules and reports when it's full") {
+	std::array<ModulePlacement, 3> placements{
+		ModulePlacement::of<SmallModule>(),
+		ModulePlacement::of<AlignedModule>(),
+		ModulePlacement::of<SmallModule>(),
+	};
+
+	// Start the memory at an odd address, so the arena has to align
+	std::vector<std::byte> memory(ModuleArena::required_size(placements) + 1);
+	ModuleArena arena{std::span{memory}.subspan(1)};
+
+	std::vector<PlacedModulePtr> modules;
+	for (auto &p : placements) {
+		modules.push_back(arena.create(p));
+		REQUIRE(modules.back());
+	}
+	CHECK(num_alive == 3);
+	CHECK(is_aligned(modules[1].get(), alignof(AlignedModule)));
+	CHECK(is_aligned(modules[2].get(), alignof(SmallModule)));
+	CHECK(arena.bytes_used() <= arena.capacity());
+
+	auto *first = reinterpret_cast<std::byte *>(modules[0].get());
+	CHECK(first >= memory.data() + 1);
+	CHECK(first < memory.data() + memory.size());
+
+	// Full (required_size() has room for alignment in any memory, so add until it fails)
+	unsigned num_extra = 0;
+	while (auto extra = arena.create(placements[1])) {
+		modules.push_back(std::move(extra));
+		num_extra++;
+	}
+	CHECK(num_extra < 2);
+	CHECK_FALSE(arena.create(ModulePlacement{}));
+
+	modules.clear();
+	CHECK(num_alive == 0);
+
+	arena.reset();
+	CHECK(arena.bytes_used() == 0);
+	CHECK(arena.create(placements[0]));
+	CHECK(num_alive == 0);
+}
+
+TEST_CASE("Module pool reuses slots, and is limited to its size") {
+	auto placement = ModulePlacement::of<OffsetModule>();
+	constexpr size_t NumSlots = 3;
+	std::vector<std::byte> memory(ModulePool::required_size(placement, NumSlots) + 3);
+	ModulePool pool{placement, std::span{memory}.subspan(3)};
+	CHECK(pool.num_free() == NumSlots);
+
+	std::vector<PlacedModulePtr> modules;
+	for (unsigned i = 0; i < NumSlots; i++) {
+		modules.push_back(pool.create());
+		REQUIRE(modules.back());
+		CHECK(is_aligned(modules.back().get(), alignof(OffsetModule)));
+	}
+	CHECK(num_alive == NumSlots);
+	CHECK(pool.num_free() == 0);
+	CHECK_FALSE(pool.create());
+
+	// The CoreProcessor pointer is inside the slot, not at its start: the same slot is reused
+	auto *middle = modules[1].get();
+	modules[1].reset();
+	CHECK(num_alive == NumSlots - 1);
+	CHECK(pool.num_free() == 1);
+
+	modules[1] = pool.create();
+	CHECK(modules[1].get() == middle);
+	CHECK(pool.num_free() == 0);
+
+	modules.clear();
+	CHECK(num_alive == 0);
+	CHECK(pool.num_free() == NumSlots);
+
+	SUBCASE("Memory too small for a slot") {
+		std::array<std::byte, 4> tiny;
+		ModulePool empty{placement, tiny};
+		CHECK(empty.num_free() == 0);
+		CHECK_FALSE(empty.create());
+	}
+}
@@ -0,0 +1,178 @@
+#define METAMODULE_PROFILE_MODULES
+#include "CoreModules/engine/module_profiler.hh"
+#include "CoreModules/engine/parallel_patch_engine.hh"
+#include "doctest.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace MetaModule;
+
+TEST_CASE("Profiler stats and histogram percentiles") {
+	ModuleProfilerT<4> profiler;
+	CHECK_FALSE(profiler.read(0));
+
+	// Small values have a bucket each
+	for (uint32_t cycles : {1, 2, 3})
+		profiler.record(0, cycles);
+	auto small = profiler.read(0);
+	REQUIRE(small);
+	CHECK(small->count == 3);
+	CHECK(small->min == 1);
+	CHECK(small->max == 3);
+	CHECK(small->mean == 2.f);
+	CHECK(small->p50 == 2);
+
+	// Other values are reported as the top of their bucket, which is within 25%
+	for (uint32_t cycles = 4; cycles < 100000; cycles = cycles * 3 / 2 + 1) {
+		ModuleProfilerT<1> one;
+		one.record(0, cycles);
+		auto p50 = one.read(0)->p50;
+		CHECK(p50 >= cycles);
+		CHECK(p50 < cycles + cycles / 4 + 1);
+	}
+
+	for (unsigned i = 0; i < 90; i++)
+		profiler.record(1, 100);
+	for (unsigned i = 0; i < 10; i++)
+		profiler.record(1, 10000);
+	auto stats = profiler.read(1);
+	REQUIRE(stats);
+	CHECK(stats->count == 100);
+	CHECK(stats->min == 100);
+	CHECK(stats->max == 10000);
+	CHECK(stats->mean == 1090.f);
+	CHECK(stats->p50 >= 100);
+	CHECK(stats->p50 < 125);
+	CHECK(stats->p95 >= 10000);
+	CHECK(stats->p99 >= 10000);
+
+	// Cleared the next time the module is timed
+	profiler.reset(1);
+	profiler.record(1, 7);
+	CHECK(profiler.read(1)->count == 1);
+	CHECK(profiler.read(1)->max == 7);
+
+	SUBCASE("Modules with ids out of range are counted, not timed") {
+		profiler.record(4, 10);
+		profiler.time(5, 1, [] {});
+		CHECK(profiler.num_dropped() == 2);
+		CHECK_FALSE(profiler.read(4));
+	}
+}
+
+TEST_CASE("Profiler time_update() times a module run outside of an engine") {
+	struct Module {
+		uint32_t id = 2;
+		unsigned num_updates = 0;
+		void update() {
+			num_updates++;
+		}
+	} module;
+
+	ModuleProfilerT<4> profiler;
+	profiler.time_update(module);
+	profiler.time_update(module);
+	CHECK(module.num_updates == 2);
+	REQUIRE(profiler.read(2));
+	CHECK(profiler.read(2)->count == 2);
+}
+
+TEST_CASE("Profiler snapshots are never torn") {
+	ModuleProfilerT<1> profiler;
+	std::atomic<bool> done{false};
+
+	// Every record is the same, so a consistent snapshot has a mean of exactly 100
+	std::thread audio{[&] {
+		for (unsigned i = 0; i < 200000; i++)
+			profiler.record(0, 100);
+		done = true;
+	}};
+
+	unsigned errors = 0;
+	while (!done) {
+		if (auto stats = profiler.read(0))
+			errors += stats->min != 100 || stats->max != 100 || stats->mean != 100.f;
+	}
+	audio.join();
+
+	CHECK(errors == 0);
+	CHECK(profiler.read(0)->count == 200000);
+}
+
+TEST_CASE("Profiler is safe to use from ParallelPatchEngine's threads") {
+	struct BusyModule : CoreProcessor {
+		float out = 0;
+		void update() override {
+			for (unsigned i = 0; i < 200; i++)
+				out = out * 0.5f + float(i);
+		}
+		void set_samplerate(float sr) override {
+		}
+		void set_param(int param_id, float val) override {
+		}
+		void set_input(int input_id, float val) override {
+		}
+		float get_output(int output_id) const override {
+			return out;
+		}
+	};
+
+	constexpr unsigned NumUnique = 8;
+	constexpr unsigned NumShared = 8;
+	constexpr unsigned NumBlocks = 300;
+	constexpr unsigned BlockSize = 16;
+
+	// Modules 0-7 have their own ids, the rest all share id 8
+	std::vector<BusyModule> modules(NumUnique + NumShared);
+	for (unsigned i = 0; i < modules.size(); i++)
+		modules[i].id = std::min(i, NumUnique);
+
+	auto profiler = std::make_unique<ModuleProfiler>();
+	ParallelPatchEngine engine{4};
+	for (auto &m : modules)
+		engine.add_module(&m, {});
+	engine.set_block_size(BlockSize);
+	engine.set_profiler(profiler.get());
+
+	for (unsigned block = 0; block < NumBlocks; block++)
+		engine.process_block(BlockSize);
+
+	for (uint32_t id = 0; id < NumUnique; id++) {
+		auto stats = profiler->read(id);
+		REQUIRE(stats);
+		CHECK(stats->count == NumBlocks);
+		CHECK(stats->min <= stats->max);
+	}
+
+	// Every timing of the shared id is either recorded or counted as dropped
+	auto shared = profiler->read(NumUnique);
+	REQUIRE(shared);
+	CHECK(shared->count + profiler->num_dropped() == NumShared * NumBlocks);
+	CHECK(shared->min <= shared->max);
+	CHECK(shared->p50 <= shared->p99);
+}
+
+TEST_CASE("Profiler timings from threads sharing an id are recorded or dropped, never torn") {
+	constexpr unsigned NumThreads = 4;
+	constexpr unsigned NumRecords = 100000;
+	ModuleProfilerT<1> profiler;
+
+	std::vector<std::thread> threads;
+	for (unsigned t = 0; t < NumThreads; t++) {
+		threads.emplace_back([&] {
+			for (unsigned i = 0; i < NumRecords; i++)
+				profiler.record(0, 100);
+		});
+	}
+	for (auto &t : threads)
+		t.join();
+
+	auto stats = profiler.read(0);
+	REQUIRE(stats);
+	CHECK(stats->count + profiler.num_dropped() == NumThreads * NumRecords);
+	CHECK(stats->min == 100);
+	CHECK(stats->max == 100);
+	CHECK(stats->mean == 100.f);
+}
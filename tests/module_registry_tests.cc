@@ -0,0 +1,106 @@
+#include "CoreModules/module_registry.hh"
+#include "doctest.h"
+#include <string>
+#include <vector>
+
+using namespace MetaModule;
+
+namespace
+{
+
+struct RegInfo {
+	static constexpr std::string_view slug{"Reg"};
+};
+
+// Module slugs whose keys with the given brand all start probing at the same slot of a 64-slot table
+std::vector<std::string> colliding_slugs(std::string_view brand, unsigned num) {
+	std::vector<std::string> slugs;
+	uint64_t home = module_key(brand, "M0") & 63;
+	for (unsigned i = 0; slugs.size() < num; i++) {
+		auto slug = "M" + std::to_string(i);
+		if ((module_key(brand, slug) & 63) == home)
+			slugs.push_back(slug);
+	}
+	return slugs;
+}
+
+} // namespace
+
+TEST_CASE("Module registry add, find and remove") {
+	ModuleRegistry<int> registry;
+	CHECK_FALSE(registry.find("Brand", "Reg"));
+	CHECK_FALSE(registry.remove("Brand", "Reg"));
+
+	CHECK(registry.add("Brand", "Reg", 1));
+	CHECK(registry.add("Other", "Reg", 2));
+	CHECK_FALSE(registry.add("Brand", "Reg", 3));
+	CHECK(registry.size() == 2);
+
+	CHECK(*registry.find("Brand", "Reg") == 1);
+	CHECK(*registry.find<RegInfo>("Other") == 2);
+	CHECK(*registry.find(module_key("Brand", "Reg")) == 1);
+
+	// Slug hashes are computed at compile time
+	static_assert(ModuleSlug::of<RegInfo>().hash == slug_hash("Reg"));
+
+	// A different slug pair with the same key is refused, so a key always finds the right entry
+	ModuleSlug forged{"Forged"};
+	forged.hash = slug_hash("Reg");
+	CHECK_FALSE(registry.add("Brand", forged, 4));
+	CHECK(*registry.find("Brand", "Reg") == 1);
+
+	CHECK(registry.remove("Brand", "Reg"));
+	CHECK_FALSE(registry.find("Brand", "Reg"));
+	CHECK(*registry.find("Other", "Reg") == 2);
+	CHECK(registry.size() == 1);
+
+	// Can be added again after removing
+	CHECK(registry.add("Brand", "Reg", 5));
+	CHECK(*registry.find("Brand", "Reg") == 5);
+}
+
+TEST_CASE("Module registry probing survives removals") {
+	ModuleRegistry<std::string> registry;
+	auto slugs = colliding_slugs("Brand", 5);
+	for (auto &slug : slugs)
+		CHECK(registry.add("Brand", ModuleSlug{slug}, slug));
+
+	for (auto &slug : slugs)
+		CHECK(*registry.find("Brand", slug) == slug);
+
+	// Removing from the start and middle of the probe chain keeps the rest reachable
+	CHECK(registry.remove("Brand", slugs[0]));
+	CHECK(registry.remove("Brand", slugs[2]));
+	CHECK_FALSE(registry.find("Brand", slugs[0]));
+	CHECK_FALSE(registry.find("Brand", slugs[2]));
+	for (auto i : {1, 3, 4})
+		CHECK(*registry.find("Brand", slugs[i]) == slugs[i]);
+}
+
+TEST_CASE("Module registry grows, and removes a whole brand") {
+	ModuleRegistry<unsigned> registry;
+	constexpr unsigned NumModules = 500;
+	for (unsigned i = 0; i < NumModules; i++)
+		CHECK(registry.add(i % 3 ? "Keep" : "Unload", ModuleSlug{"Module" + std::to_string(i)}, i));
+	CHECK(registry.size() == NumModules);
+
+	unsigned errors = 0;
+	for (unsigned i = 0; i < NumModules; i++) {
+		auto found = registry.find(i % 3 ? "Keep" : "Unload", "Module" + std::to_string(i));
+		errors += !found || *found != i;
+	}
+	CHECK(errors == 0);
+
+	auto num_unloaded = (NumModules + 2) / 3;
+	CHECK(registry.remove_brand("Unload") == num_unloaded);
+	CHECK(registry.size() == NumModules - num_unloaded);
+
+	errors = 0;
+	for (unsigned i = 0; i < NumModules; i++) {
+		auto found = registry.find(i % 3 ? "Keep" : "Unload", "Module" + std::to_string(i));
+		errors += i % 3 ? (!found || *found != i) : found != nullptr;
+	}
+	CHECK(errors == 0);
+	for (auto &entry : registry.all())
+		CHECK(entry.brand_slug == "Keep");
+}
@@ -0,0 +1,390 @@
+#include "CoreModules/SmartCoreProcessor.hh"
+#include "CoreModules/elements/element_info.hh"
+#include "CoreModules/engine/parallel_patch_engine.hh"
+#include "CoreModules/engine/patch_engine.hh"
+#include "doctest.h"
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace MetaModule;
+
+namespace
+{
+
+// Outputs its input plus a constant. Output is 0 until the first update().
+struct AddModule : CoreProcessor {
+	float amount;
+	float in = 0;
+	float out = 0;
+	bool in_patched = false;
+	bool out_patched = false;
+	std::vector<int> *run_log = nullptr;
+	int tag = 0;
+
+	AddModule(float amount = 1.f, std::vector<int> *log = nullptr, int tag = 0)
+		: amount{amount}
+		, run_log{log}
+		, tag{tag} {
+	}
+
+	void update() override {
+		out = in + amount;
+		if (run_log)
+			run_log->push_back(tag);
+	}
+	void set_samplerate(float sr) override {
+	}
+	void set_param(int param_id, float val) override {
+	}
+	void set_input(int input_id, float val) override {
+		in = val;
+	}
+	float get_output(int output_id) const override {
+		return out;
+	}
+	void mark_input_patched(int) override {
+		in_patched = true;
+	}
+	void mark_all_inputs_unpatched() override {
+		in_patched = false;
+	}
+	void mark_output_patched(int) override {
+		out_patched = true;
+	}
+	void mark_all_outputs_unpatched() override {
+		out_patched = false;
+	}
+};
+
+constexpr ElementCount::Counts OneInOneOut{.num_inputs = 1, .num_outputs = 1};
+
+struct KnobsInfo : ModuleInfoBase {
+	static constexpr std::string_view slug{"Knobs"};
+	static constexpr std::array<Element, 3> Elements{{Knob{}, Knob{}, Knob{}}};
+
+	enum class Elem { Knob1, Knob2, Knob3 };
+};
+
+struct KnobsModule : SmartCoreProcessor<KnobsInfo, WithBinaryState> {
+	void update() override {
+	}
+	void set_samplerate(float sr) override {
+	}
+};
+
+// Has its own text state, and didn't opt in to binary state
+struct TextStateModule : SmartCoreProcessor<KnobsInfo> {
+	std::string text = "custom";
+
+	void update() override {
+	}
+	void set_samplerate(float sr) override {
+	}
+	std::string save_state() override {
+		return text;
+	}
+};
+
+constexpr ElementCount::Counts ThreeKnobs{.num_params = 3};
+
+// Outputs its param value, counting how many update_block() calls it gets
+struct ParamOutModule : CoreProcessor {
+	float param = 0;
+	unsigned num_blocks = 0;
+
+	void update() override {
+	}
+	void update_block(std::span<const float *const>, std::span<float *const> outputs, unsigned num_frames) override {
+		num_blocks++;
+		for (unsigned i = 0; i < num_frames; i++)
+			outputs[0][i] = bypassed ? -1.f : param;
+	}
+	void set_samplerate(float sr) override {
+	}
+	void set_param(int param_id, float val) override {
+		param = val;
+	}
+	void set_input(int input_id, float val) override {
+	}
+	float get_output(int output_id) const override {
+		return param;
+	}
+};
+
+// Records which thread ran it. Slow enough that one thread can't run a whole block alone.
+struct ThreadLogModule : CoreProcessor {
+	std::thread::id thread;
+
+	void update() override {
+	}
+	void update_block(std::span<const float *const>, std::span<float *const>, unsigned) override {
+		thread = std::this_thread::get_id();
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	void set_samplerate(float sr) override {
+	}
+	void set_param(int param_id, float val) override {
+	}
+	void set_input(int input_id, float val) override {
+	}
+	float get_output(int output_id) const override {
+		return 0;
+	}
+};
+
+} // namespace
+
+TEST_CASE("Modules run in dependency order") {
+	std::vector<int> log;
+	AddModule a{1, &log, 0};
+	AddModule b{1, &log, 1};
+	AddModule c{1, &log, 2};
+
+	PatchEngine engine;
+	// Added in reverse order of the signal flow
+	auto c_idx = engine.add_module(&c, OneInOneOut);
+	auto b_idx = engine.add_module(&b, OneInOneOut);
+	auto a_idx = engine.add_module(&a, OneInOneOut);
+
+	CHECK(engine.add_cable({{a_idx, 0}, {b_idx, 0}}));
+	CHECK(engine.add_cable({{b_idx, 0}, {c_idx, 0}}));
+
+	engine.process();
+	CHECK(log == std::vector<int>{0, 1, 2});
+
+	// a -> b -> c all within one frame
+	CHECK(c.out == 3.f);
+
+	SUBCASE("Patched state is set from the cables") {
+		CHECK(a.out_patched);
+		CHECK_FALSE(a.in_patched);
+		CHECK(b.in_patched);
+		CHECK(b.out_patched);
+		CHECK(c.in_patched);
+		CHECK_FALSE(c.out_patched);
+	}
+
+	SUBCASE("Input jacks can only have one cable") {
+		CHECK_FALSE(engine.add_cable({{a_idx, 0}, {c_idx, 0}}));
+	}
+
+	SUBCASE("Invalid jacks are rejected") {
+		CHECK_FALSE(engine.add_cable({{a_idx, 1}, {c_idx, 0}}));
+		CHECK_FALSE(engine.add_cable({{a_idx, 0}, {7, 0}}));
+	}
+
+	SUBCASE("Removing a module removes its cables") {
+		engine.remove_module(b_idx);
+		CHECK(engine.get_cables().empty());
+		CHECK(engine.module_order().size() == 2);
+	}
+}
+
+TEST_CASE("Feedback loops are delayed by one frame") {
+	AddModule a{1};
+	AddModule b{10};
+
+	PatchEngine engine;
+	auto a_idx = engine.add_module(&a, OneInOneOut);
+	auto b_idx = engine.add_module(&b, OneInOneOut);
+
+	engine.add_cable({{a_idx, 0}, {b_idx, 0}});
+	engine.add_cable({{b_idx, 0}, {a_idx, 0}});
+
+	CHECK(engine.is_feedback({{b_idx, 0}, {a_idx, 0}}));
+	CHECK_FALSE(engine.is_feedback({{a_idx, 0}, {b_idx, 0}}));
+
+	// a reads b's previous output
+	engine.process();
+	CHECK(a.out == 1.f);
+	CHECK(b.out == 11.f);
+
+	engine.process();
+	CHECK(a.out == 12.f);
+	CHECK(b.out == 22.f);
+}
+
+TEST_CASE("Block processing matches frame processing") {
+	AddModule a1{0.5f}, b1{2.f}, c1{-1.f};
+	AddModule a2{0.5f}, b2{2.f}, c2{-1.f};
+
+	PatchEngine frame_engine;
+	PatchEngine block_engine;
+
+	for (auto [engine, a, b, c] : {std::tuple{&frame_engine, &a1, &b1, &c1}, std::tuple{&block_engine, &a2, &b2, &c2}}) {
+		auto a_idx = engine->add_module(a, OneInOneOut);
+		auto b_idx = engine->add_module(b, OneInOneOut);
+		auto c_idx = engine->add_module(c, OneInOneOut);
+		engine->add_cable({{a_idx, 0}, {b_idx, 0}});
+		engine->add_cable({{b_idx, 0}, {c_idx, 0}});
+		engine->add_cable({{c_idx, 0}, {a_idx, 0}});
+	}
+
+	// With a block size of 1, a feedback delay of one block equals one frame
+	block_engine.set_block_size(1);
+
+	for (int i = 0; i < 16; i++) {
+		frame_engine.process();
+		block_engine.process_block(1);
+		CHECK(block_engine.output_buffer({2, 0})[0] == c1.out);
+	}
+}
+
+TEST_CASE("Parallel engine matches the single-threaded engine exactly") {
+	constexpr unsigned NumChains = 7;
+	constexpr unsigned ChainLength = 5;
+	constexpr unsigned BlockSize = 32;
+
+	std::vector<AddModule> serial_modules;
+	std::vector<AddModule> parallel_modules;
+	for (unsigned i = 0; i < NumChains * ChainLength; i++) {
+		serial_modules.emplace_back(0.1f * i);
+		parallel_modules.emplace_back(0.1f * i);
+	}
+
+	PatchEngine serial;
+	ParallelPatchEngine parallel{4};
+
+	// Independent chains, each with a feedback cable from the last module to the first
+	auto build = [&](PatchEngine &engine, std::vector<AddModule> &modules) {
+		for (auto &m : modules)
+			engine.add_module(&m, OneInOneOut);
+
+		for (uint32_t chain = 0; chain < NumChains; chain++) {
+			auto first = chain * ChainLength;
+			for (uint32_t i = first; i < first + ChainLength - 1; i++)
+				engine.add_cable({{i, 0}, {i + 1, 0}});
+			engine.add_cable({{first + ChainLength - 1, 0}, {first, 0}});
+		}
+		engine.set_block_size(BlockSize);
+	};
+	build(serial, serial_modules);
+	build(parallel, parallel_modules);
+
+	CHECK(parallel.num_subgraphs() == NumChains);
+
+	for (unsigned block = 0; block < 20; block++) {
+		serial.process_block(BlockSize);
+		parallel.process_block(BlockSize);
+
+		for (uint32_t m = 0; m < NumChains * ChainLength; m++) {
+			auto expected = serial.output_buffer({m, 0});
+			auto actual = parallel.output_buffer({m, 0});
+			CHECK(std::equal(expected.begin(), expected.end(), actual.begin()));
+		}
+	}
+}
+
+TEST_CASE("Parallel engine runs in parallel when called through a PatchEngine reference") {
+	ThreadLogModule modules[4];
+	ParallelPatchEngine parallel{4};
+	for (auto &m : modules)
+		parallel.add_module(&m, {});
+	parallel.set_block_size(1);
+
+	PatchEngine &engine = parallel;
+	engine.process_block(1);
+
+	std::set<std::thread::id> threads;
+	for (auto &m : modules)
+		threads.insert(m.thread);
+	CHECK(threads.size() > 1);
+}
+
+TEST_CASE("Delta snapshots only contain changed params, and restore the patch") {
+	KnobsModule modules[3];
+	PatchEngine engine;
+	for (auto &m : modules)
+		engine.add_module(&m, ThreeKnobs);
+
+	CHECK_FALSE(engine.has_state_changes());
+
+	modules[1].set_param(2, 0.9f);
+	std::vector<std::byte> full(engine.state_size());
+	CHECK(engine.save_state_into(full) == full.size());
+	CHECK_FALSE(engine.has_state_changes());
+
+	// Setting a param to its current value is not a change
+	modules[0].set_param(0, 0.f);
+	CHECK_FALSE(engine.has_state_changes());
+
+	modules[2].set_param(0, 0.5f);
+	modules[2].set_param(1, 0.25f);
+	std::vector<std::byte> delta1(engine.state_delta_size());
+	CHECK(engine.save_state_delta_into(delta1) == delta1.size());
+
+	modules[0].set_param(1, 0.125f);
+	std::vector<std::byte> delta2(engine.state_delta_size());
+	CHECK(engine.save_state_delta_into(delta2) == delta2.size());
+
+	// Only one module with one param changed
+	CHECK(delta2.size() < delta1.size());
+	CHECK_FALSE(engine.has_state_changes());
+
+	KnobsModule restored_modules[3];
+	PatchEngine restored;
+	for (auto &m : restored_modules)
+		restored.add_module(&m, ThreeKnobs);
+
+	CHECK(restored.load_state_from(full));
+	CHECK(restored.load_state_delta_from(delta1));
+	CHECK(restored.load_state_delta_from(delta2));
+
+	for (unsigned m = 0; m < 3; m++) {
+		for (unsigned p = 0; p < 3; p++)
+			CHECK(restored_modules[m].get_param(p) == modules[m].get_param(p));
+	}
+}
+
+TEST_CASE("Snapshots skip modules that use text state") {
+	KnobsModule knobs;
+	TextStateModule text;
+	PatchEngine engine;
+	engine.add_module(&knobs, ThreeKnobs);
+	engine.add_module(&text, ThreeKnobs);
+
+	// The host saves the text module with save_state(), so its custom state isn't lost
+	CHECK(text.binary_state_size() == 0);
+	CHECK(engine.state_size() == knobs.binary_state_size() + sizeof(uint32_t) * 2);
+
+	text.set_param(0, 0.5f);
+	CHECK_FALSE(engine.has_state_changes());
+	knobs.set_param(0, 0.5f);
+	CHECK(engine.has_state_changes());
+}
+
+TEST_CASE("Events are applied at their sample offsets") {
+	ParamOutModule module;
+	PatchEngine engine;
+	auto idx = engine.add_module(&module, {.num_params = 1, .num_outputs = 1});
+	engine.set_block_size(32);
+
+	CHECK(engine.post_event(idx, ModuleEvent::param(0, 1.f)));
+	CHECK(engine.post_event(idx, ModuleEvent::param(0, 2.f, 10)));
+	CHECK(engine.post_event(idx, ModuleEvent::bypass(true, 20)));
+	engine.process_block(32);
+
+	auto out = engine.output_buffer({idx, 0});
+	CHECK(module.num_blocks == 3);
+	CHECK(out[0] == 1.f);
+	CHECK(out[9] == 1.f);
+	CHECK(out[10] == 2.f);
+	CHECK(out[19] == 2.f);
+	CHECK(out[20] == -1.f);
+	CHECK(out[31] == -1.f);
+
+	// No events: the block is not split
+	engine.process_block(32);
+	CHECK(module.num_blocks == 4);
+
+	SUBCASE("The queue is bounded") {
+		unsigned num_posted = 0;
+		while (engine.post_event(idx, ModuleEvent::param(0, 0.f)))
+			num_posted++;
+		CHECK(num_posted == ModuleEventQueue::capacity());
+	}
+}
@@ -1,6 +1,11 @@
 #include "../SmartCoreProcessor.hh"
 #include "CoreModules/elements/element_info.hh"
 #include "doctest.h"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
 
 using namespace MetaModule;
 
@@ -32,10 +37,22 @@ struct TestInfo : ModuleInfoBase {
 };
 
 struct TestModuleCore : SmartCoreProcessor<TestInfo> {
+	using Elem = TestInfo::Elem;
+
 	void update() override {
 	}
 	void set_samplerate(float sr) override {
 	}
+
+	std::optional<float> in2() {
+		return getInput<Elem::In2In>();
+	}
+	bool in2_patched() {
+		return isPatched<Elem::In2In>();
+	}
+	std::optional<float> samp1() {
+		return getInput<Elem::Samp1In>();
+	}
 };
 
 TEST_CASE("Fail") {
@@ -53,3 +70,424 @@ TEST_CASE("Fail") {
 		CHECK(c == raw[i++]);
 	}
 }
+
+TEST_CASE("base64 round trip, including lengths that don't fill a whole vector block") {
+	for (size_t size = 0; size < 200; size++) {
+		std::vector<uint8_t> raw(size);
+		for (unsigned i = 0; auto &c : raw)
+			c = uint8_t(i++ * 37 + size);
+
+		auto encoded = TestModuleCore::encode(raw);
+		CHECK(encoded.size() == Base64::encoded_size(size));
+		CHECK(TestModuleCore::decode(encoded) == raw);
+
+		// Without padding
+		while (encoded.size() && encoded.back() == '=')
+			encoded.pop_back();
+		CHECK(TestModuleCore::decode(encoded) == raw);
+	}
+
+	SUBCASE("Invalid chars are rejected") {
+		std::vector<uint8_t> out(64);
+		CHECK_FALSE(TestModuleCore::decode("AQID-A==", out));
+		CHECK_FALSE(TestModuleCore::decode("AQIDBA==AQIDBA==AQIDBA==AQIDBA==", out));
+		CHECK_FALSE(TestModuleCore::decode("AQIDBAAQIDBAAQIDBAAQIDBAAQIDBAAQIDBAAQIDBAAQID*A", out));
+	}
+}
+
+TEST_CASE("Batched inputs keep isPatched() and getInput() behavior") {
+	TestModuleCore core;
+	constexpr int Samp1 = 0, In2 = 3;
+
+	CHECK_FALSE(core.in2_patched());
+	CHECK_FALSE(core.in2());
+
+	core.set_input(In2, 2.f);
+	CHECK(core.in2_patched());
+	CHECK(core.in2() == 2.f);
+
+	core.mark_input_unpatched(In2);
+	CHECK_FALSE(core.in2_patched());
+	CHECK_FALSE(core.in2());
+
+	// Patched without a value: 0V
+	core.mark_input_patched(In2);
+	CHECK(core.in2() == 0.f);
+	core.mark_all_inputs_unpatched();
+
+	// Without a mask: the first vals.size() inputs
+	std::array<float, 2> vals{1.f, 3.f};
+	core.set_inputs(vals);
+	CHECK(core.samp1() == 1.f);
+	CHECK_FALSE(core.in2());
+
+	// Selected inputs without a value are not marked patched
+	core.mark_all_inputs_unpatched();
+	std::array<uint64_t, 1> mask{(1u << Samp1) | (1u << In2)};
+	core.set_inputs(vals, mask);
+	CHECK(core.samp1() == 1.f);
+	CHECK_FALSE(core.in2_patched());
+
+	std::array<float, 4> all_vals{5.f, 6.f, 7.f, 8.f};
+	core.set_inputs(all_vals, mask);
+	CHECK(core.samp1() == 5.f);
+	CHECK(core.in2() == 8.f);
+}
+
+TEST_CASE("Bulk patched jacks: an empty span means nothing is patched") {
+	TestModuleCore core;
+	constexpr int In2 = 3;
+
+	std::array<uint64_t, 1> patched{1u << In2};
+	core.mark_inputs_patched(patched);
+	CHECK(core.in2_patched());
+	CHECK_FALSE(core.samp1());
+
+	// Not an index mask, where empty would select all
+	core.mark_inputs_patched({});
+	CHECK_FALSE(core.in2_patched());
+	CHECK_FALSE(core.samp1());
+
+	// Same for the default implementation
+	struct JackModule : CoreProcessor {
+		std::array<bool, 4> in_patched{};
+		void update() override {
+		}
+		void set_samplerate(float sr) override {
+		}
+		void set_param(int param_id, float val) override {
+		}
+		void set_input(int input_id, float val) override {
+		}
+		float get_output(int output_id) const override {
+			return 0;
+		}
+		void mark_all_inputs_unpatched() override {
+			in_patched.fill(false);
+		}
+		void mark_input_patched(int input_id) override {
+			if (size_t(input_id) < in_patched.size())
+				in_patched[input_id] = true;
+		}
+	} module;
+
+	module.mark_inputs_patched(patched);
+	CHECK(module.in_patched == std::array{false, false, false, true});
+	module.mark_inputs_patched({});
+	CHECK(module.in_patched == std::array{false, false, false, false});
+
+}
+
+struct KnobsInfo : ModuleInfoBase {
+	static constexpr std::string_view slug{"Knobs"};
+
+	static constexpr std::array<Element, 3> Elements{{
+		Knob{},
+		FlipSwitch{},
+		Slider{},
+	}};
+
+	enum class Elem {
+		FreqKnob,
+		ModeSwitch,
+		LevelSlider,
+	};
+};
+
+struct SmoothedModuleCore : SmartCoreProcessor<KnobsInfo, WithParamSmoothing | WithBinaryState> {
+	using Elem = KnobsInfo::Elem;
+
+	void update() override {
+		smoothParams();
+	}
+	void set_samplerate(float sr) override {
+		setSmoothingTime<Elem::FreqKnob>(0.01f, sr);
+	}
+
+	float freq() {
+		return getSmoothedState<Elem::FreqKnob>();
+	}
+	float level() {
+		return getSmoothedState<Elem::LevelSlider>();
+	}
+};
+
+TEST_CASE("Param smoothing") {
+	SmoothedModuleCore core;
+	core.set_samplerate(1000.f);
+
+	// The first value (e.g. from loading a patch) jumps
+	core.set_param(0, 0.5f);
+	CHECK(core.freq() == 0.5f);
+	core.update();
+	CHECK(core.freq() == 0.5f);
+
+	core.set_param(0, 1.f);
+	core.set_param(2, 1.f);
+	core.update();
+
+	// FreqKnob: one-pole with a 10 sample time constant
+	CHECK(core.freq() == doctest::Approx(1.f - 0.5f * std::exp(-0.1f)));
+	// LevelSlider: no smoothing time set, so it jumps
+	CHECK(core.level() == 1.f);
+	// get_param() is not smoothed
+	CHECK(core.get_param(0) == 1.f);
+
+	for (unsigned i = 0; i < 100; i++)
+		core.update();
+	CHECK(core.freq() == doctest::Approx(1.f).epsilon(0.001));
+
+	// Modules that don't opt in have no smoothing state
+	static_assert(sizeof(SmartCoreProcessor<KnobsInfo>) < sizeof(SmoothedModuleCore));
+}
+
+// Same elements as KnobsInfo, but a different module
+struct OtherKnobsInfo : KnobsInfo {
+	static constexpr std::string_view slug{"OtherKnobs"};
+};
+
+struct OtherKnobsCore : SmartCoreProcessor<OtherKnobsInfo, WithBinaryState> {
+	void update() override {
+	}
+	void set_samplerate(float sr) override {
+	}
+};
+
+TEST_CASE("Binary state round trip, and state from other modules is rejected") {
+	SmoothedModuleCore core;
+	core.set_param(0, 0.25f);
+	core.set_param(1, 1.f);
+	core.set_param(2, 0.75f);
+
+	std::vector<std::byte> state(core.binary_state_size());
+	REQUIRE(core.save_state_into(state) == state.size());
+	CHECK(core.save_state_into(std::span{state}.first(state.size() - 1)) == 0);
+
+	SmoothedModuleCore restored;
+	CHECK(restored.load_state_from(state));
+	for (int i = 0; i < 3; i++)
+		CHECK(restored.get_param(i) == core.get_param(i));
+	// Smoothed values jump to the loaded values
+	CHECK(restored.freq() == 0.25f);
+
+	CHECK_FALSE(restored.load_state_from(std::span{state}.first(state.size() - 1)));
+
+	// Same number of params and jacks, but a different module
+	OtherKnobsCore other;
+	CHECK(other.binary_state_size() == state.size());
+	CHECK_FALSE(other.load_state_from(state));
+	CHECK(other.get_param(0) == 0.f);
+
+	std::vector<std::byte> delta(core.state_delta_size(0));
+	REQUIRE(core.save_state_delta_into(0, delta) == delta.size());
+	CHECK_FALSE(other.load_state_delta_from(delta));
+	CHECK(restored.load_state_delta_from(delta));
+}
+
+TEST_CASE("A delta with a bad param id changes nothing") {
+	SmoothedModuleCore core;
+	core.set_param(0, 0.25f);
+	core.set_param(1, 1.f);
+	core.set_param(2, 0.75f);
+
+	std::vector<std::byte> delta(core.state_delta_size(0));
+	REQUIRE(core.save_state_delta_into(0, delta) == delta.size());
+
+	// The last entry is a (param id, value) pair: point it at a param that doesn't exist
+	uint32_t bad_id = 99;
+	std::memcpy(delta.data() + delta.size() - sizeof(uint32_t) - sizeof(float), &bad_id, sizeof bad_id);
+
+	SmoothedModuleCore restored;
+	auto generation = restored.state_generation();
+	CHECK_FALSE(restored.load_state_delta_from(delta));
+	CHECK(restored.state_generation() == generation);
+	for (int i = 0; i < 3; i++)
+		CHECK(restored.get_param(i) == 0.f);
+}
+
+struct LightsInfo : ModuleInfoBase {
+	static constexpr std::string_view slug{"Lights"};
+
+	static constexpr std::array<Element, 3> Elements{{
+		MonoLight{},
+		RgbLight{},
+		MonoLight{},
+	}};
+
+	enum class Elem {
+		ClockLight,
+		ColorLight,
+		ResetLight,
+	};
+};
+
+struct LightsModuleCore : SmartCoreProcessor<LightsInfo> {
+	using Elem = LightsInfo::Elem;
+
+	void update() override {
+	}
+	void set_samplerate(float sr) override {
+	}
+
+	void clock(float val) {
+		setLED<Elem::ClockLight>(val);
+	}
+	void reset(float val) {
+		setLED<Elem::ResetLight>(val);
+	}
+};
+
+TEST_CASE("Only changed lights are reported") {
+	LightsModuleCore core;
+	std::array<uint16_t, 5> ids;
+	std::array<float, 5> vals;
+
+	// All lights are reported the first time
+	CHECK(core.get_changed_leds(ids, vals) == 5);
+	CHECK(core.get_changed_leds(ids, vals) == 0);
+
+	core.reset(1.f);
+	core.clock(0.5f);
+	core.clock(0.25f);
+	REQUIRE(core.get_changed_leds(ids, vals) == 2);
+	CHECK(ids[0] == 0);
+	CHECK(vals[0] == 0.25f);
+	CHECK(ids[1] == 4);
+	CHECK(vals[1] == 1.f);
+
+	// Setting the same value is not a change
+	core.reset(1.f);
+	CHECK(core.get_changed_leds(ids, vals) == 0);
+
+	SUBCASE("Changes that don't fit are reported next time") {
+		core.clock(1.f);
+		core.reset(0.f);
+		CHECK(core.get_changed_leds(std::span{ids}.first(1), vals) == 1);
+		CHECK(ids[0] == 0);
+		CHECK(core.get_changed_leds(ids, vals) == 1);
+		CHECK(ids[0] == 4);
+	}
+}
+
+TEST_CASE("The last light change always reaches the GUI") {
+	constexpr unsigned NumRounds = 200;
+	constexpr unsigned NumChanges = 2000;
+	unsigned errors = 0;
+
+	for (unsigned round = 0; round < NumRounds; round++) {
+		LightsModuleCore core;
+		std::atomic<bool> done{false};
+		std::array<uint16_t, 5> ids;
+		std::array<float, 5> vals;
+		float last_clock = -1.f;
+
+		auto read_changes = [&] {
+			auto num = core.get_changed_leds(ids, vals);
+			for (size_t i = 0; i < num; i++) {
+				if (ids[i] == 0)
+					last_clock = vals[i];
+			}
+		};
+
+		std::thread audio{[&] {
+			for (unsigned i = 1; i <= NumChanges; i++)
+				core.clock(float(i));
+			done.store(true, std::memory_order_release);
+		}};
+
+		while (!done.load(std::memory_order_acquire))
+			read_changes();
+		audio.join();
+		read_changes();
+
+		errors += last_clock != float(NumChanges);
+	}
+	CHECK(errors == 0);
+}
+
+struct DisplaysInfo : ModuleInfoBase {
+	static constexpr std::string_view slug{"Displays"};
+
+	static constexpr std::array<Element, 3> Elements{{
+		MonoLight{},
+		DynamicTextDisplay{},
+		DynamicTextDisplay{},
+	}};
+
+	enum class Elem {
+		ClockLight,
+		TempoDisplay,
+		NameDisplay,
+	};
+};
+
+struct DisplaysModuleCore : SmartCoreProcessor<DisplaysInfo> {
+	using Elem = DisplaysInfo::Elem;
+
+	void update() override {
+	}
+	void set_samplerate(float sr) override {
+	}
+
+	unsigned num_formats = 0;
+
+	void tempo(int bpm) {
+		setDisplayText<Elem::TempoDisplay>(bpm, [this](int val, std::span<char> text) {
+			num_formats++;
+			return size_t(std::snprintf(text.data(), text.size(), "%d BPM", val));
+		});
+	}
+	void name(std::string_view text) {
+		setDisplayText<Elem::NameDisplay>(text);
+	}
+};
+
+TEST_CASE("Display text is only formatted and copied when it changes") {
+	DisplaysModuleCore core;
+	std::array<char, 32> text;
+	auto as_string = [&](size_t len) { return std::string{text.data(), len}; };
+
+	constexpr int ClockLight = 0, Tempo = 1, Name = 2;
+	uint32_t tempo_version = 0, name_version = 0, light_version = 0;
+
+	// Not a text display
+	CHECK(core.get_display_text(ClockLight, text) == 0);
+	CHECK(core.display_text_changed(ClockLight, light_version));
+
+	// Text hasn't been set yet
+	CHECK(core.display_text_changed(Tempo, tempo_version));
+	CHECK(core.get_display_text(Tempo, text) == 0);
+
+	core.tempo(120);
+	CHECK(core.num_formats == 1);
+	CHECK(core.display_text_changed(Tempo, tempo_version));
+	CHECK(as_string(core.get_display_text(Tempo, text)) == "120 BPM");
+	CHECK_FALSE(core.display_text_changed(Tempo, tempo_version));
+
+	// Same value: not formatted again, and the version stays the same
+	core.tempo(120);
+	CHECK(core.num_formats == 1);
+	CHECK_FALSE(core.display_text_changed(Tempo, tempo_version));
+
+	core.tempo(95);
+	CHECK(core.num_formats == 2);
+	CHECK(core.display_text_changed(Tempo, tempo_version));
+	CHECK(as_string(core.get_display_text(Tempo, text)) == "95 BPM");
+
+	// Each display has its own version
+	core.name("Kick");
+	CHECK_FALSE(core.display_text_changed(Tempo, tempo_version));
+	CHECK(core.display_text_changed(Name, name_version));
+	CHECK(as_string(core.get_display_text(Name, text)) == "Kick");
+
+	core.name("Kick");
+	CHECK_FALSE(core.display_text_changed(Name, name_version));
+
+	SUBCASE("Long text is truncated") {
+		core.name("A name that is much longer than the display buffer");
+		CHECK(core.display_text_changed(Name, name_version));
+		CHECK(core.get_display_text(Name, text) == 32);
+		CHECK(core.get_display_text(Name, std::span{text}.first(4)) == 4);
+		CHECK(as_string(4) == "A na");
+	}
+}
@@ -0,0 +1,131 @@
+#include "CoreModules/spsc_ring.hh"
+#include "doctest.h"
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace MetaModule;
+
+TEST_CASE("SPSC ring: single items, bulk and regions") {
+	SpscRing<int, 8> ring;
+	CHECK(ring.empty());
+	CHECK(ring.write_available() == 8);
+	CHECK_FALSE(ring.front());
+	CHECK_FALSE(ring.try_pop());
+
+	CHECK(ring.push(1));
+	CHECK(ring.push(2));
+	CHECK(*ring.front() == 1);
+	ring.pop();
+	CHECK(ring.try_pop() == 2);
+	CHECK(ring.empty());
+
+	// Bulk push stops when full
+	std::array<int, 10> src;
+	std::iota(src.begin(), src.end(), 10);
+	CHECK(ring.push(src) == 8);
+	CHECK(ring.write_available() == 0);
+	CHECK(ring.write_region().empty());
+	CHECK_FALSE(ring.push(99));
+
+	std::array<int, 5> dst{};
+	CHECK(ring.pop(dst) == 5);
+	CHECK(dst == std::array{10, 11, 12, 13, 14});
+	CHECK(ring.read_available() == 3);
+
+	// Regions are contiguous, so they stop at the end of the storage.
+	// Items 15..17 are in slots 7, 0, 1, so slots 2..6 are free.
+	auto region = ring.write_region();
+	CHECK(region.size() == 5);
+	std::iota(region.begin(), region.end(), 20);
+	ring.commit_write(5);
+	CHECK(ring.write_region().empty());
+
+	auto readable = ring.read_region();
+	CHECK(readable.size() == 1);
+	CHECK(readable[0] == 15);
+	ring.commit_read(1);
+
+	readable = ring.read_region();
+	CHECK(readable.size() == 7);
+	CHECK(readable[0] == 16);
+	CHECK(readable[2] == 20);
+	CHECK(readable[6] == 24);
+	ring.commit_read(7);
+	CHECK(ring.empty());
+
+	// Next write starts in the last slot
+	CHECK(ring.write_region().size() == 1);
+	ring.push(src);
+	CHECK(ring.try_pop() == 10);
+	CHECK(ring.read_available() == 7);
+}
+
+TEST_CASE("SPSC ring stress: items arrive complete and in order") {
+	constexpr uint32_t NumItems = 1'000'000;
+	SpscRing<uint32_t, 64> ring;
+
+	// Each side cycles through single items, bulk spans and in-place regions, with varying sizes
+	std::thread producer{[&] {
+		uint32_t next = 0;
+		std::array<uint32_t, 23> chunk;
+		for (unsigned round = 0; next < NumItems; round++) {
+			switch (round % 3) {
+				case 0:
+					if (ring.push(next))
+						next++;
+					break;
+
+				case 1: {
+					auto num = std::min<uint32_t>(1 + round % chunk.size(), NumItems - next);
+					std::iota(chunk.begin(), chunk.begin() + num, next);
+					next += ring.push(std::span{chunk.data(), num});
+				} break;
+
+				case 2: {
+					auto region = ring.write_region();
+					auto num = std::min<size_t>(region.size(), NumItems - next);
+					for (size_t i = 0; i < num; i++)
+						region[i] = next++;
+					ring.commit_write(num);
+				} break;
+			}
+			if (round % 64 == 0)
+				std::this_thread::yield();
+		}
+	}};
+
+	uint32_t expected = 0;
+	unsigned errors = 0;
+	std::array<uint32_t, 17> chunk;
+	for (unsigned round = 0; expected < NumItems; round++) {
+		switch (round % 3) {
+			case 0:
+				if (auto item = ring.try_pop())
+					errors += *item != expected++;
+				break;
+
+			case 1: {
+				auto num = ring.pop(std::span{chunk.data(), 1 + round % chunk.size()});
+				for (size_t i = 0; i < num; i++)
+					errors += chunk[i] != expected++;
+			} break;
+
+			case 2: {
+				auto region = ring.read_region();
+				for (auto item : region)
+					errors += item != expected++;
+				ring.commit_read(region.size());
+			} break;
+		}
+		if (round % 64 == 0)
+			std::this_thread::yield();
+	}
+
+	producer.join();
+	CHECK(errors == 0);
+	CHECK(expected == NumItems);
+	CHECK(ring.empty());
+}